@@ -13,8 +13,14 @@
 #define CONFIG_SDCARD_HAS_POWER_SWITCH 1
 #define CONFIG_SDCARD_POWER_SWITCH_ACTIVE_HIGH 1
 #define CONFIG_SDCARD_SPI_FREQ_20MHZ 1
-#define CONFIG_SDCARD_SPI_FREQ_IDX 0
+#define CONFIG_SDCARD_SPI_FREQ 20000000
+#define CONFIG_SDCARD_POLL_BURST_LEN 8
+#define CONFIG_SDCARD_CRC 1
+#define CONFIG_SDCARD_CRC_HW 1
+#define CONFIG_SDCARD_PRE_ERASE 1
+#define CONFIG_SDCARD_STATS 1
 #define CONFIG_USE_SPI 1
+#define CONFIG_SPI_BUS_OWNERSHIP 1
 #define CONFIG_SPI_TEST 1
 #define CONFIG_USE_CAN 1
 #define CONFIG_CAN_COUNT 3
@@ -29,5 +35,35 @@
 #define CONFIG_ARBIT_BPS_CAN_THREE 1
 #define CONFIG_CAN_LOG_DEBUG 1
 #define CONFIG_CAN_LOG_LEVEL 0
+#define CONFIG_CAN_RX_RING_SIZE 2048
+#define CONFIG_USE_BLOCKDEV 1
+#define CONFIG_BLOCKDEV_WRITE_SLOTS 16
+#define CONFIG_BLOCKDEV_MAX_RUN 16
+#define CONFIG_BLOCKDEV_TASK_PRIORITY 1
+#define CONFIG_BLOCKDEV_TEST 1
 #define CONFIG_USE_LFS_SD 1
+#define CONFIG_LFS_SD_CACHE_2048 1
+#define CONFIG_LFS_SD_CACHE_SIZE 2048
+#define CONFIG_LFS_SD_LOOKAHEAD_SIZE 8192
+#define CONFIG_LFS_SD_SYNC_ON_PERIOD 1
+#define CONFIG_LFS_SD_SYNC_MODE 2
+#define CONFIG_LFS_SD_SYNC_BYTES 65536
+#define CONFIG_LFS_SD_SYNC_MS 1000
+#define CONFIG_LFS_SD_MAX_OPEN_FILES 4
+#define CONFIG_LFS_SD_MAX_RINGS 2
+#define CONFIG_LFS_SD_RING_SEGMENT_SIZE 65536
+#define CONFIG_LFS_SD_ERASE_NONE 1
+#define CONFIG_LFS_SD_ERASE_STRATEGY 0
+#define CONFIG_LFS_SD_BOOT_LOG 1
 #define CONFIG_TEST_LFS_SD 1
+#define CONFIG_TEST_LFS_REPLAY 1
+#define CONFIG_USE_LFS_WRITER 1
+#define CONFIG_LFS_WRITER_STREAMS 3
+#define CONFIG_LFS_WRITER_BUF_SIZE 2048
+#define CONFIG_LFS_WRITER_BUF_COUNT 4
+#define CONFIG_LFS_WRITER_FLUSH_MS 500
+#define CONFIG_LFS_WRITER_TASK_PRIORITY 1
+#define CONFIG_TEST_LFS_WRITER 1
+#define CONFIG_USE_CAPTURE 1
+#define CONFIG_CAPTURE_BATCH_SIZE 512
+#define CONFIG_TEST_CAPTURE 1
@@ -69,6 +69,7 @@ extern uint32_t SystemCoreClock;
 #define configUSE_COUNTING_SEMAPHORES           1
 #define configQUEUE_REGISTRY_SIZE               4
 #define configUSE_QUEUE_SETS                    0
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   2 // index 1: SPI DMA completion
 #define configUSE_TIME_SLICING                  0
 #define configUSE_NEWLIB_REENTRANT              0
 #define configENABLE_BACKWARD_COMPATIBILITY     1
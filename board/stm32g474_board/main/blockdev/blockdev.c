@@ -0,0 +1,586 @@
+/*
+ * blockdev.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_BLOCKDEV
+
+#include "stdbool.h"
+#include "string.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "blockdev.h"
+#include "test_blockdev.h"
+#include "bsp/sdcard/sdcard.h"
+
+#define BLOCKDEV_TASK_STACK_SIZE        (512)
+#define BLOCKDEV_TASK_PRIORITY          (CONFIG_BLOCKDEV_TASK_PRIORITY)
+#define BLOCKDEV_SLOT_COUNT             (CONFIG_BLOCKDEV_WRITE_SLOTS)
+#define BLOCKDEV_MAX_RUN                (CONFIG_BLOCKDEV_MAX_RUN)
+#define BLOCKDEV_SLOT_TIMEOUT           (2000)
+
+typedef enum {
+    BLOCKDEV_SLOT_FREE = 0,
+    BLOCKDEV_SLOT_PENDING,      // queued, may still be overwritten
+    BLOCKDEV_SLOT_IN_FLIGHT,    // being written by the worker
+} BLOCKDEV_SLOT_STATE_T;
+
+typedef struct {
+    BLOCKDEV_SLOT_STATE_T state;
+    BLOCKDEV_CLIENT_T client;
+    uint32_t lba;
+    uint8_t data[BLOCKDEV_BLOCK_SIZE];
+} BLOCKDEV_SLOT_T;
+
+typedef enum {
+    BLOCKDEV_REQ_READ = 0,
+    BLOCKDEV_REQ_ERASE,
+} BLOCKDEV_REQ_OP_T;
+
+typedef struct {
+    BLOCKDEV_REQ_OP_T op;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t * pBuff;            // read only
+    int32_t status;
+} BLOCKDEV_REQ_T;
+
+typedef struct {
+    BLOCKDEV_REQ_T * pReq;      // outstanding read or erase, NULL if none
+    uint32_t pending;           // slots pending or in flight
+    int32_t error;              // first failed write since the last report
+    bool syncWait;
+    uint8_t priority;
+    SemaphoreHandle_t semDone;  // request or sync completion
+    StaticSemaphore_t semDoneStruct;
+    SemaphoreHandle_t mutexClient;  // one request or sync at a time
+    StaticSemaphore_t mutexClientStruct;
+} BLOCKDEV_CLIENT_CTX_T;
+
+static bool bInit = false;
+static TaskHandle_t taskHandle_blockdev = NULL;
+static StaticTask_t taskStruct_blockdev;
+static StackType_t taskStackStorage[BLOCKDEV_TASK_STACK_SIZE];
+static SemaphoreHandle_t mutexHandle = NULL;
+static StaticSemaphore_t mutexStruct;
+static SemaphoreHandle_t semFreeSlots = NULL;
+static StaticSemaphore_t semFreeSlotsStruct;
+/*
+ * Work is signalled with a semaphore, not a task notification: the worker
+ * owns the SPI bus while talking to the card and its notification is used
+ * for DMA completion.
+ */
+static SemaphoreHandle_t semWork = NULL;
+static StaticSemaphore_t semWorkStruct;
+static BLOCKDEV_SLOT_T slots[BLOCKDEV_SLOT_COUNT];
+static BLOCKDEV_CLIENT_CTX_T clients[N_BLOCKDEV_CLIENT];
+static uint32_t headLba = 0;    // block after the last write, elevator position
+static BLOCKDEV_STATS_T stats = {0};
+
+
+static BLOCKDEV_SLOT_T * BLOCKDEV_FindSlot(uint32_t lba, BLOCKDEV_SLOT_STATE_T state)
+{
+    for(uint32_t i = 0; i < BLOCKDEV_SLOT_COUNT; i++) {
+        if((slots[i].state == state) &&
+           ((state == BLOCKDEV_SLOT_FREE) || (slots[i].lba == lba))) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Pending data overrides what was read from the card. In flight slots are
+ * older than a pending slot of the same block, so they go first.
+ */
+static void BLOCKDEV_Overlay(const BLOCKDEV_REQ_T * pRead)
+{
+    static const BLOCKDEV_SLOT_STATE_T order[] = {
+        BLOCKDEV_SLOT_IN_FLIGHT,
+        BLOCKDEV_SLOT_PENDING
+    };
+
+    for(uint32_t n = 0; n < (sizeof(order) / sizeof(order[0])); n++) {
+        for(uint32_t i = 0; i < BLOCKDEV_SLOT_COUNT; i++) {
+            if((slots[i].state == order[n]) &&
+               (slots[i].lba >= pRead->lba) &&
+               (slots[i].lba < (pRead->lba + pRead->count))) {
+                memcpy(&pRead->pBuff[(slots[i].lba - pRead->lba) * BLOCKDEV_BLOCK_SIZE],
+                       slots[i].data, BLOCKDEV_BLOCK_SIZE);
+            }
+        }
+    }
+}
+
+
+static BLOCKDEV_CLIENT_T BLOCKDEV_NextRequest(void)
+{
+    BLOCKDEV_CLIENT_T best = N_BLOCKDEV_CLIENT;
+
+    for(uint32_t c = 0; c < N_BLOCKDEV_CLIENT; c++) {
+        if((clients[c].pReq != NULL) &&
+           ((best == N_BLOCKDEV_CLIENT) || (clients[c].priority < clients[best].priority))) {
+            best = (BLOCKDEV_CLIENT_T)c;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * Picks the next write run: the highest priority client with pending
+ * slots, its first block at or after the elevator position (wrapping to
+ * its lowest block), extended with consecutive pending blocks of any
+ * client. Slots of the run are marked in flight.
+ */
+static uint32_t BLOCKDEV_BuildRun(BLOCKDEV_SLOT_T ** run)
+{
+    BLOCKDEV_CLIENT_T client = N_BLOCKDEV_CLIENT;
+    BLOCKDEV_SLOT_T * pAhead = NULL;
+    BLOCKDEV_SLOT_T * pLowest = NULL;
+    BLOCKDEV_SLOT_T * pSlot;
+    uint32_t n = 0;
+
+    for(uint32_t i = 0; i < BLOCKDEV_SLOT_COUNT; i++) {
+        if((slots[i].state == BLOCKDEV_SLOT_PENDING) &&
+           ((client == N_BLOCKDEV_CLIENT) ||
+            (clients[slots[i].client].priority < clients[client].priority))) {
+            client = slots[i].client;
+        }
+    }
+    if(client == N_BLOCKDEV_CLIENT) {
+        return 0;
+    }
+    for(uint32_t i = 0; i < BLOCKDEV_SLOT_COUNT; i++) {
+        pSlot = &slots[i];
+        if((pSlot->state != BLOCKDEV_SLOT_PENDING) || (pSlot->client != client)) {
+            continue;
+        }
+        if((pLowest == NULL) || (pSlot->lba < pLowest->lba)) {
+            pLowest = pSlot;
+        }
+        if((pSlot->lba >= headLba) &&
+           ((pAhead == NULL) || (pSlot->lba < pAhead->lba))) {
+            pAhead = pSlot;
+        }
+    }
+    pSlot = (pAhead != NULL) ? pAhead : pLowest;
+    while((pSlot != NULL) && (n < BLOCKDEV_MAX_RUN)) {
+        pSlot->state = BLOCKDEV_SLOT_IN_FLIGHT;
+        run[n++] = pSlot;
+        pSlot = BLOCKDEV_FindSlot(pSlot->lba + 1, BLOCKDEV_SLOT_PENDING);
+    }
+    return n;
+}
+
+
+static int32_t BLOCKDEV_WriteRun(BLOCKDEV_SLOT_T * const * run, uint32_t n)
+{
+    int32_t ret;
+    int32_t retEnd;
+
+    if(n > 1) {
+        ret = SDCARD_WriteBegin(run[0]->lba, n);
+        if(ret == SDCARD_ERR_NONE) {
+            for(uint32_t i = 0; i < n; i++) {
+                ret = SDCARD_WriteData(run[i]->data);
+                if(ret != SDCARD_ERR_NONE) {
+                    break;
+                }
+            }
+            /* Always send the stop token, even on error */
+            retEnd = SDCARD_WriteEnd();
+            if(ret == SDCARD_ERR_NONE) {
+                ret = retEnd;
+            }
+        }
+        if(ret == SDCARD_ERR_NONE) {
+            return ret;
+        }
+        /* Fall back to single block writes, which retry at a lower clock */
+    }
+    for(uint32_t i = 0; i < n; i++) {
+        ret = SDCARD_WriteSingleBlock(run[i]->lba, run[i]->data, BLOCKDEV_BLOCK_SIZE);
+        if(ret != SDCARD_ERR_NONE) {
+            return ret;
+        }
+    }
+    return SDCARD_ERR_NONE;
+}
+
+
+/*
+ * Pending writes of the client inside the erased range are dropped, the
+ * erase supersedes them. Nothing is in flight while the worker is here.
+ * Returns the number of slots freed.
+ */
+static uint32_t BLOCKDEV_DropPending(BLOCKDEV_CLIENT_T client, const BLOCKDEV_REQ_T * pErase)
+{
+    uint32_t n = 0;
+
+    for(uint32_t i = 0; i < BLOCKDEV_SLOT_COUNT; i++) {
+        if((slots[i].state == BLOCKDEV_SLOT_PENDING) &&
+           (slots[i].client == client) &&
+           (slots[i].lba >= pErase->lba) &&
+           (slots[i].lba < (pErase->lba + pErase->count))) {
+            slots[i].state = BLOCKDEV_SLOT_FREE;
+            clients[client].pending--;
+            n++;
+        }
+    }
+    stats.client[client].dropped += n;
+    return n;
+}
+
+
+/* Returns false when there is nothing left to do */
+static bool BLOCKDEV_Service(void)
+{
+    BLOCKDEV_SLOT_T * run[BLOCKDEV_MAX_RUN];
+    BLOCKDEV_CLIENT_CTX_T * pClient;
+    BLOCKDEV_REQ_T * pReq;
+    BLOCKDEV_CLIENT_T requester;
+    uint32_t n;
+    int32_t ret;
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    /*
+     * Reads and erases block their caller, serve them ahead of queued writes
+     */
+    requester = BLOCKDEV_NextRequest();
+    if(requester != N_BLOCKDEV_CLIENT) {
+        pClient = &clients[requester];
+        pReq = pClient->pReq;
+        if(pReq->op == BLOCKDEV_REQ_ERASE) {
+            n = BLOCKDEV_DropPending(requester, pReq);
+            xSemaphoreGive(mutexHandle);
+            for(uint32_t i = 0; i < n; i++) {
+                xSemaphoreGive(semFreeSlots);
+            }
+
+            pReq->status = SDCARD_Erase(pReq->lba, pReq->lba + pReq->count - 1);
+
+            xSemaphoreTake(mutexHandle, portMAX_DELAY);
+        } else {
+            xSemaphoreGive(mutexHandle);
+
+            pReq->status = SDCARD_ReadMultiBlock(pReq->lba, pReq->pBuff, pReq->count);
+
+            xSemaphoreTake(mutexHandle, portMAX_DELAY);
+            if(pReq->status == SDCARD_ERR_NONE) {
+                BLOCKDEV_Overlay(pReq);
+            }
+        }
+        pClient->pReq = NULL;
+        xSemaphoreGive(mutexHandle);
+        xSemaphoreGive(pClient->semDone);
+        return true;
+    }
+
+    n = BLOCKDEV_BuildRun(run);
+    xSemaphoreGive(mutexHandle);
+    if(n == 0) {
+        return false;
+    }
+
+    ret = BLOCKDEV_WriteRun(run, n);
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    stats.writeRuns++;
+    stats.writeRunBlocks += n;
+    if(n > stats.maxRun) {
+        stats.maxRun = n;
+    }
+    headLba = run[n - 1]->lba + 1;
+    for(uint32_t i = 0; i < n; i++) {
+        pClient = &clients[run[i]->client];
+        if((ret != SDCARD_ERR_NONE) && (pClient->error == BLOCKDEV_ERR_NONE)) {
+            pClient->error = ret;
+        }
+        run[i]->state = BLOCKDEV_SLOT_FREE;
+        pClient->pending--;
+        if((pClient->pending == 0) && pClient->syncWait) {
+            pClient->syncWait = false;
+            xSemaphoreGive(pClient->semDone);
+        }
+    }
+    xSemaphoreGive(mutexHandle);
+    for(uint32_t i = 0; i < n; i++) {
+        xSemaphoreGive(semFreeSlots);
+    }
+    return true;
+}
+
+
+static void BLOCKDEV_Task(void * pvParam)
+{
+    while(bInit != true) {
+        vTaskDelay(1);
+    }
+
+    while(1) {
+        xSemaphoreTake(semWork, portMAX_DELAY);
+        while(BLOCKDEV_Service());
+    }
+}
+
+
+void BLOCKDEV_init(void)
+{
+    if(bInit == true) {
+        return;
+    }
+
+    memset(slots, 0, sizeof(slots));
+    memset(clients, 0, sizeof(clients));
+    for(uint32_t c = 0; c < N_BLOCKDEV_CLIENT; c++) {
+        clients[c].priority = (uint8_t)c;
+        clients[c].semDone = xSemaphoreCreateBinaryStatic(&clients[c].semDoneStruct);
+        configASSERT(clients[c].semDone != NULL);
+        clients[c].mutexClient = xSemaphoreCreateMutexStatic(&clients[c].mutexClientStruct);
+        configASSERT(clients[c].mutexClient != NULL);
+    }
+    mutexHandle = xSemaphoreCreateMutexStatic(&mutexStruct);
+    configASSERT(mutexHandle != NULL);
+    semFreeSlots = xSemaphoreCreateCountingStatic(BLOCKDEV_SLOT_COUNT,
+                                BLOCKDEV_SLOT_COUNT, &semFreeSlotsStruct);
+    configASSERT(semFreeSlots != NULL);
+    semWork = xSemaphoreCreateBinaryStatic(&semWorkStruct);
+    configASSERT(semWork != NULL);
+
+    taskHandle_blockdev = xTaskCreateStatic(BLOCKDEV_Task,
+                                    "blockdev",
+                                    BLOCKDEV_TASK_STACK_SIZE,
+                                    (void *)0,
+                                    BLOCKDEV_TASK_PRIORITY,
+                                    taskStackStorage,
+                                    &taskStruct_blockdev);
+    configASSERT(taskHandle_blockdev != NULL);
+
+#if CONFIG_BLOCKDEV_TEST
+    TEST_BLOCKDEV_init();
+#endif
+
+    bInit = true;
+}
+
+
+/* lba to lba + count - 1 lies on the card, without wrapping around */
+static bool BLOCKDEV_InRange(uint32_t lba, uint32_t count)
+{
+    const uint32_t blockCount = SDCARD_GetBlockCount();
+    return (lba < blockCount) && (count <= (blockCount - lba));
+}
+
+
+/* Hands a read or erase to the worker and waits for it */
+static int32_t BLOCKDEV_Request(BLOCKDEV_CLIENT_T client, BLOCKDEV_REQ_T * pReq)
+{
+    BLOCKDEV_CLIENT_CTX_T * pClient = &clients[client];
+
+    pReq->status = SDCARD_ERR_NONE;
+
+    xSemaphoreTake(pClient->mutexClient, portMAX_DELAY);
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    pClient->pReq = pReq;
+    if(pReq->op == BLOCKDEV_REQ_ERASE) {
+        stats.client[client].eraseRequests++;
+        stats.client[client].eraseBlocks += pReq->count;
+    } else {
+        stats.client[client].readRequests++;
+        stats.client[client].readBlocks += pReq->count;
+    }
+    xSemaphoreGive(mutexHandle);
+    xSemaphoreGive(semWork);
+    xSemaphoreTake(pClient->semDone, portMAX_DELAY);
+    xSemaphoreGive(pClient->mutexClient);
+
+    return pReq->status;
+}
+
+
+int32_t BLOCKDEV_read(BLOCKDEV_CLIENT_T client, uint32_t lba, void * buff, uint32_t count)
+{
+    BLOCKDEV_REQ_T read;
+
+    if((client >= N_BLOCKDEV_CLIENT) || (buff == NULL) || (count == 0)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return BLOCKDEV_ERR_NOT_INITIALIZED;
+    }
+    if(!BLOCKDEV_InRange(lba, count)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+
+    read.op = BLOCKDEV_REQ_READ;
+    read.lba = lba;
+    read.count = count;
+    read.pBuff = (uint8_t *)buff;
+    return BLOCKDEV_Request(client, &read);
+}
+
+
+int32_t BLOCKDEV_erase(BLOCKDEV_CLIENT_T client, uint32_t lba, uint32_t count)
+{
+    BLOCKDEV_REQ_T erase;
+
+    if((client >= N_BLOCKDEV_CLIENT) || (count == 0)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return BLOCKDEV_ERR_NOT_INITIALIZED;
+    }
+    if(!BLOCKDEV_InRange(lba, count)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+
+    erase.op = BLOCKDEV_REQ_ERASE;
+    erase.lba = lba;
+    erase.count = count;
+    erase.pBuff = NULL;
+    return BLOCKDEV_Request(client, &erase);
+}
+
+
+static int32_t BLOCKDEV_TakeError(BLOCKDEV_CLIENT_CTX_T * pClient)
+{
+    const int32_t ret = pClient->error;
+    pClient->error = BLOCKDEV_ERR_NONE;
+    return ret;
+}
+
+
+int32_t BLOCKDEV_write(BLOCKDEV_CLIENT_T client, uint32_t lba, const void * buff, uint32_t count)
+{
+    const uint8_t * pSrc = (const uint8_t *)buff;
+    BLOCKDEV_CLIENT_CTX_T * pClient;
+    BLOCKDEV_SLOT_T * pSlot;
+    int32_t ret;
+
+    if((client >= N_BLOCKDEV_CLIENT) || (buff == NULL) || (count == 0)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return BLOCKDEV_ERR_NOT_INITIALIZED;
+    }
+    if(!BLOCKDEV_InRange(lba, count)) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+    pClient = &clients[client];
+
+    for(uint32_t i = 0; i < count; i++, lba++, pSrc += BLOCKDEV_BLOCK_SIZE) {
+        /*
+         * Rewrite of a block that is still queued, replace its data
+         */
+        xSemaphoreTake(mutexHandle, portMAX_DELAY);
+        pSlot = BLOCKDEV_FindSlot(lba, BLOCKDEV_SLOT_PENDING);
+        if(pSlot != NULL) {
+            memcpy(pSlot->data, pSrc, BLOCKDEV_BLOCK_SIZE);
+            stats.client[client].writeBlocks++;
+            stats.client[client].coalesced++;
+            xSemaphoreGive(mutexHandle);
+            continue;
+        }
+        xSemaphoreGive(mutexHandle);
+
+        xSemaphoreGive(semWork);
+        if(pdTRUE != xSemaphoreTake(semFreeSlots, BLOCKDEV_SLOT_TIMEOUT)) {
+            return BLOCKDEV_ERR_TIMEOUT;
+        }
+
+        xSemaphoreTake(mutexHandle, portMAX_DELAY);
+        pSlot = BLOCKDEV_FindSlot(lba, BLOCKDEV_SLOT_PENDING);
+        if(pSlot != NULL) {
+            /* Queued by another task meanwhile */
+            memcpy(pSlot->data, pSrc, BLOCKDEV_BLOCK_SIZE);
+            stats.client[client].coalesced++;
+            xSemaphoreGive(semFreeSlots);
+        } else {
+            pSlot = BLOCKDEV_FindSlot(0, BLOCKDEV_SLOT_FREE);
+            configASSERT(pSlot != NULL);
+            memcpy(pSlot->data, pSrc, BLOCKDEV_BLOCK_SIZE);
+            pSlot->lba = lba;
+            pSlot->client = client;
+            pSlot->state = BLOCKDEV_SLOT_PENDING;
+            pClient->pending++;
+            if((BLOCKDEV_SLOT_COUNT - uxSemaphoreGetCount(semFreeSlots)) > stats.maxPending) {
+                stats.maxPending = BLOCKDEV_SLOT_COUNT - uxSemaphoreGetCount(semFreeSlots);
+            }
+        }
+        stats.client[client].writeBlocks++;
+        xSemaphoreGive(mutexHandle);
+    }
+    xSemaphoreGive(semWork);
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    ret = BLOCKDEV_TakeError(pClient);
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+int32_t BLOCKDEV_sync(BLOCKDEV_CLIENT_T client)
+{
+    BLOCKDEV_CLIENT_CTX_T * pClient;
+    int32_t ret;
+
+    if(client >= N_BLOCKDEV_CLIENT) {
+        return BLOCKDEV_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return BLOCKDEV_ERR_NOT_INITIALIZED;
+    }
+    pClient = &clients[client];
+
+    xSemaphoreTake(pClient->mutexClient, portMAX_DELAY);
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    stats.client[client].syncs++;
+    if(pClient->pending != 0) {
+        pClient->syncWait = true;
+        xSemaphoreGive(mutexHandle);
+        xSemaphoreGive(semWork);
+        xSemaphoreTake(pClient->semDone, portMAX_DELAY);
+        xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    }
+    ret = BLOCKDEV_TakeError(pClient);
+    xSemaphoreGive(mutexHandle);
+    xSemaphoreGive(pClient->mutexClient);
+    return ret;
+}
+
+
+void BLOCKDEV_setPriority(BLOCKDEV_CLIENT_T client, uint8_t priority)
+{
+    if((client >= N_BLOCKDEV_CLIENT) || (bInit != true)) {
+        return;
+    }
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    clients[client].priority = priority;
+    xSemaphoreGive(mutexHandle);
+}
+
+
+const BLOCKDEV_STATS_T * BLOCKDEV_getStats(void)
+{
+    return &stats;
+}
+
+
+void BLOCKDEV_resetStats(void)
+{
+    if(bInit != true) {
+        return;
+    }
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    memset(&stats, 0, sizeof(stats));
+    xSemaphoreGive(mutexHandle);
+}
+
+#endif /* CONFIG_USE_BLOCKDEV */
@@ -0,0 +1,84 @@
+/*
+ * blockdev.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef BLOCKDEV_BLOCKDEV_H_
+#define BLOCKDEV_BLOCKDEV_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_BLOCKDEV
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "bsp/sdcard/sdcard.h"
+
+#define BLOCKDEV_ERR_NONE               (0)
+// Don't overlap with SPI and SD card error values
+#define BLOCKDEV_ERR_INVALID_ARG        (SDCARD_ERR_LASTENTRY)
+#define BLOCKDEV_ERR_NOT_INITIALIZED    (SDCARD_ERR_LASTENTRY-1)
+#define BLOCKDEV_ERR_TIMEOUT            (SDCARD_ERR_LASTENTRY-2)
+
+#define BLOCKDEV_BLOCK_SIZE             (SDCARD_BLOCK_SIZE)
+
+/*
+ * Clients sharing the SD card. Lower value is served first when requests
+ * from several clients are pending, see BLOCKDEV_setPriority().
+ */
+typedef enum {
+    BLOCKDEV_CLIENT_LFS = 0,
+    BLOCKDEV_CLIENT_FATFS,
+    BLOCKDEV_CLIENT_MSC,
+    BLOCKDEV_CLIENT_RAWLOG,
+    N_BLOCKDEV_CLIENT
+} BLOCKDEV_CLIENT_T;
+
+typedef struct {
+    uint32_t readRequests;
+    uint32_t readBlocks;
+    uint32_t writeBlocks;       // blocks handed to BLOCKDEV_write()
+    uint32_t coalesced;         // rewrites of a block still queued
+    uint32_t eraseRequests;
+    uint32_t eraseBlocks;
+    uint32_t dropped;           // queued writes superseded by an erase
+    uint32_t syncs;
+} BLOCKDEV_CLIENT_STATS_T;
+
+typedef struct {
+    BLOCKDEV_CLIENT_STATS_T client[N_BLOCKDEV_CLIENT];
+    uint32_t writeRuns;         // CMD24/CMD25 transactions
+    uint32_t writeRunBlocks;    // blocks written by those transactions
+    uint32_t maxRun;
+    uint32_t maxPending;        // write slot high watermark
+} BLOCKDEV_STATS_T;
+
+void BLOCKDEV_init(void);
+/*
+ * Blocking read of count blocks into buff. Data still queued for writing
+ * is returned instead of the card contents.
+ */
+int32_t BLOCKDEV_read(BLOCKDEV_CLIENT_T client, uint32_t lba, void * buff, uint32_t count);
+/*
+ * Copies count blocks into write-back slots and returns, blocking only
+ * while no slot is free. Errors from earlier writes of this client are
+ * returned here or by BLOCKDEV_sync().
+ */
+int32_t BLOCKDEV_write(BLOCKDEV_CLIENT_T client, uint32_t lba, const void * buff, uint32_t count);
+/*
+ * Blocking erase of count blocks. Writes of this client still queued for
+ * those blocks are discarded. Erased blocks read back as all 0x00 or all
+ * 0xFF depending on the card.
+ */
+int32_t BLOCKDEV_erase(BLOCKDEV_CLIENT_T client, uint32_t lba, uint32_t count);
+/* Blocks until all writes of this client are on the card */
+int32_t BLOCKDEV_sync(BLOCKDEV_CLIENT_T client);
+/* 0 is the highest priority */
+void BLOCKDEV_setPriority(BLOCKDEV_CLIENT_T client, uint8_t priority);
+const BLOCKDEV_STATS_T * BLOCKDEV_getStats(void);
+void BLOCKDEV_resetStats(void);
+
+#endif /* CONFIG_USE_BLOCKDEV */
+#endif /* BLOCKDEV_BLOCKDEV_H_ */
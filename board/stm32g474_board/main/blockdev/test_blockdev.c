@@ -0,0 +1,97 @@
+/*
+ * test_blockdev.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_BLOCKDEV_TEST
+
+#include "string.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "FreeRTOS.h"
+#include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "blockdev.h"
+#include "test_blockdev.h"
+
+static bool bInit = false;
+
+static const char * const clientName[N_BLOCKDEV_CLIENT] = {
+    "lfs",
+    "fatfs",
+    "msc",
+    "rawlog",
+};
+
+static BaseType_t CmdBlockdevStats(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t internalState = 0;
+    static uint32_t client = 0;
+    const BLOCKDEV_STATS_T * pStats = BLOCKDEV_getStats();
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(internalState == 0) {
+        ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam != NULL) {
+            if((strParamLen == 5) && (strncmp(ptrStrParam, "reset", 5) == 0)) {
+                BLOCKDEV_resetStats();
+                snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+            } else {
+                snprintf(pcWriteBuffer, xWriteBufferLen,
+                        "\tError: Parameter 1 value is invalid!\r\n\r\n");
+            }
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tWrite runs: %lu, blocks: %lu, avg run: %lu, max run: %lu\r\n"
+                "\tMax pending slots: %lu\r\n"
+                "\tClient  reads  read blocks  write blocks  coalesced  syncs  erases  erase blocks  dropped\r\n",
+                pStats->writeRuns, pStats->writeRunBlocks,
+                (pStats->writeRuns != 0) ? (pStats->writeRunBlocks / pStats->writeRuns) : 0,
+                pStats->maxRun, pStats->maxPending);
+        client = 0;
+        internalState++;
+        return 1;
+    } else if(client < N_BLOCKDEV_CLIENT) {
+        const BLOCKDEV_CLIENT_STATS_T * pClient = &pStats->client[client];
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\t%-7s %-6lu %-12lu %-13lu %-10lu %-6lu %-7lu %-13lu %lu\r\n",
+                clientName[client],
+                pClient->readRequests, pClient->readBlocks,
+                pClient->writeBlocks, pClient->coalesced, pClient->syncs,
+                pClient->eraseRequests, pClient->eraseBlocks, pClient->dropped);
+        client++;
+        return 1;
+    }
+    internalState = 0;
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\r\n");
+    return 0;
+}
+
+static const CLI_Command_Definition_t blockdev_stats = {
+    "bd_stats",
+    "bd_stats [reset]:\r\n"
+    "\tShow or reset block device queue statistics\r\n\r\n",
+    CmdBlockdevStats,
+    -1
+};
+
+void TEST_BLOCKDEV_init(void)
+{
+    if(bInit) {
+        return;
+    }
+    FreeRTOS_CLIRegisterCommand(&blockdev_stats);
+    bInit = true;
+}
+
+#endif /* CONFIG_BLOCKDEV_TEST */
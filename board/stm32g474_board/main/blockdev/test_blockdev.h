@@ -0,0 +1,18 @@
+/*
+ * test_blockdev.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef BLOCKDEV_TEST_BLOCKDEV_H_
+#define BLOCKDEV_TEST_BLOCKDEV_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_BLOCKDEV
+
+void TEST_BLOCKDEV_init(void);
+
+#endif /* CONFIG_USE_BLOCKDEV */
+#endif /* BLOCKDEV_TEST_BLOCKDEV_H_ */
@@ -5,9 +5,24 @@
 #include "board_api.h"
 #include "test_board.h"
 #include "lpuart.h"
+#include "bsp_cycle.h"
 #include "spi/bsp_spi.h"
 #include "can/bsp_can.h"
 
+#if CONFIG_APB2_DIV_1
+#define BOARD_APB2_DIVIDER      RCC_HCLK_DIV1
+#elif CONFIG_APB2_DIV_2
+#define BOARD_APB2_DIVIDER      RCC_HCLK_DIV2
+#elif CONFIG_APB2_DIV_4
+#define BOARD_APB2_DIVIDER      RCC_HCLK_DIV4
+#elif CONFIG_APB2_DIV_8
+#define BOARD_APB2_DIVIDER      RCC_HCLK_DIV8
+#elif CONFIG_APB2_DIV_16
+#define BOARD_APB2_DIVIDER      RCC_HCLK_DIV16
+#else
+#error "Invalid APB2 Prescaler!"
+#endif
+
 static PCD_HandleTypeDef hpcd_USB_FS;
 
 void HAL_MspInit(void)
@@ -63,7 +78,7 @@ static void SystemClock_Config(void)
     RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
     RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
     RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV2;
-    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV4; // SPI source 40MHz
+    RCC_ClkInitStruct.APB2CLKDivider = BOARD_APB2_DIVIDER; // SPI source CONFIG_APB2_PERIPH_FREQ
 
     if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_4) != HAL_OK) {
         __disable_irq();
@@ -159,6 +174,7 @@ void board_init()
 {
     HAL_Init();
     SystemClock_Config();
+    BSP_CYCLE_init();
     SysTick->CTRL &= ~1U;   // Explicitly disable systick to prevent its ISR runs before scheduler start
     BoardGpio_Config();
     LPUART_Init();
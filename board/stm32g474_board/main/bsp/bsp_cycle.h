@@ -0,0 +1,37 @@
+/*
+ * bsp_cycle.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef BSP_BSP_CYCLE_H_
+#define BSP_BSP_CYCLE_H_
+
+#include "stdint.h"
+#include "stm32g4xx.h"
+
+/*
+ * Cortex-M4 DWT cycle counter, used for sub-tick latency measurement.
+ * The counter wraps every 2^32 / SystemCoreClock seconds (~26s at 160MHz),
+ * so only use it for intervals shorter than that.
+ */
+
+static inline void BSP_CYCLE_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t BSP_CYCLE_get(void)
+{
+    return DWT->CYCCNT;
+}
+
+static inline uint32_t BSP_CYCLE_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000U);
+}
+
+#endif /* BSP_BSP_CYCLE_H_ */
@@ -7,6 +7,8 @@
 
 #include "logger_conf.h"
 #include "stdbool.h"
+#include "stddef.h"
+#include "string.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
@@ -14,17 +16,37 @@
 #include "test_can.h"
 #include "stm32g4xx_hal.h"
 #include "lpuart.h"
+#include "bsp/bsp_cycle.h"
+#include "capture/capture.h"
 
+#if CONFIG_USE_CAPTURE
+#define CONFIG_CAN_TASK_STACK_SIZE      (512)   // capture encodes in the bus task
+#define CAN_TASK_WAIT_TICKS             (pdMS_TO_TICKS(1000))
+#else
 #define CONFIG_CAN_TASK_STACK_SIZE      (256)
+#define CAN_TASK_WAIT_TICKS             (portMAX_DELAY)
+#endif
 #define CONFIG_CAN_TASK_PRIORITY        (1)
 #define CONFIG_CAN_TX_Q_LEN             (3)
 #define CONFIG_CAN_TX_ELEM_SIZE         sizeof(CAN_TX_T)
-#define CONFIG_CAN_RX_Q_LEN             (3)
-#define CONFIG_CAN_RX_ELEM_SIZE         sizeof(CAN_RX_T)
+#define CAN_RX_RING_SIZE                (CONFIG_CAN_RX_RING_SIZE)
+#define CAN_RX_RING_MASK                (CAN_RX_RING_SIZE - 1)
+#define CAN_RX_REC_SIZE(len)            ((sizeof(CAN_RX_T) + (len) + 3U) & ~3U)
+#define CAN_RX_REC_MAX                  CAN_RX_REC_SIZE(CONFIG_CANFD_DATA_SIZE)
+
+#if (CAN_RX_RING_SIZE & CAN_RX_RING_MASK) != 0
+#error "CAN RX ring size must be a power of two"
+#endif
 
 #define CAN_TX_BIT                      (0x01UL)
 #define CAN_RX_BIT                      (0x02UL)
 
+/* Interrupt flags served without HAL_FDCAN_IRQHandler() */
+#define CAN_IR_RX_FAST                  (FDCAN_FLAG_RX_FIFO0_NEW_MESSAGE | FDCAN_FLAG_RX_FIFO1_NEW_MESSAGE)
+
+/* Owner of a HAL handle, the HAL only calls back with handles from can[] */
+#define CAN_FROM_HANDLE(hfdcan)         ((CAN_T *)((uint8_t *)(hfdcan) - offsetof(CAN_T, FDCAN_handle)))
+
 static char const * const taskName[CONFIG_CAN_COUNT] = {
 #if (CONFIG_CAN_COUNT >= 1)
     "can1",
@@ -51,13 +73,21 @@ typedef struct {
     IRQn_Type IRQn;
     ARBIT_BITRATE_T arbit_bps;
     DATA_BITRATE_T data_bps;
+    CAN_ID_T id;
     TaskHandle_t task;
     StaticTask_t taskStruct;
     QueueHandle_t txQueueHandle;
     StaticQueue_t txQueueStruct;
-    QueueHandle_t rxQueueHandle;
-    StaticQueue_t rxQueueStruct;
-    uint32_t debugRxCount;
+    /*
+     * Single producer (interrupt), single consumer (task) ring of
+     * CAN_RX_T records. head and tail are free running byte counts,
+     * each one written by one side only.
+     */
+    uint8_t * rxRing;
+    volatile uint32_t rxHead;
+    volatile uint32_t rxTail;
+    CAN_STATS_T stats;
+    CAN_FILTER_PROFILE_T filters;
     bool txInProgress;
     bool isEnabled;
 } CAN_T;
@@ -66,7 +96,8 @@ static bool bInit = false;
 static CAN_T can[N_CAN_ID];
 static StackType_t canTaskStack[N_CAN_ID][CONFIG_CAN_TASK_STACK_SIZE];
 static uint8_t txQueueSto[N_CAN_ID][CONFIG_CAN_TX_Q_LEN * CONFIG_CAN_TX_ELEM_SIZE];
-static uint8_t rxQueueSto[N_CAN_ID][CONFIG_CAN_RX_Q_LEN * CONFIG_CAN_RX_ELEM_SIZE];
+static uint8_t rxRingSto[N_CAN_ID][CAN_RX_RING_SIZE] __attribute__((aligned(4)));
+static uint8_t rxDiscard[CONFIG_CANFD_DATA_SIZE];
 
 static const uint32_t DLC_TO_BYTES[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12,
                     16, 20, 24, 32, 48, 64};
@@ -130,6 +161,20 @@ static FDCAN_GlobalTypeDef * DEFAULT_FDCAN[N_CAN_ID] = {
 };
 
 
+static uint32_t const FILTER_TYPE_TO_HAL[N_CAN_FILTER_TYPE] = {
+    FDCAN_FILTER_RANGE,
+    FDCAN_FILTER_DUAL,
+    FDCAN_FILTER_MASK
+};
+
+
+static uint32_t const FILTER_ACTION_TO_HAL[N_CAN_FILTER_ACTION] = {
+    FDCAN_FILTER_TO_RXFIFO0,
+    FDCAN_FILTER_TO_RXFIFO1,
+    FDCAN_FILTER_REJECT
+};
+
+
 static IRQn_Type const DEFAULT_FCAN_IRQ[N_CAN_ID] = {
 #if (CONFIG_CAN_COUNT >=1)
     FDCAN1_IT0_IRQn,
@@ -208,9 +253,39 @@ static ARBIT_BITRATE_T const DEFAULT_ARBIT_BITRATE[CONFIG_CAN_COUNT] = {
 };
 
 
+/*
+ * Consumer side. Records are handed out in place and released once the
+ * caller is done with them.
+ */
+static void can_rx_drain(CAN_T * const me)
+{
+    uint32_t tail = me->rxTail;
+    CAN_RX_T * pRec;
+
+    while(tail != me->rxHead) {
+        /* Record contents are valid once head has moved past them */
+        __DMB();
+        pRec = (CAN_RX_T *)&me->rxRing[tail & CAN_RX_RING_MASK];
+        if(pRec->size == 0) {
+            /* Padding up to the end of the ring */
+            tail += CAN_RX_RING_SIZE - (tail & CAN_RX_RING_MASK);
+        } else {
+            me->stats.rxFrames++;
+#if CONFIG_USE_CAPTURE
+            /* Record layout in capture.h */
+            CAPTURE_rx(me->id, pRec);
+#endif
+            tail += pRec->size;
+        }
+        /* Done with the record before handing it back */
+        __DMB();
+        me->rxTail = tail;
+    }
+}
+
+
 static void can_task(void * pvParam)
 {
-    CAN_RX_T rxElem;
     CAN_TX_T txElem;
     CAN_T * const me = (CAN_T *)pvParam;
     uint32_t notifyValue = 0;
@@ -220,14 +295,13 @@ static void can_task(void * pvParam)
     HAL_NVIC_EnableIRQ(me->IRQn);
 
     me->txInProgress = false;
-    me->debugRxCount = 0;
 
     while(1) {
         if(pdPASS == xTaskNotifyWait(
                                 pdFALSE,
                                 UINT32_MAX,
                                 &notifyValue,
-                                portMAX_DELAY)) {
+                                CAN_TASK_WAIT_TICKS)) {
             if(0 != (notifyValue & CAN_TX_BIT)) {
                 if(pdTRUE == xQueueReceive(me->txQueueHandle, &txElem, 0)) {
                     if(HAL_OK == HAL_FDCAN_AddMessageToTxFifoQ(
@@ -235,6 +309,9 @@ static void can_task(void * pvParam)
                                         &(txElem.header),
                                         &(txElem.data[0]))) {
                         me->txInProgress = true;
+#if CONFIG_USE_CAPTURE
+                        CAPTURE_tx(me->id, &txElem, BSP_CYCLE_get());
+#endif
                     }
                 } else {
                     me->txInProgress = false;
@@ -242,26 +319,17 @@ static void can_task(void * pvParam)
             }
 
             if(0 != (notifyValue & CAN_RX_BIT)) {
-                while(pdTRUE == xQueueReceive(me->rxQueueHandle,
-                        &rxElem, 0)) {
-                    me->debugRxCount++;
-                    /*
-                     * [0]     : tag (0xFF)
-                     * [1..2]  : length
-                     * [3..6]  : timestamp offset
-                     * [7..10] : SEQ number
-                     * [11]    : packet type
-                     *             0x00: Start Time in Ticks
-                     *             0x01: Tx CAN standard
-                     *             0x02: Rx CAN standard
-                     *             0x03: Tx CAN-FD
-                     *             0x04: Rx CAN-FD
-                     * [12..N] : payload
-                     * [N]     : checksum8
-                     */
-                    /// TODO: Write to SD card
-                }
+                can_rx_drain(me);
             }
+#if CONFIG_USE_CAPTURE
+            /* One write for everything drained, also ends a stopped session */
+            CAPTURE_commit(me->id);
+#endif
+        } else {
+#if CONFIG_USE_CAPTURE
+            /* Quiet bus */
+            CAPTURE_poll(me->id);
+#endif
         }
     }
     vTaskDelete(NULL);
@@ -269,42 +337,115 @@ static void can_task(void * pvParam)
 
 
 /*
- * NOTE: This called from the interrupt
+ * Producer side, called from the interrupt. Reserves room for the largest
+ * record at the current head, skipping to the ring start if the end is too
+ * close. Returns NULL if the ring is full.
  */
-void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs)
+static CAN_RX_T * can_rx_reserve(CAN_T * const me, uint32_t * pPad)
 {
-    CAN_RX_T rxElem = {0};
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    CAN_T * me = NULL;
-    uint32_t id = 0;
+    const uint32_t head = me->rxHead;
+    const uint32_t offset = head & CAN_RX_RING_MASK;
+    const uint32_t room = CAN_RX_RING_SIZE - (head - me->rxTail);
+    uint32_t pad = 0;
+
+    if((CAN_RX_RING_SIZE - offset) < CAN_RX_REC_MAX) {
+        pad = CAN_RX_RING_SIZE - offset;
+    }
+    if(room < (pad + CAN_RX_REC_MAX)) {
+        return NULL;
+    }
+    if(pad != 0) {
+        ((CAN_RX_T *)&me->rxRing[offset])->size = 0;
+    }
+    *pPad = pad;
+    return (CAN_RX_T *)&me->rxRing[(head + pad) & CAN_RX_RING_MASK];
+}
+
 
-    for(id = 0; id < CONFIG_CAN_COUNT; id++) {
-        me = &can[id];
-        if(me->FDCAN_handle.Instance == hfdcan->Instance) {
+/*
+ * Moves every element pending in an RX FIFO into the ring, called from the
+ * interrupt. Elements that waited in the FIFO are stamped when they are
+ * read, at most two frames late. Returns the number of frames added.
+ */
+static uint32_t can_rx_fifo(CAN_T * const me, const uint32_t fifo)
+{
+    FDCAN_RxHeaderTypeDef header;
+    CAN_RX_T * pRec;
+    uint32_t pad;
+    uint32_t timestamp;
+    uint32_t count = 0;
+
+    while(HAL_FDCAN_GetRxFifoFillLevel(&(me->FDCAN_handle), fifo) != 0) {
+        timestamp = BSP_CYCLE_get();
+        pad = 0;
+        pRec = can_rx_reserve(me, &pad);
+        /* Data goes straight into the ring */
+        if(HAL_OK != HAL_FDCAN_GetRxMessage(&(me->FDCAN_handle), fifo, &header,
+                            (pRec != NULL) ? &(pRec->data[0]) : &rxDiscard[0])) {
+            /// TODO: Handle this
+            configASSERT(pdFALSE);
             break;
         }
+        if(pRec == NULL) {
+            /* The message is read anyway to free the FIFO element */
+            me->stats.rxOverrun++;
+            continue;
+        }
+        pRec->len = (uint8_t)BSP_CAN_dlc_to_bytes(header.DataLength);
+        pRec->size = CAN_RX_REC_SIZE(pRec->len);
+        pRec->id = header.Identifier;
+        if(header.IdType == FDCAN_EXTENDED_ID) {
+            pRec->id |= CAN_RX_ID_EXT;
+        }
+        if(header.RxFrameType == FDCAN_REMOTE_FRAME) {
+            pRec->id |= CAN_RX_ID_RTR;
+        }
+        pRec->flags = 0;
+        if(header.FDFormat == FDCAN_FD_CAN) {
+            pRec->flags |= CAN_RX_FLAG_FD;
+        }
+        if(header.BitRateSwitch == FDCAN_BRS_ON) {
+            pRec->flags |= CAN_RX_FLAG_BRS;
+        }
+        if(header.ErrorStateIndicator == FDCAN_ESI_PASSIVE) {
+            pRec->flags |= CAN_RX_FLAG_ESI;
+        }
+        pRec->timestamp = timestamp;
+        /* Record contents must be visible before the new head */
+        __DMB();
+        me->rxHead += pad + pRec->size;
+        count++;
     }
+    return count;
+}
 
-    if(id >= CONFIG_CAN_COUNT) {
-        // invalid
+
+/*
+ * Drains both RX FIFOs and wakes the bus task once for the whole batch.
+ * The FIFO1 interrupt of the same entry then finds nothing left.
+ */
+static void can_rx_irq(CAN_T * const me)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t count;
+    uint32_t used;
+
+    /* FIFO1 holds the frames the filter profile marks as priority */
+    count = can_rx_fifo(me, FDCAN_RX_FIFO1);
+    count += can_rx_fifo(me, FDCAN_RX_FIFO0);
+    if(count == 0) {
         return;
     }
 
-    if((RxFifo0ITs & FDCAN_IT_RX_FIFO0_NEW_MESSAGE) != RESET) {
-        /* Retrieve Rx messages from RX FIFO0 */
-        if(HAL_OK == HAL_FDCAN_GetRxMessage(hfdcan, FDCAN_RX_FIFO0, &(rxElem.header), &(rxElem.data[0]))) {
-            if(pdTRUE == xQueueSendFromISR(me->rxQueueHandle, &rxElem, &xHigherPriorityTaskWoken)) {
-                xTaskNotifyFromISR(me->task, CAN_RX_BIT, eSetBits, &xHigherPriorityTaskWoken);
-            } else {
-                /// TODO: notify that CAN Rx Queue has overrun!!!
-                /// ASSERT for now
-                configASSERT(pdFALSE);
-            }
-        } else {
-            /// TODO: Handle this
-            configASSERT(pdFALSE);
-        }
+    me->stats.rxIrqs++;
+    if(count > me->stats.rxMaxBatch) {
+        me->stats.rxMaxBatch = count;
     }
+    used = me->rxHead - me->rxTail;
+    if(used > me->stats.rxMaxUsed) {
+        me->stats.rxMaxUsed = used;
+    }
+    xTaskNotifyFromISR(me->task, CAN_RX_BIT, eSetBits, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -312,29 +453,90 @@ void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs)
 /*
  * NOTE: This called from the interrupt
  */
-void HAL_FDCAN_TxFifoEmptyCallback(FDCAN_HandleTypeDef *hfdcan)
+void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs)
 {
-    CAN_T * me = NULL;
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    uint32_t id = 0;
+    CAN_T * const me = CAN_FROM_HANDLE(hfdcan);
 
-    for(id = 0; id < CONFIG_CAN_COUNT; id++) {
-        me = &can[id];
-        if(me->FDCAN_handle.Instance == hfdcan->Instance) {
-            break;
-        }
+    if((RxFifo0ITs & FDCAN_IT_RX_FIFO0_MESSAGE_LOST) != RESET) {
+        /* FIFO was full, the controller dropped a frame */
+        me->stats.rxLost++;
+    }
+    if((RxFifo0ITs & FDCAN_IT_RX_FIFO0_NEW_MESSAGE) != RESET) {
+        can_rx_irq(me);
     }
+}
 
-    if(id >= CONFIG_CAN_COUNT) {
-        // invalid
-        return;
+
+/*
+ * NOTE: This called from the interrupt
+ */
+void HAL_FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs)
+{
+    CAN_T * const me = CAN_FROM_HANDLE(hfdcan);
+
+    if((RxFifo1ITs & FDCAN_IT_RX_FIFO1_MESSAGE_LOST) != RESET) {
+        me->stats.rxLost++;
+    }
+    if((RxFifo1ITs & FDCAN_IT_RX_FIFO1_NEW_MESSAGE) != RESET) {
+        can_rx_irq(me);
     }
+}
+
+
+/*
+ * NOTE: This called from the interrupt
+ */
+void HAL_FDCAN_TxFifoEmptyCallback(FDCAN_HandleTypeDef *hfdcan)
+{
+    CAN_T * const me = CAN_FROM_HANDLE(hfdcan);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     xTaskNotifyFromISR(me->task, CAN_TX_BIT, eSetBits, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 
+/*
+ * Programs the filter profile into the message RAM. HAL_FDCAN_Init()
+ * clears the filter lists, so this follows every (re)initialization.
+ */
+static bool can_apply_filters(CAN_T * const me)
+{
+    const CAN_FILTER_PROFILE_T * const pProfile = &(me->filters);
+    FDCAN_FilterTypeDef filter;
+    uint32_t stdIdx = 0;
+    uint32_t extIdx = 0;
+
+    for(uint32_t i = 0; i < pProfile->count; i++) {
+        const CAN_FILTER_T * const pFilter = &(pProfile->filter[i]);
+        if(pFilter->bExtended) {
+            filter.IdType = FDCAN_EXTENDED_ID;
+            filter.FilterIndex = extIdx++;
+        } else {
+            filter.IdType = FDCAN_STANDARD_ID;
+            filter.FilterIndex = stdIdx++;
+        }
+        filter.FilterType = FILTER_TYPE_TO_HAL[pFilter->type];
+        filter.FilterConfig = FILTER_ACTION_TO_HAL[pFilter->action];
+        filter.FilterID1 = pFilter->id1;
+        filter.FilterID2 = pFilter->id2;
+        if(HAL_OK != HAL_FDCAN_ConfigFilter(&(me->FDCAN_handle), &filter)) {
+            return false;
+        }
+    }
+
+    if(HAL_OK != HAL_FDCAN_ConfigGlobalFilter(
+                    &(me->FDCAN_handle),
+                    pProfile->bRejectOthers ? FDCAN_REJECT : FDCAN_ACCEPT_IN_RX_FIFO0,
+                    pProfile->bRejectOthers ? FDCAN_REJECT : FDCAN_ACCEPT_IN_RX_FIFO0,
+                    pProfile->bRejectRemote ? FDCAN_REJECT_REMOTE : FDCAN_FILTER_REMOTE,
+                    pProfile->bRejectRemote ? FDCAN_REJECT_REMOTE : FDCAN_FILTER_REMOTE)) {
+        return false;
+    }
+    return true;
+}
+
+
 void BSP_CAN_init(void)
 {
     GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -378,6 +580,7 @@ void BSP_CAN_init(void)
 
     for(uint32_t i = 0; i < N_CAN_ID; i++) {
         CAN_T * const me = &can[i];
+        me->id = (CAN_ID_T)i;
         me->isEnabled = false;
         me->IRQn = DEFAULT_FCAN_IRQ[i];
 
@@ -387,12 +590,10 @@ void BSP_CAN_init(void)
                                 &txQueueSto[i][0],
                                 &me->txQueueStruct);
         configASSERT(NULL != me->txQueueHandle);
-        me->rxQueueHandle = xQueueCreateStatic(
-                                CONFIG_CAN_RX_Q_LEN,
-                                CONFIG_CAN_RX_ELEM_SIZE,
-                                &rxQueueSto[i][0],
-                                &me->rxQueueStruct);
-        configASSERT(NULL != me->rxQueueHandle);
+        me->rxRing = &rxRingSto[i][0];
+        me->rxHead = 0;
+        me->rxTail = 0;
+        memset(&me->stats, 0, sizeof(me->stats));
 
         me->FDCAN_handle.Instance = DEFAULT_FDCAN[i];
         me->FDCAN_handle.Init.ClockDivider = FDCAN_CLOCK_DIV1;
@@ -423,6 +624,8 @@ void BSP_CAN_init(void)
         me->FDCAN_handle.Init.ExtFiltersNbr = 0;
         me->FDCAN_handle.Init.TxFifoQueueMode = FDCAN_TX_FIFO_OPERATION;
         configASSERT(HAL_OK == HAL_FDCAN_Init(&me->FDCAN_handle));
+        memset(&me->filters, 0, sizeof(me->filters));
+        configASSERT(can_apply_filters(me));
 
         me->task = xTaskCreateStatic(
                             can_task,
@@ -474,6 +677,62 @@ bool BSP_CAN_configure(const CAN_ID_T id,
     me->arbit_bps = arbit_bps;
     me->data_bps = data_bps;
 
+    return can_apply_filters(me);
+}
+
+
+bool BSP_CAN_set_filters(const CAN_ID_T id, const CAN_FILTER_PROFILE_T * pProfile)
+{
+    uint32_t nStd = 0;
+    uint32_t nExt = 0;
+
+    if((id >= N_CAN_ID) || (pProfile == NULL) || (pProfile->count > CAN_FILTER_MAX)) {
+        return false;
+    }
+
+    CAN_T * const me = &(can[id]);
+
+    for(uint32_t i = 0; i < pProfile->count; i++) {
+        const CAN_FILTER_T * const pFilter = &(pProfile->filter[i]);
+        const uint32_t idMax = pFilter->bExtended ? 0x1FFFFFFFUL : 0x7FFUL;
+        if((pFilter->type >= N_CAN_FILTER_TYPE) || (pFilter->action >= N_CAN_FILTER_ACTION) ||
+           (pFilter->id1 > idMax) || (pFilter->id2 > idMax) ||
+           ((pFilter->type == CAN_FILTER_RANGE) && (pFilter->id1 > pFilter->id2))) {
+            return false;
+        }
+        if(pFilter->bExtended) {
+            nExt++;
+        } else {
+            nStd++;
+        }
+    }
+    if((nStd > CAN_FILTER_STD_MAX) || (nExt > CAN_FILTER_EXT_MAX)) {
+        return false;
+    }
+
+    if(HAL_FDCAN_STATE_READY != HAL_FDCAN_GetState(&(me->FDCAN_handle))) {
+        /* Bus is running */
+        return false;
+    }
+
+    /* The list sizes are part of the message RAM layout */
+    me->FDCAN_handle.Init.StdFiltersNbr = nStd;
+    me->FDCAN_handle.Init.ExtFiltersNbr = nExt;
+    if(HAL_OK != HAL_FDCAN_Init(&(me->FDCAN_handle))) {
+        return false;
+    }
+    me->filters = *pProfile;
+    return can_apply_filters(me);
+}
+
+
+bool BSP_CAN_get_filters(const CAN_ID_T id, CAN_FILTER_PROFILE_T * pProfile)
+{
+    if((id >= N_CAN_ID) || (pProfile == NULL)) {
+        return false;
+    }
+
+    *pProfile = can[id].filters;
     return true;
 }
 
@@ -505,7 +764,9 @@ bool BSP_CAN_start(const CAN_ID_T id)
 
         if(HAL_OK != HAL_FDCAN_ActivateNotification(
                             &(me->FDCAN_handle),
-                            (FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_TX_FIFO_EMPTY |
+                            (FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_MESSAGE_LOST |
+                            FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_MESSAGE_LOST |
+                            FDCAN_IT_TX_FIFO_EMPTY |
                             FDCAN_IT_ERROR_PASSIVE | FDCAN_IT_ERROR_WARNING | FDCAN_IT_BUS_OFF),
                             FDCAN_TX_BUFFER0)) {
             CAN_LOG_DEBUG("HAL_FDCAN_ActivateNotification error!\r\n");
@@ -536,7 +797,8 @@ bool BSP_CAN_stop(const CAN_ID_T id)
 
         if(HAL_OK != HAL_FDCAN_DeactivateNotification(
                         &(me->FDCAN_handle),
-                        FDCAN_IT_RX_FIFO0_NEW_MESSAGE)) {
+                        (FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_MESSAGE_LOST |
+                        FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_MESSAGE_LOST))) {
             CAN_LOG_DEBUG("HAL_FDCAN_DeactivateNotification error!\r\n");
             return false;
         }
@@ -587,12 +849,57 @@ bool BSP_CAN_send(const CAN_ID_T id, CAN_TX_T * pElem)
     return true;
 }
 
+uint32_t BSP_CAN_dlc_to_bytes(const uint32_t dlc)
+{
+    if(dlc >= (sizeof(DLC_TO_BYTES) / sizeof(DLC_TO_BYTES[0]))) {
+        return 0;
+    }
+    return DLC_TO_BYTES[dlc];
+}
+
+bool BSP_CAN_get_stats(const CAN_ID_T id, CAN_STATS_T * pStats)
+{
+    if((id >= N_CAN_ID) || (pStats == NULL)) {
+        return false;
+    }
+
+    *pStats = can[id].stats;
+    return true;
+}
+
+
+void BSP_CAN_reset_stats(const CAN_ID_T id)
+{
+    if(id >= N_CAN_ID) {
+        return;
+    }
+
+    CAN_T * const me = &(can[id]);
+    memset(&me->stats, 0, sizeof(me->stats));
+}
+
+/*
+ * When new messages are the only pending interrupts, clear them and drain
+ * the FIFOs directly. Anything else goes through the HAL handler.
+ */
+static inline void can_irq(CAN_T * const me)
+{
+    FDCAN_GlobalTypeDef * const pReg = me->FDCAN_handle.Instance;
+    const uint32_t flags = pReg->IR & pReg->IE;
+
+    if((flags != 0) && ((flags & ~CAN_IR_RX_FAST) == 0)) {
+        pReg->IR = flags;
+        can_rx_irq(me);
+    } else {
+        HAL_FDCAN_IRQHandler(&me->FDCAN_handle);
+    }
+}
+
 // CAN-FD
 void FDCAN1_IT0_IRQHandler(void)
 {
 #if (CONFIG_CAN_COUNT >= 1)
-    CAN_T * const me = &can[CAN_ONE];
-    HAL_FDCAN_IRQHandler(&me->FDCAN_handle);
+    can_irq(&can[CAN_ONE]);
 #endif
 }
 
@@ -600,15 +907,13 @@ void FDCAN1_IT0_IRQHandler(void)
 void FDCAN2_IT0_IRQHandler(void)
 {
 #if (CONFIG_CAN_COUNT >= 2)
-    CAN_T * const me = &can[CAN_TWO];
-    HAL_FDCAN_IRQHandler(&me->FDCAN_handle);
+    can_irq(&can[CAN_TWO]);
 #endif
 }
 
 void FDCAN3_IT0_IRQHandler(void)
 {
 #if (CONFIG_CAN_COUNT >= 3)
-    CAN_T * const me = &can[CAN_THREE];
-    HAL_FDCAN_IRQHandler(&me->FDCAN_handle);
+    can_irq(&can[CAN_THREE]);
 #endif
 }
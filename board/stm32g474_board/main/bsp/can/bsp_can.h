@@ -58,11 +58,69 @@ typedef struct {
     uint8_t data[CONFIG_CANFD_DATA_SIZE];
 } CAN_TX_T;
 
+#define CAN_RX_ID_EXT               (0x80000000UL)
+#define CAN_RX_ID_RTR               (0x40000000UL)
+#define CAN_RX_FLAG_BRS             (0x01)
+#define CAN_RX_FLAG_ESI             (0x02)
+#define CAN_RX_FLAG_FD              (0x04)
+
+/* Received frame as stored in the RX ring, followed by len data bytes */
 typedef struct {
-    FDCAN_RxHeaderTypeDef header;
-    uint8_t data[CONFIG_CANFD_DATA_SIZE];
+    uint16_t size;          // bytes taken in the ring, 0 = continues at the ring start
+    uint8_t flags;          // CAN_RX_FLAG_xxx
+    uint8_t len;
+    uint32_t id;            // identifier | CAN_RX_ID_xxx
+    uint32_t timestamp;     // DWT cycle count at reception
+    uint8_t data[];
 } CAN_RX_T;
 
+#define CAN_FILTER_STD_MAX          (28)    // FDCAN message RAM list sizes
+#define CAN_FILTER_EXT_MAX          (8)
+#define CAN_FILTER_MAX              (CAN_FILTER_STD_MAX + CAN_FILTER_EXT_MAX)
+
+typedef enum {
+    CAN_FILTER_RANGE = 0,   // id1 <= id <= id2
+    CAN_FILTER_DUAL,        // id == id1 or id == id2
+    CAN_FILTER_MASK,        // (id & id2) == (id1 & id2)
+    N_CAN_FILTER_TYPE
+} CAN_FILTER_TYPE_T;
+
+typedef enum {
+    CAN_FILTER_FIFO0 = 0,
+    CAN_FILTER_FIFO1,       // priority frames, drained first
+    CAN_FILTER_REJECT,
+    N_CAN_FILTER_ACTION
+} CAN_FILTER_ACTION_T;
+
+typedef struct {
+    uint8_t bExtended;
+    uint8_t type;           // CAN_FILTER_TYPE_T
+    uint8_t action;         // CAN_FILTER_ACTION_T
+    uint32_t id1;
+    uint32_t id2;
+} CAN_FILTER_T;
+
+/*
+ * Hardware acceptance filters of one bus. Standard and extended filters
+ * are matched in the order they appear, the first match decides. A zeroed
+ * profile accepts every frame into FIFO0.
+ */
+typedef struct {
+    uint32_t count;
+    bool bRejectOthers;     // frames matching no filter, otherwise FIFO0
+    bool bRejectRemote;
+    CAN_FILTER_T filter[CAN_FILTER_MAX];
+} CAN_FILTER_PROFILE_T;
+
+typedef struct {
+    uint32_t rxFrames;
+    uint32_t rxOverrun;     // frames dropped, RX ring full
+    uint32_t rxLost;        // frames dropped by the controller, RX FIFO full
+    uint32_t rxIrqs;        // interrupts that moved frames into the ring
+    uint32_t rxMaxBatch;    // most frames moved by one interrupt
+    uint32_t rxMaxUsed;     // RX ring high-water mark in bytes
+} CAN_STATS_T;
+
 void BSP_CAN_init(void);
 bool BSP_CAN_configure(const CAN_ID_T id,
                        const ARBIT_BITRATE_T arbit_bps,
@@ -71,6 +129,12 @@ bool BSP_CAN_is_enabled(const CAN_ID_T id);
 bool BSP_CAN_start(const CAN_ID_T id);
 bool BSP_CAN_stop(const CAN_ID_T id);
 bool BSP_CAN_send(const CAN_ID_T id, CAN_TX_T * pElem);
+uint32_t BSP_CAN_dlc_to_bytes(const uint32_t dlc);
+bool BSP_CAN_get_stats(const CAN_ID_T id, CAN_STATS_T * pStats);
+/* Only while the bus is stopped */
+bool BSP_CAN_set_filters(const CAN_ID_T id, const CAN_FILTER_PROFILE_T * pProfile);
+bool BSP_CAN_get_filters(const CAN_ID_T id, CAN_FILTER_PROFILE_T * pProfile);
+void BSP_CAN_reset_stats(const CAN_ID_T id);
 
 #endif /* CONFIG_USE_CAN */
 #endif /* BSP_CAN_H_ */
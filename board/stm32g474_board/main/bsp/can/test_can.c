@@ -13,6 +13,7 @@
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "cli.h"
 #include "test_can.h"
 #include "bsp_can.h"
 
@@ -20,6 +21,40 @@
 
 static bool bInit = false;
 static CAN_TX_T canTxElem;
+static CAN_FILTER_PROFILE_T filterProfile;
+
+static char const * const FILTER_TYPE_NAME[N_CAN_FILTER_TYPE] = {
+    "range",
+    "dual",
+    "mask"
+};
+
+static char const * const FILTER_ACTION_NAME[N_CAN_FILTER_ACTION] = {
+    "fifo0",
+    "fifo1",
+    "reject"
+};
+
+
+/* Index of parameter paramIdx in names[], -1 if not found */
+static int32_t ParseName(const char *pcCommandString, UBaseType_t paramIdx,
+                         char const * const * names, uint32_t count)
+{
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, paramIdx, &strParamLen);
+    if(ptrStrParam == NULL) {
+        return -1;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if((strlen(names[i]) == strParamLen) &&
+           (strncmp(ptrStrParam, names[i], strParamLen) == 0)) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
 
 static BaseType_t CmdCanStart(
         char *pcWriteBuffer,
@@ -325,12 +360,262 @@ static const CLI_Command_Definition_t can_send = {
 };
 
 
+static BaseType_t CmdCanStat(
+        char *pcWriteBuffer,
+        size_t xWriteBufferLen,
+        const char *pcCommandString)
+{
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    CAN_STATS_T stats;
+    size_t len;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if(ptrStrParam != NULL) {
+        if((strParamLen != 5) || (strncmp(ptrStrParam, "reset", 5) != 0)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "E (%ld) " TAG_TEST_CAN
+                    ": Parameter 1 value is invalid!\r\n\r\n", xTaskGetTickCount());
+            return 0;
+        }
+        for(uint32_t i = 0; i < N_CAN_ID; i++) {
+            BSP_CAN_reset_stats((CAN_ID_T)i);
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "I (%ld) " TAG_TEST_CAN
+                ": OK\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < N_CAN_ID; i++) {
+        BSP_CAN_get_stats((CAN_ID_T)i, &stats);
+        len = strlen(pcWriteBuffer);
+        snprintf(&pcWriteBuffer[len], xWriteBufferLen - len,
+                "\tCAN%lu: rx %lu in %lu irqs (max %lu), overrun %lu, lost %lu\r\n"
+                "\t      ring max %lu of %u bytes\r\n",
+                i + 1, stats.rxFrames, stats.rxIrqs, stats.rxMaxBatch,
+                stats.rxOverrun, stats.rxLost, stats.rxMaxUsed,
+                CONFIG_CAN_RX_RING_SIZE);
+    }
+    len = strlen(pcWriteBuffer);
+    snprintf(&pcWriteBuffer[len], xWriteBufferLen - len, "\r\n");
+    return 0;
+}
+
+
+static const CLI_Command_Definition_t can_stat = {
+    "can_stat",
+    "can_stat [reset]:\r\n"
+    "\tShow or reset the receive statistics of each CAN\r\n\r\n",
+    CmdCanStat,
+    -1
+};
+
+
+static BaseType_t CmdCanFilterAdd(
+        char *pcWriteBuffer,
+        size_t xWriteBufferLen,
+        const char *pcCommandString)
+{
+    static char const * const ID_TYPE_NAME[2] = {"std", "ext"};
+    CAN_FILTER_T * pFilter;
+    uint32_t periph;
+    int32_t i32Temp;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if((CLI_parseU32(pcCommandString, 1, &periph) != true) || (periph >= N_CAN_ID)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Invalid CAN peripheral!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    BSP_CAN_get_filters((CAN_ID_T)periph, &filterProfile);
+    if(filterProfile.count >= CAN_FILTER_MAX) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Filter list is full!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    pFilter = &filterProfile.filter[filterProfile.count];
+
+    i32Temp = ParseName(pcCommandString, 2, ID_TYPE_NAME, 2);
+    if(i32Temp < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 2 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    pFilter->bExtended = (uint8_t)i32Temp;
+    i32Temp = ParseName(pcCommandString, 3, FILTER_TYPE_NAME, N_CAN_FILTER_TYPE);
+    if(i32Temp < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 3 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    pFilter->type = (uint8_t)i32Temp;
+    if(CLI_parseU32(pcCommandString, 4, &pFilter->id1) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 4 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    if(CLI_parseU32(pcCommandString, 5, &pFilter->id2) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 5 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    i32Temp = ParseName(pcCommandString, 6, FILTER_ACTION_NAME, N_CAN_FILTER_ACTION);
+    if(i32Temp < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 6 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    pFilter->action = (uint8_t)i32Temp;
+    filterProfile.count++;
+
+    if(!BSP_CAN_set_filters((CAN_ID_T)periph, &filterProfile)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": BSP_CAN_set_filters Failed! Is CAN%lu stopped?\r\n\r\n",
+                xTaskGetTickCount(), (periph + 1));
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "I (%ld) " TAG_TEST_CAN
+            ": OK\r\n\r\n", xTaskGetTickCount());
+    return 0;
+}
+
+
+static const CLI_Command_Definition_t can_fadd = {
+    "can_fadd",
+    "can_fadd <periph> <std|ext> <range|dual|mask> <id1> <id2> <fifo0|fifo1|reject>:\r\n"
+    "\tAppend a hardware filter to <periph>, the first match decides\r\n\r\n",
+    CmdCanFilterAdd,
+    6
+};
+
+
+static BaseType_t CmdCanFilterClear(
+        char *pcWriteBuffer,
+        size_t xWriteBufferLen,
+        const char *pcCommandString)
+{
+    static char const * const OTHERS_NAME[2] = {"accept", "reject"};
+    uint32_t periph;
+    int32_t i32Temp;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if((CLI_parseU32(pcCommandString, 1, &periph) != true) || (periph >= N_CAN_ID)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Invalid CAN peripheral!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+    i32Temp = ParseName(pcCommandString, 2, OTHERS_NAME, 2);
+    if(i32Temp < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": Parameter 2 value is invalid!\r\n\r\n", xTaskGetTickCount());
+        return 0;
+    }
+
+    memset(&filterProfile, 0, sizeof(filterProfile));
+    filterProfile.bRejectOthers = (i32Temp != 0);
+    filterProfile.bRejectRemote = (i32Temp != 0);
+    if(!BSP_CAN_set_filters((CAN_ID_T)periph, &filterProfile)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "E (%ld) " TAG_TEST_CAN
+                ": BSP_CAN_set_filters Failed! Is CAN%lu stopped?\r\n\r\n",
+                xTaskGetTickCount(), (periph + 1));
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "I (%ld) " TAG_TEST_CAN
+            ": OK\r\n\r\n", xTaskGetTickCount());
+    return 0;
+}
+
+
+static const CLI_Command_Definition_t can_fclear = {
+    "can_fclear",
+    "can_fclear <periph> <accept|reject>:\r\n"
+    "\tRemove all filters of <periph>, frames matching no filter are\r\n"
+    "\taccepted into FIFO0 or rejected, remote frames too\r\n\r\n",
+    CmdCanFilterClear,
+    2
+};
+
+
+/* One filter per call */
+static BaseType_t CmdCanFilterList(
+        char *pcWriteBuffer,
+        size_t xWriteBufferLen,
+        const char *pcCommandString)
+{
+    static uint32_t index = 0;
+    const CAN_FILTER_T * pFilter;
+    uint32_t periph;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(index == 0) {
+        if((CLI_parseU32(pcCommandString, 1, &periph) != true) || (periph >= N_CAN_ID)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "E (%ld) " TAG_TEST_CAN
+                    ": Invalid CAN peripheral!\r\n\r\n", xTaskGetTickCount());
+            return 0;
+        }
+        BSP_CAN_get_filters((CAN_ID_T)periph, &filterProfile);
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tOthers: %s, remote frames: %s, %lu filters\r\n",
+                filterProfile.bRejectOthers ? "reject" : "fifo0",
+                filterProfile.bRejectRemote ? "reject" : "filter",
+                filterProfile.count);
+    }
+    if(index < filterProfile.count) {
+        const size_t len = strlen(pcWriteBuffer);
+        pFilter = &filterProfile.filter[index];
+        snprintf(&pcWriteBuffer[len], xWriteBufferLen - len,
+                "\t%2lu: %s %-5s 0x%08lx 0x%08lx %s\r\n",
+                index, pFilter->bExtended ? "ext" : "std",
+                FILTER_TYPE_NAME[pFilter->type], pFilter->id1, pFilter->id2,
+                FILTER_ACTION_NAME[pFilter->action]);
+        index++;
+        return 1;
+    }
+    strncat(pcWriteBuffer, "\r\n", xWriteBufferLen - strlen(pcWriteBuffer) - 1);
+    index = 0;
+    return 0;
+}
+
+
+static const CLI_Command_Definition_t can_flist = {
+    "can_flist",
+    "can_flist <periph>:\r\n"
+    "\tShow the hardware filters of <periph>\r\n\r\n",
+    CmdCanFilterList,
+    1
+};
+
+
 void TEST_CAN_init(void)
 {
     if(bInit != true) {
         FreeRTOS_CLIRegisterCommand(&can_start);
         FreeRTOS_CLIRegisterCommand(&can_stop);
         FreeRTOS_CLIRegisterCommand(&can_send);
+        FreeRTOS_CLIRegisterCommand(&can_stat);
+        FreeRTOS_CLIRegisterCommand(&can_fadd);
+        FreeRTOS_CLIRegisterCommand(&can_fclear);
+        FreeRTOS_CLIRegisterCommand(&can_flist);
 
         bInit = true;
     }
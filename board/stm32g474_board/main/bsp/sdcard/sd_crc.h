@@ -0,0 +1,27 @@
+/*
+ * sd_crc.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef BSP_SDCARD_SD_CRC_H_
+#define BSP_SDCARD_SD_CRC_H_
+
+#include "stdint.h"
+#include "stddef.h"
+
+#define SD_CRC16_POLY           (0x1021)
+
+/*
+ * SD_CRC16() uses the CRC peripheral when CONFIG_SDCARD_CRC_HW is set. Use
+ * of the peripheral is serialized with a mutex, so SD_CRC16() may be called
+ * from any task after SD_CRC_init(), but not from an ISR.
+ */
+void SD_CRC_init(void);
+/* Command CRC7, returned right aligned (without the end bit) */
+uint8_t SD_CRC7(const uint8_t * pData, size_t len);
+/* Data block CRC16, transmitted MSB first after the block */
+uint16_t SD_CRC16(const uint8_t * pData, size_t len);
+
+#endif /* BSP_SDCARD_SD_CRC_H_ */
@@ -14,9 +14,11 @@
 #include "task.h"
 #include "semphr.h"
 #include "sdcard.h"
+#include "sd_crc.h"
 #include "test_sdcard.h"
 #include "bsp/spi/bsp_spi.h"
 #include "bsp/lpuart.h"
+#include "bsp/bsp_cycle.h"
 
 #if CONFIG_USE_SDCARD
 
@@ -36,29 +38,231 @@
 #define SD_DEFAULT_TIMEOUT      (100)
 #define SD_WAIT_BUSY_TIMEOUT    (1000)
 #define SD_WAIT_TOKEN_TIMEOUT   (200)
+#define SD_POLL_BURST_LEN       (CONFIG_SDCARD_POLL_BURST_LEN)
+#define SD_INIT_MAX_FREQ        (400000)    // identification mode limit
+#define SD_DEFAULT_SPEED_FREQ   (25000000)  // default speed limit
+#define SD_SWITCH_STATUS_SIZE   (64)        // CMD6 status, 512 bits
+#define SD_ERASE_AU_BLOCKS      (8192)      // 4MB allocation unit
+#define SD_ERASE_AU_TIMEOUT     (250)       // per AU when SD status is not read
+#define SD_PRE_ERASE_MAX        (0x7FFFFF)  // ACMD23 count is 23 bits
+
+#if ((CONFIG_APB2_PERIPH_FREQ / 256) > SD_INIT_MAX_FREQ)
+#error "SD init clock exceeds 400kHz at this APB2 frequency"
+#endif
 
 static bool bInit = false;
 static SemaphoreHandle_t semHandle = NULL;
 static StaticSemaphore_t semStruct;
-static uint8_t block_data[SDCARD_BLOCK_SIZE];
+/*
+ * Driver lock, held by csOwner from chip select assert to release. Driver
+ * state, the poll lookahead and the deferred busy belong to that task.
+ */
+static SemaphoreHandle_t mutexHandle = NULL;
+static StaticSemaphore_t mutexStruct;
+static TaskHandle_t csOwner = NULL;
+
+typedef enum {
+    SD_TRANSFER_IDLE = 0,
+    SD_TRANSFER_READ,       // CMD18 in progress
+    SD_TRANSFER_WRITE,      // CMD25 in progress
+} SD_TRANSFER_T;
 
 typedef struct {
+    SD_TRANSFER_T transfer;
+    BSP_SPI_CLK_T clk;          // data transfer clock, stepped down on errors
     uint8_t csd_version;
     uint32_t max_block_count;   // number of 512-byte block
     uint32_t sector_size;       // Size of erasable sector in bytes
     uint32_t size_MB;           // Card size in Mega-Bytes (MB)
+    bool busyPending;           // card is programming after an async write
+    TickType_t busyStart;
+    SDCARD_WRITE_CB_T busyCb;
+    void * busyCtx;
+#if CONFIG_SDCARD_STATS
+    uint8_t lastCmd;            // command index being timed
+    uint32_t lastCmdCycle;      // cycle count when lastCmd was sent
+#endif
 } SDCARD_T;
 
 static SDCARD_T sdcard = {0};
 
-void SD_ChipSelect(bool bSelect)
+typedef struct {
+    uint8_t buf[SD_POLL_BURST_LEN];
+    uint32_t idx;               // next unread byte in buf
+    uint32_t len;               // valid bytes in buf
+} SD_POLL_T;
+
+static SD_POLL_T sdPoll = {0};
+
+#if CONFIG_SDCARD_STATS
+static SDCARD_STATS_T sdStats = {0};
+#endif
+
+/* Fastest SPI clock not above maxHz, or the slowest available */
+static BSP_SPI_CLK_T SDCARD_ClockFor(uint32_t maxHz)
+{
+    uint32_t clk;
+
+    for(clk = 0; clk < (N_BSP_SPI_CLK - 1); clk++) {
+        if(BSP_SPI_getClockHz((BSP_SPI_CLK_T)clk) <= maxHz) {
+            break;
+        }
+    }
+    return (BSP_SPI_CLK_T)clk;
+}
+
+
+static BSP_SPI_CLK_T SDCARD_SpiClock(void)
+{
+    if(bInit) {
+        return sdcard.clk;
+    }
+    return SDCARD_ClockFor(SD_INIT_MAX_FREQ);
+}
+
+
+/*
+ * Lowers the data transfer clock by one step after a CRC error or a
+ * missing/garbled data token. A data error token is a media or address
+ * error reported by the card and leaves the clock alone. Returns true if
+ * the failed transfer should be retried.
+ */
+static bool SDCARD_ClockStepDown(int32_t err)
+{
+    if((err != SDCARD_ERR_CRC) && (err != SDCARD_ERR_WAIT_DATA_TOKEN)) {
+        return false;
+    }
+    /* Called between transfers, chip select is released */
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    if(sdcard.clk >= (N_BSP_SPI_CLK - 1)) {
+        xSemaphoreGive(mutexHandle);
+        return false;
+    }
+    sdcard.clk++;
+#if CONFIG_SDCARD_STATS
+    sdStats.clkStepDowns++;
+#endif
+    xSemaphoreGive(mutexHandle);
+    SD_PRINTF("SD clock stepped down to %lu Hz\r\n", BSP_SPI_getClockHz(sdcard.clk));
+    return true;
+}
+
+
+static int32_t SDCARD_SpiTransactSeg(const BSP_SPI_SEGMENT_T * pSeg, size_t nSeg)
+{
+    int32_t ret = SPI_ERR_NONE;
+    int32_t status = SPI_ERR_NONE;
+    BSP_SPI_CLK_T clk = SDCARD_SpiClock();
+
+#if CONFIG_SPI_BUS_OWNERSHIP
+    if(BSP_SPI_isOwner()) {
+        /* Direct transfer, no round trip through the SPI manager */
+        return BSP_SPI_transferSeg(pSeg, nSeg);
+    }
+#endif
+    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
+    ret = BSP_SPI_transactSeg(pSeg, nSeg, SPI_MODE0, NULL, clk, semHandle, &status);
+    if(ret != SPI_ERR_NONE) {
+        return ret;
+    }
+    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
+        return SPI_ERR_TIMEOUT;
+    }
+    return status;
+}
+
+
+static int32_t SDCARD_SpiTransact(const void * pTxBuf, void * pRxBuf, size_t len)
+{
+    const BSP_SPI_SEGMENT_T seg = { pTxBuf, pRxBuf, len };
+    return SDCARD_SpiTransactSeg(&seg, 1);
+}
+
+
+/*
+ * Polling reads (R1, data token, busy) clock out SD_POLL_BURST_LEN bytes of
+ * 0xFF per DMA transaction. Bytes following the matched one are kept in
+ * the lookahead buffer and consumed by the next poll or SDCARD_ReadBytes(),
+ * e.g. the first bytes of a data block after its token. Anything the host
+ * transmits, and chip select changes, invalidate the lookahead.
+ */
+static void SDCARD_PollFlush(void)
+{
+    sdPoll.idx = 0;
+    sdPoll.len = 0;
+}
+
+
+static int32_t SDCARD_PollByte(uint8_t * pByte)
+{
+    int32_t ret;
+
+    if(sdPoll.idx >= sdPoll.len) {
+        SDCARD_PollFlush();
+        ret = SDCARD_SpiTransact(NULL, sdPoll.buf, sizeof(sdPoll.buf));
+        if(ret != SPI_ERR_NONE) {
+            return ret;
+        }
+        sdPoll.len = sizeof(sdPoll.buf);
+#if CONFIG_SDCARD_STATS
+        sdStats.pollTransactions++;
+#endif
+    }
+    *pByte = sdPoll.buf[sdPoll.idx++];
+    return SPI_ERR_NONE;
+}
+
+
+/* True while the calling task has the card selected */
+static bool SD_IsSelected(void)
+{
+    return (csOwner != NULL) && (csOwner == xTaskGetCurrentTaskHandle());
+}
+
+
+/*
+ * Selecting the card takes the driver lock, waiting for any other task's
+ * command sequence to end, and then the SPI bus for the whole CS window.
+ * Chip select is not asserted if the bus cannot be acquired. Deselecting
+ * from a task that does not hold the lock leaves chip select alone.
+ */
+static int32_t SD_ChipSelect(bool bSelect)
 {
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
     if(bSelect) {
+        if(csOwner == self) {
+            /* Re-assert after a toggle within the sequence */
+            LL_GPIO_ResetOutputPin(SD_CS_Port, SD_CS_Pin);
+            return SDCARD_ERR_NONE;
+        }
+        xSemaphoreTake(mutexHandle, portMAX_DELAY);
+#if CONFIG_SPI_BUS_OWNERSHIP
+        const int32_t ret = BSP_SPI_acquire(SPI_MODE0, SDCARD_SpiClock(), SD_DEFAULT_TIMEOUT);
+        if(ret != SPI_ERR_NONE) {
+            xSemaphoreGive(mutexHandle);
+            SD_PRINTF("SD SPI bus not available %ld\r\n", ret);
+            return ret;
+        }
+#endif
+        csOwner = self;
+        SDCARD_PollFlush();
         /* Active Low */
         LL_GPIO_ResetOutputPin(SD_CS_Port, SD_CS_Pin);
     } else {
-        LL_GPIO_SetOutputPin(SD_CS_Port, SD_CS_Pin);
+        if(csOwner == NULL) {
+            LL_GPIO_SetOutputPin(SD_CS_Port, SD_CS_Pin);
+        } else if(csOwner == self) {
+            LL_GPIO_SetOutputPin(SD_CS_Port, SD_CS_Pin);
+            SDCARD_PollFlush();
+#if CONFIG_SPI_BUS_OWNERSHIP
+            BSP_SPI_release();
+#endif
+            csOwner = NULL;
+            xSemaphoreGive(mutexHandle);
+        }
     }
+    return SDCARD_ERR_NONE;
 }
 
 
@@ -81,6 +285,19 @@ void SD_SetPowerState(bool bOn)
 }
 #endif /* CONFIG_SDCARD_HAS_POWER_SWITCH */
 
+
+#if CONFIG_SDCARD_STATS
+static void SDCARD_StatUpdate(SDCARD_CMD_STAT_T * pStat, uint32_t startCycle)
+{
+    const uint32_t us = BSP_CYCLE_to_us(BSP_CYCLE_get() - startCycle);
+    pStat->count++;
+    pStat->totalUs += us;
+    if(us > pStat->maxUs) {
+        pStat->maxUs = us;
+    }
+}
+#endif /* CONFIG_SDCARD_STATS */
+
 /*
 R1: 0abcdefg
      ||||||`- 1th bit (g): card is in idle state
@@ -93,16 +310,8 @@ R1: 0abcdefg
              (8th bit is always zero)
 */
 static int8_t SDCARD_ReadR1() {
-    int8_t ret = SPI_ERR_NONE;
     int32_t spiRet = SPI_ERR_NONE;
-    int32_t status;
     uint8_t r1;
-    BSP_SPI_CLK_T clk;
-    if(bInit) {
-        clk = (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX;
-    } else {
-        clk = BSP_SPI_CLK_156KHZ;
-    }
     /*
      * Note: command response time (NCR)
      *   SDC : 0-8 bytes
@@ -110,45 +319,30 @@ static int8_t SDCARD_ReadR1() {
      */
     uint32_t ncr = 0;
     const uint32_t ncrMax = 32; /* NCR + some huge margin */
-    // make sure FF is transmitted during receive
-    uint8_t tx = 0xFF;
     for(;;) {
-        // clear pending semaphore
-        while(pdTRUE == xSemaphoreTake(semHandle, 0));
-
-        tx = 0xFF;
-        spiRet = BSP_SPI_transact(&tx, &r1, 1, SPI_MODE0, NULL, clk, semHandle, &status);
+        spiRet = SDCARD_PollByte(&r1);
         if(spiRet != SPI_ERR_NONE) {
             SD_PRINTF("Read R1 Error %d\r\n", __LINE__);
             return (int8_t)spiRet;
         }
-
-        if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-            SD_PRINTF("Read R1 Error %d\r\n", __LINE__);
-            return SPI_ERR_TIMEOUT;
-        }
-        if(status != SPI_ERR_NONE) {
-            SD_PRINTF("Read R1 Error %d\r\n", __LINE__);
-            return (int8_t)spiRet;
-        }
-
         if((r1 & 0x80) == 0) { // 8th bit alwyas zero, r1 recevied
-            ret = r1;
             break;
-        } else {
-            ncr++;
-            if(ncr >= ncrMax) {
-                SD_PRINTF("Read R1 Timeout %d\r\n", __LINE__);
-                return SDCARD_ERR_TIMEOUT;
-            }
-            vTaskDelay(1);
+        }
+        ncr++;
+        if(ncr >= ncrMax) {
+            SD_PRINTF("Read R1 Timeout %d\r\n", __LINE__);
+            return SDCARD_ERR_TIMEOUT;
         }
     }
+#if CONFIG_SDCARD_STATS
+    SDCARD_StatUpdate(&sdStats.r1[sdcard.lastCmd], sdcard.lastCmdCycle);
+#endif
 
-    return ret;
+    return (int8_t)r1;
 }
 
 // data token for CMD9, CMD17, CMD18 and CMD24 are the same
+#define DATA_TOKEN_CMD6  0xFE
 #define DATA_TOKEN_CMD9  0xFE
 #define DATA_TOKEN_CMD10 0xFE
 #define DATA_TOKEN_CMD17 0xFE
@@ -160,40 +354,25 @@ static int8_t SDCARD_ReadR1() {
 static int32_t SDCARD_WaitDataToken(uint8_t token)
 {
     int32_t spiRet = SPI_ERR_NONE;
-    int32_t status;
     uint8_t fb;
-    // make sure FF is transmitted during receive
-    uint8_t tx = 0xFF;
-    BSP_SPI_CLK_T clk;
-
-    if(bInit) {
-        clk = (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX;
-    } else {
-        clk = BSP_SPI_CLK_156KHZ;
-    }
 
     TickType_t startTime = xTaskGetTickCount();
     for(;;) {
-        // clear pending semaphore
-        while(pdTRUE == xSemaphoreTake(semHandle, 0));
-        tx = 0xFF;
-        spiRet = BSP_SPI_transact(&tx, &fb, 1, SPI_MODE0, NULL, clk, semHandle, &status);
+        spiRet = SDCARD_PollByte(&fb);
         if(spiRet != SPI_ERR_NONE) {
             SD_PRINTF("Wait Data Token Error %d\r\n", __LINE__);
-            return (int8_t)spiRet;
-        }
-        if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-            SD_PRINTF("Wait Data Token Error %d\r\n", __LINE__);
-            return SPI_ERR_TIMEOUT;
-        }
-        if(status != SPI_ERR_NONE) {
-            SD_PRINTF("Wait Data Token Error %d\r\n", __LINE__);
-            return (int8_t)spiRet;
+            return spiRet;
         }
         if(fb == token) {
             break;
         }
+        if((fb & 0xF0) == 0x00) {
+            /* Data error token: 0000 out-of-range, ECC, CC, error */
+            SD_PRINTF("Data Error Token 0x%02x\r\n", fb);
+            return SDCARD_ERR_DATA_ERROR_TOKEN;
+        }
         if(fb != 0xFF) {
+            /* Neither idle nor a valid token, corrupted on the line */
             SD_PRINTF("Wait Data Token Error %d\r\n", __LINE__);
             return SDCARD_ERR_WAIT_DATA_TOKEN;
         }
@@ -202,6 +381,9 @@ static int32_t SDCARD_WaitDataToken(uint8_t token)
             return SDCARD_ERR_WAIT_DATA_TOKEN;
         }
     }
+#if CONFIG_SDCARD_STATS
+    SDCARD_StatUpdate(&sdStats.token[sdcard.lastCmd], sdcard.lastCmdCycle);
+#endif
 
     return SDCARD_ERR_NONE;
 }
@@ -210,94 +392,235 @@ static int32_t SDCARD_WaitDataToken(uint8_t token)
 static int32_t SDCARD_ReadBytes(uint8_t * buff, size_t buff_size)
 {
     int32_t ret = 0;
-    int32_t status = 0;
-    BSP_SPI_CLK_T clk;
 
-    if(bInit) {
-        clk = (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX;
-    } else {
-        clk = BSP_SPI_CLK_156KHZ;
+    /* consume what is left from the last poll burst */
+    while((buff_size > 0) && (sdPoll.idx < sdPoll.len)) {
+        *buff++ = sdPoll.buf[sdPoll.idx++];
+        buff_size--;
+    }
+    if(buff_size == 0) {
+        return SPI_ERR_NONE;
     }
 
-    memset(buff, 0xFF, buff_size);
-    /* clear */
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));
-    ret = BSP_SPI_transact(buff, buff, buff_size, SPI_MODE0, NULL, clk, semHandle, &status);
-    if(SPI_ERR_NONE != ret) {
+    ret = SDCARD_SpiTransact(NULL, buff, buff_size);
+    if(ret != SPI_ERR_NONE) {
         SD_PRINTF("Read Bytes Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_PRINTF("Read Bytes Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
+    return SPI_ERR_NONE;
+}
+
+
+static int32_t SDCARD_Transfer(const void * pTxBuf, void * pRxBuf, size_t len)
+{
+    /* Card output clocked during a host transmit is not a response */
+    SDCARD_PollFlush();
+    return SDCARD_SpiTransact(pTxBuf, pRxBuf, len);
+}
+
+
+/*
+ * Data block write: token, data, CRC and the data response byte in one
+ * SPI transaction.
+ */
+static int32_t SDCARD_SendDataBlock(uint8_t token, const uint8_t * buff, uint8_t * pDataResp)
+{
+#if CONFIG_SDCARD_CRC
+    const uint16_t crc16 = SD_CRC16(buff, SDCARD_BLOCK_SIZE);
+    const uint8_t crc[2] = { (uint8_t)(crc16 >> 8), (uint8_t)crc16 };
+#else
+    static const uint8_t crc[2] = { 0xFF, 0xFF };
+#endif
+    const BSP_SPI_SEGMENT_T seg[] = {
+        { &token, NULL, sizeof(token) },
+        { buff, NULL, SDCARD_BLOCK_SIZE },
+        { crc, NULL, sizeof(crc) },
+        { NULL, pDataResp, 1 },
+    };
+
+    SDCARD_PollFlush();
+    return SDCARD_SpiTransactSeg(seg, sizeof(seg) / sizeof(seg[0]));
+}
+
+
+/*
+ * Data block read after the data token: data and CRC in one SPI
+ * transaction, less what is already in the poll lookahead. The CRC16 is
+ * verified when CONFIG_SDCARD_CRC is set.
+ */
+static int32_t SDCARD_ReadDataBlock(uint8_t * buff, size_t len, uint8_t * crc)
+{
+    BSP_SPI_SEGMENT_T seg[2];
+    size_t nSeg = 0;
+    size_t crcLen = 2;
+    int32_t ret;
+#if CONFIG_SDCARD_CRC
+    const uint8_t * const pData = buff;
+    const size_t dataLen = len;
+    uint8_t * const pCrc = crc;
+#endif
+
+    while((len > 0) && (sdPoll.idx < sdPoll.len)) {
+        *buff++ = sdPoll.buf[sdPoll.idx++];
+        len--;
     }
-    if(status < 0) {
-        SD_PRINTF("Read Bytes Error %d\r\n", __LINE__);
-        return status;
+    while((crcLen > 0) && (sdPoll.idx < sdPoll.len)) {
+        *crc++ = sdPoll.buf[sdPoll.idx++];
+        crcLen--;
+    }
+    if(len > 0) {
+        seg[nSeg].pTxBuf = NULL;
+        seg[nSeg].pRxBuf = buff;
+        seg[nSeg].len = len;
+        nSeg++;
+    }
+    if(crcLen > 0) {
+        seg[nSeg].pTxBuf = NULL;
+        seg[nSeg].pRxBuf = crc;
+        seg[nSeg].len = crcLen;
+        nSeg++;
     }
+    if(nSeg != 0) {
+        ret = SDCARD_SpiTransactSeg(seg, nSeg);
+        if(ret != SPI_ERR_NONE) {
+            return ret;
+        }
+    }
+#if CONFIG_SDCARD_CRC
+    if(SD_CRC16(pData, dataLen) != (((uint16_t)pCrc[0] << 8) | pCrc[1])) {
+#if CONFIG_SDCARD_STATS
+        sdStats.crcErrors++;
+#endif
+        return SDCARD_ERR_CRC;
+    }
+#endif
     return SPI_ERR_NONE;
 }
 
 
-static int32_t SDCARD_WaitNotBusy() {
+static int32_t SDCARD_SendCommand(uint8_t cmdIdx, uint32_t arg)
+{
+    /*
+     * CRC7 is always computed: CMD0 and CMD8 are checked in SPI mode
+     * regardless, and every command once CMD59 has enabled CRC.
+     */
+    uint8_t cmd[] = {
+        0x40 | cmdIdx,
+        (arg >> 24) & 0xFF, /* ARG */
+        (arg >> 16) & 0xFF,
+        (arg >> 8) & 0xFF,
+        arg & 0xFF,
+        0
+    };
+    cmd[5] = (SD_CRC7(cmd, 5) << 1) | 1; /* CRC7 + end bit */
+#if CONFIG_SDCARD_STATS
+    sdcard.lastCmd = cmdIdx & 0x3F;
+    sdcard.lastCmdCycle = BSP_CYCLE_get();
+#endif
+    return SDCARD_Transfer(cmd, NULL, sizeof(cmd));
+}
+
+
+static void SDCARD_BusyComplete(int32_t status)
+{
+    SDCARD_WRITE_CB_T cb = sdcard.busyCb;
+    void * ctx = sdcard.busyCtx;
+
+    if(sdcard.busyPending != true) {
+        return;
+    }
+    sdcard.busyPending = false;
+    sdcard.busyCb = NULL;
+    sdcard.busyCtx = NULL;
+    if(cb != NULL) {
+        cb(status, ctx);
+    }
+}
+
+
+static void SDCARD_DeferBusy(SDCARD_WRITE_CB_T cb, void * ctx)
+{
+    sdcard.busyPending = true;
+    sdcard.busyStart = xTaskGetTickCount();
+    sdcard.busyCb = cb;
+    sdcard.busyCtx = ctx;
+}
+
+
+static int32_t SDCARD_WaitNotBusyFor(TickType_t timeout) {
     uint8_t busy;
     int32_t ret;
-    TickType_t startTime = xTaskGetTickCount();
+    /* a deferred busy has been running since the async write returned */
+    TickType_t startTime = sdcard.busyPending ? sdcard.busyStart : xTaskGetTickCount();
     do {
-        ret = SDCARD_ReadBytes(&busy, sizeof(busy));
+        ret = SDCARD_PollByte(&busy);
         if(ret != SPI_ERR_NONE) {
             SD_PRINTF("Wait Busy Error %d\r\n", __LINE__);
+            SDCARD_BusyComplete(ret);
             return ret;
         }
-        if((xTaskGetTickCount() - startTime) > SD_WAIT_BUSY_TIMEOUT) {
+        if((xTaskGetTickCount() - startTime) > timeout) {
             SD_PRINTF("Wait Busy Timeout\r\n");
+            SDCARD_BusyComplete(SDCARD_ERR_TIMEOUT);
             return SDCARD_ERR_TIMEOUT;
         }
     } while(busy != 0xFF);
 
+    SDCARD_BusyComplete(SDCARD_ERR_NONE);
     return SPI_ERR_NONE;
 }
 
 
-static int32_t SDCARD_SendCMD0(void)
-{
-    int32_t ret = SDCARD_ERR_NONE;
-    int32_t status = 0;
-    uint8_t cmd[] =
-        { 0x40 | 0x00 /* CMD0 */, 0x00, 0x00, 0x00, 0x00 /* ARG = 0 */, (0x4A << 1) | 1 /* CRC7 + end bit */ };
-    BSP_SPI_CLK_T clk;
+static int32_t SDCARD_WaitNotBusy() {
+    return SDCARD_WaitNotBusyFor(SD_WAIT_BUSY_TIMEOUT);
+}
 
-    if(bInit) {
-        clk = (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX;
-    } else {
-        clk = BSP_SPI_CLK_156KHZ;
-    }
 
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, clk, semHandle, &status);
+#if (CONFIG_SDCARD_SPI_FREQ > SD_DEFAULT_SPEED_FREQ)
+/*
+ * CMD6 in mode 1 (switch) for high speed. Chip select must be asserted.
+ */
+static int32_t SDCARD_SwitchHighSpeed(void)
+{
+    int32_t ret;
+    int8_t r1;
+    uint8_t status[SD_SWITCH_STATUS_SIZE];
+    uint8_t crc[2];
 
+    ret = SDCARD_SendCommand(0x06, 0x80FFFFF1);
     if(ret != SPI_ERR_NONE) {
-        SD_PRINTF("CMD0 Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_PRINTF("CMD0 Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        return r1;
+    }
+    if(r1 != 0x00) {
+        return SDCARD_ERR_R1;
+    }
+    ret = SDCARD_WaitDataToken(DATA_TOKEN_CMD6);
+    if(ret < 0) {
+        return ret;
     }
-    if(status != SPI_ERR_NONE) {
-        SD_PRINTF("CMD0 Error %d\r\n", __LINE__);
-        return status;
+    ret = SDCARD_ReadDataBlock(status, sizeof(status), crc);
+    if(ret < 0) {
+        return ret;
+    }
+    /* Function group 1 result, bits 379:376 */
+    if((status[16] & 0x0F) != 0x01) {
+        return SDCARD_ERR_UNSUPPORTED;
     }
     return SDCARD_ERR_NONE;
 }
+#endif
 
 
 int32_t SDCARD_Init(void)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
     uint8_t retry;
+    uint8_t csd[SDCARD_CSD_DATA_SIZE];
 
     /*
      * Note: This must be only called after scheduler has started.
@@ -335,6 +658,12 @@ int32_t SDCARD_Init(void)
 #endif /* CONFIG_SDCARD_HAS_POWER_SWITCH */
 
     BSP_SPI_init();
+    /* Before any early return, sd_crc_test relies on it */
+    SD_CRC_init();
+    if(mutexHandle == NULL) {
+        mutexHandle = xSemaphoreCreateMutexStatic(&mutexStruct);
+        configASSERT(NULL != mutexHandle);
+    }
 
     /*
      * SD Card SPI CS
@@ -347,6 +676,8 @@ int32_t SDCARD_Init(void)
     GPIO_InitStruct.Pull = LL_GPIO_PULL_NO;
     LL_GPIO_Init(SD_CS_Port, &GPIO_InitStruct);
     SD_ChipSelect(false);
+    sdcard.transfer = SD_TRANSFER_IDLE;
+    sdcard.busyPending = false;
 
 #if CONFIG_SDCARD_HAS_DETECT_PIN
     /*
@@ -409,16 +740,11 @@ int32_t SDCARD_Init(void)
         uint8_t dummy[24];
         memset(dummy, 0xFF, sizeof(dummy));
 #endif
-        while(pdTRUE == xSemaphoreTake(semHandle, 0));
-        ret = BSP_SPI_transact(dummy, dummy, sizeof(dummy), SPI_MODE0, NULL, BSP_SPI_CLK_156KHZ, semHandle, &status);
+        ret = SDCARD_Transfer(dummy, NULL, sizeof(dummy));
         if(ret != SPI_ERR_NONE) {
             SD_PRINTF("SD Init Error %d\r\n", __LINE__);
             return ret;
         }
-        if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-            return SPI_ERR_TIMEOUT;
-        }
     }
 
     /*
@@ -427,9 +753,12 @@ int32_t SDCARD_Init(void)
      *     To enter SPI mode, CMD0 needs to be sent twice (see figure 4-1 in
      *     SD Simplified spec v4.10). Some cards enter SD mode on first CMD0.
      */
-    SD_ChipSelect(true);
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
     /* First CMD0 */
-    ret = SDCARD_SendCMD0();
+    ret = SDCARD_SendCommand(0x00, 0);
     if(SDCARD_ERR_NONE != ret) {
         SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
         SD_ChipSelect(false);
@@ -441,9 +770,12 @@ int32_t SDCARD_Init(void)
         /* Toggle CS */
         SD_ChipSelect(false);
         vTaskDelay(10);
-        SD_ChipSelect(true);
+        ret = SD_ChipSelect(true);
+        if(ret != SDCARD_ERR_NONE) {
+            return ret;
+        }
         /* Second CMD0 */
-        ret = SDCARD_SendCMD0();
+        ret = SDCARD_SendCommand(0x00, 0);
         vTaskDelay(10);
         if(SDCARD_ERR_NONE != ret) {
             SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
@@ -479,26 +811,12 @@ int32_t SDCARD_Init(void)
         SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
         return ret;
     }
-    {
-        uint8_t cmd[] =
-            { 0x40 | 0x08 /* CMD8 */, 0x00, 0x00, 0x01, 0xAA /* ARG */, (0x43 << 1) | 1 /* CRC7 + end bit */ };
-        while(pdTRUE == xSemaphoreTake(semHandle, 0));
-        ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, BSP_SPI_CLK_156KHZ, semHandle, &status);
-        if(ret != SPI_ERR_NONE) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
-            return ret;
-        }
-        if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
-            return SPI_ERR_TIMEOUT;
-        }
-        if(status != SPI_ERR_NONE) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
-            return status;
-        }
+    /* CMD8 (SEND_IF_COND) command */
+    ret = SDCARD_SendCommand(0x08, 0x000001AA);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
+        return ret;
     }
 
     r1 = SDCARD_ReadR1();
@@ -510,6 +828,7 @@ int32_t SDCARD_Init(void)
     }
     if(r1 == 0x05) {
         // SD Ver1 or MMC Ver3
+        SD_ChipSelect(false);
         SD_PRINTF("SD Init  Error %d\r\n", __LINE__);
         return SDCARD_ERR_UNSUPPORTED;  // SDSC not supported
     } else if(r1 == 0x01) {
@@ -542,26 +861,12 @@ int32_t SDCARD_Init(void)
             SD_PRINTF("SD Init Error %d\r\n", __LINE__);
             return ret;
         }
-        {
-            uint8_t cmd[] =
-                { 0x40 | 0x37 /* CMD55 */, 0x00, 0x00, 0x00, 0x00 /* ARG */, (0x7F << 1) | 1 /* CRC7 + end bit */ };
-            while(pdTRUE == xSemaphoreTake(semHandle, 0));
-            ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, BSP_SPI_CLK_156KHZ, semHandle, &status);
-            if(ret != SPI_ERR_NONE) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return ret;
-            }
-            if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return SPI_ERR_TIMEOUT;
-            }
-            if(status != SPI_ERR_NONE) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return status;
-            }
+        /* CMD55 (APP_CMD) command */
+        ret = SDCARD_SendCommand(0x37, 0);
+        if(ret != SPI_ERR_NONE) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+            return ret;
         }
 
         r1 = SDCARD_ReadR1();
@@ -582,26 +887,12 @@ int32_t SDCARD_Init(void)
             SD_PRINTF("SD Init Error %d\r\n", __LINE__);
             return ret;
         }
-        {
-            uint8_t cmd[] =
-                { 0x40 | 0x29 /* ACMD41 */, 0x40, 0x00, 0x00, 0x00 /* ARG */, (0x7F << 1) | 1 /* CRC7 + end bit */ };
-            while(pdTRUE == xSemaphoreTake(semHandle, 0));
-            ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, BSP_SPI_CLK_156KHZ, semHandle, &status);
-            if(ret != SPI_ERR_NONE) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return ret;
-            }
-            if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return SPI_ERR_TIMEOUT;
-            }
-            if(status != SPI_ERR_NONE) {
-                SD_ChipSelect(false);
-                SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-                return status;
-            }
+        /* ACMD41 (SD_SEND_OP_COND) command */
+        ret = SDCARD_SendCommand(0x29, 0x40000000);
+        if(ret != SPI_ERR_NONE) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+            return ret;
         }
 
         r1 = SDCARD_ReadR1();
@@ -632,26 +923,12 @@ int32_t SDCARD_Init(void)
         SD_PRINTF("SD Init Error %d\r\n", __LINE__);
         return ret;
     }
-    {
-        uint8_t cmd[] =
-            { 0x40 | 0x3A /* CMD58 */, 0x00, 0x00, 0x00, 0x00 /* ARG */, (0x7F << 1) | 1 /* CRC7 + end bit */ };
-        while(pdTRUE == xSemaphoreTake(semHandle, 0));
-        ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, BSP_SPI_CLK_156KHZ, semHandle, &status);
-        if(ret != SPI_ERR_NONE) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-            return ret;
-        }
-        if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-            return SPI_ERR_TIMEOUT;
-        }
-        if(status != SPI_ERR_NONE) {
-            SD_ChipSelect(false);
-            SD_PRINTF("SD Init Error %d\r\n", __LINE__);
-            return status;
-        }
+    /* CMD58 (READ_OCR) command */
+    ret = SDCARD_SendCommand(0x3A, 0);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+        return ret;
     }
 
     r1 = SDCARD_ReadR1();
@@ -686,6 +963,48 @@ int32_t SDCARD_Init(void)
             return SDCARD_ERR_UNSUPPORTED;
         }
     }
+#if CONFIG_SDCARD_CRC
+    /*
+     * Step 6.
+     *   Send CMD59 (CRC_ON_OFF) to have the card check CRC on commands and
+     *   written data blocks.
+     */
+    ret = SDCARD_SendCommand(0x3B, 1);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+        return ret;
+    }
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        SD_ChipSelect(false);
+        ret = r1;
+        SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+        return ret;
+    }
+    if(r1 != 0x00) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Init Error %d\r\n", __LINE__);
+        return SDCARD_ERR_R1;
+    }
+#endif
+#if (CONFIG_SDCARD_SPI_FREQ > SD_DEFAULT_SPEED_FREQ)
+    /*
+     * Step 7.
+     *   Send CMD6 (SWITCH_FUNC) to select high speed (function group 1,
+     *   function 1). Stay within the default speed limit if the card does
+     *   not switch.
+     */
+    ret = SDCARD_SwitchHighSpeed();
+    if(ret == SDCARD_ERR_NONE) {
+        sdcard.clk = SDCARD_ClockFor(CONFIG_SDCARD_SPI_FREQ);
+    } else {
+        SD_PRINTF("SD high speed not available %ld\r\n", ret);
+        sdcard.clk = SDCARD_ClockFor(SD_DEFAULT_SPEED_FREQ);
+    }
+#else
+    sdcard.clk = SDCARD_ClockFor(CONFIG_SDCARD_SPI_FREQ);
+#endif
 
     SD_ChipSelect(false);
     bInit = true;
@@ -693,37 +1012,37 @@ int32_t SDCARD_Init(void)
     /*
      * Get SD Card Information
      */
-    ret = SDCARD_ReadCardSpecificData(block_data, SDCARD_CSD_DATA_SIZE);
+    ret = SDCARD_ReadCardSpecificData(csd, SDCARD_CSD_DATA_SIZE);
     if(ret != SDCARD_ERR_NONE) {
         SD_PRINTF("CSD Error %d\r\n", __LINE__);
         bInit = false;
         return ret;
     }
     // check CSD version
-    sdcard.csd_version = (block_data[0] >> 6) & 0x03;
+    sdcard.csd_version = (csd[0] >> 6) & 0x03;
     if(sdcard.csd_version != 0x01) {
         SD_PRINTF("CSD Version 2.0 not found\r\n");
         bInit = false;
         return SDCARD_ERR_UNSUPPORTED;
     }
     // check READ_BL_LEN
-    if((block_data[5] & 0x0F) != 0x09) {
+    if((csd[5] & 0x0F) != 0x09) {
         SD_PRINTF("READ_BL_LEN != 512 Byte\r\n");
         bInit = false;
         return SDCARD_ERR_UNSUPPORTED;
     }
     // check WRITE_BL_LEN
-    if(((block_data[13] >> 6) + ((block_data[12] & 0x03) << 2)) != 0x09) {
+    if(((csd[13] >> 6) + ((csd[12] & 0x03) << 2)) != 0x09) {
         SD_PRINTF("WRITE_BL_LEN != 512 Byte\r\n");
         bInit = false;
         return SDCARD_ERR_UNSUPPORTED;
     }
-    const uint32_t block_count_512K = block_data[9] +
-            ((uint32_t)block_data[8] << 8) + ((uint32_t)(block_data[7] & 0x3F) << 16);
+    const uint32_t block_count_512K = csd[9] +
+            ((uint32_t)csd[8] << 8) + ((uint32_t)(csd[7] & 0x3F) << 16);
     sdcard.max_block_count = block_count_512K * 1024U;
     sdcard.size_MB = ((block_count_512K + 1) * 512) / 1024;
-    const uint32_t sd_sectorSize = ((block_data[10] & 0x3F) << 1) +
-                                   ((block_data[11] >> 7) & 0x01);
+    const uint32_t sd_sectorSize = ((csd[10] & 0x3F) << 1) +
+                                   ((csd[11] >> 7) & 0x01);
     // check Sector Size
     sdcard.sector_size = (sd_sectorSize + 1) * 512;
     if(sdcard.sector_size != SDCARD_SECTOR_SIZE) {
@@ -804,14 +1123,16 @@ int SDCARD_GetBlocksNumber(uint32_t* num) {
 int32_t SDCARD_ReadOCR(uint32_t * pOCR)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
 
     if(bInit != true) {
         return SDCARD_ERR_NOT_INITIALIZED;
     }
 
-    SD_ChipSelect(true);
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
 
     ret = SDCARD_WaitNotBusy();
     if(ret != SPI_ERR_NONE) {
@@ -820,28 +1141,12 @@ int32_t SDCARD_ReadOCR(uint32_t * pOCR)
         return ret;
     }
     /* CMD58 (READ_OCR) command */
-    uint8_t cmd[] = {
-            0x40 | 0x3A /* CMD58 */,
-            0x00, 0x00, 0x00, 0x00 /* ARG */,
-            (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
+    ret = SDCARD_SendCommand(0x3A, 0);
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read OCR Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read OCR Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read OCR Error %d\r\n", __LINE__);
-        return status;
-    }
     r1 = SDCARD_ReadR1();
     if(r1 < 0) {
         SD_ChipSelect(false);
@@ -879,8 +1184,8 @@ int32_t SDCARD_ReadOCR(uint32_t * pOCR)
 int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
+    uint8_t crc[2];
 
     if((buff == NULL) || (buffLen != SDCARD_CID_DATA_SIZE)) {
         return SDCARD_ERR_INVALID_ARG;
@@ -890,7 +1195,10 @@ int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen)
         return SDCARD_ERR_NOT_INITIALIZED;
     }
 
-    SD_ChipSelect(true);
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
 
     ret = SDCARD_WaitNotBusy();
     if(ret != SPI_ERR_NONE) {
@@ -900,28 +1208,12 @@ int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen)
     }
 
     /* CMD10 (SEND_CID) command */
-    uint8_t cmd[] = {
-        0x40 | 0x0A /* CMD10 */,
-        0x00, 0x00, 0x00, 0x00, /* ARG */
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
+    ret = SDCARD_SendCommand(0x0A, 0);
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read CID Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read CID Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read CID Error %d\r\n", __LINE__);
-        return status;
-    }
 
     r1 = SDCARD_ReadR1();
     if(r1 < 0) {
@@ -943,7 +1235,7 @@ int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen)
         return ret;
     }
 
-    ret = SDCARD_ReadBytes(buff, SDCARD_CID_DATA_SIZE);
+    ret = SDCARD_ReadDataBlock(buff, SDCARD_CID_DATA_SIZE, crc);
     if(ret < 0) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read CID Error %d\r\n", __LINE__);
@@ -958,8 +1250,8 @@ int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen)
 int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
+    uint8_t crc[2];
 
     if((buff == NULL) || (buffLen != SDCARD_CSD_DATA_SIZE)) {
         return SDCARD_ERR_INVALID_ARG;
@@ -969,7 +1261,10 @@ int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen)
         return SDCARD_ERR_NOT_INITIALIZED;
     }
 
-    SD_ChipSelect(true);
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
 
     ret = SDCARD_WaitNotBusy();
     if(ret != SPI_ERR_NONE) {
@@ -979,28 +1274,12 @@ int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen)
     }
 
     /* CMD9 (SEND_CSD) command */
-    uint8_t cmd[] = {
-        0x40 | 0x09 /* CMD9 */,
-        0x00, 0x00, 0x00, 0x00, /* ARG */
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
+    ret = SDCARD_SendCommand(0x09, 0);
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read CSD Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read CSD Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read CSD Error %d\r\n", __LINE__);
-        return status;
-    }
 
     r1 = SDCARD_ReadR1();
     if(r1 < 0) {
@@ -1022,7 +1301,7 @@ int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen)
         return ret;
     }
 
-    ret = SDCARD_ReadBytes(buff, SDCARD_CSD_DATA_SIZE);
+    ret = SDCARD_ReadDataBlock(buff, SDCARD_CSD_DATA_SIZE, crc);
     if(ret < 0) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read CSD Error %d\r\n", __LINE__);
@@ -1034,10 +1313,9 @@ int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen)
 }
 
 
-int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen)
+static int32_t SDCARD_ReadSingleBlockTry(uint32_t blockNum, uint8_t * buff, size_t buffLen)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
     uint8_t crc[2];
 
@@ -1049,7 +1327,10 @@ int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen
         return SDCARD_ERR_NOT_INITIALIZED;
     }
 
-    SD_ChipSelect(true);
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
 
     ret = SDCARD_WaitNotBusy();
     if(ret != SPI_ERR_NONE) {
@@ -1059,32 +1340,12 @@ int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen
     }
 
     /* CMD17 (SEND_SINGLE_BLOCK) command */
-    uint8_t cmd[] = {
-        0x40 | 0x11 /* CMD17 */,
-        (blockNum >> 24) & 0xFF, /* ARG */
-        (blockNum >> 16) & 0xFF,
-        (blockNum >> 8) & 0xFF,
-        blockNum & 0xFF,
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
+    ret = SDCARD_SendCommand(0x11, blockNum);
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read Single Block Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read Single Block Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read Single Block Error %d\r\n", __LINE__);
-        return status;
-    }
 
     r1 = SDCARD_ReadR1();
     if(r1 < 0) {
@@ -1106,14 +1367,7 @@ int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen
         return ret;
     }
 
-    ret = SDCARD_ReadBytes(buff, SDCARD_BLOCK_SIZE);
-    if(ret < 0) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Read Single Block Error %d\r\n", __LINE__);
-        return ret;
-    }
-
-    ret = SDCARD_ReadBytes(crc, 2);
+    ret = SDCARD_ReadDataBlock(buff, SDCARD_BLOCK_SIZE, crc);
     if(ret < 0) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Read Single Block Error %d\r\n", __LINE__);
@@ -1125,22 +1379,32 @@ int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen
 }
 
 
-int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t buffLen)
+int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen)
+{
+    int32_t ret;
+
+    do {
+        ret = SDCARD_ReadSingleBlockTry(blockNum, buff, buffLen);
+    } while((ret != SDCARD_ERR_NONE) && SDCARD_ClockStepDown(ret));
+    return ret;
+}
+
+
+/*
+ * Sends CMD24 and the data block, returns once the card has accepted the
+ * data. Chip select is still asserted on success, the card is busy
+ * programming.
+ */
+static int32_t SDCARD_WriteBlockStart(uint32_t blockNum, const uint8_t * buff)
 {
     int32_t ret = SPI_ERR_NONE;
-    int32_t status;
     int8_t r1;
 
-    if((buff == NULL) || (buffLen != SDCARD_BLOCK_SIZE)) {
-        return SDCARD_ERR_INVALID_ARG;
-    }
-
-    if(bInit != true) {
-        return SDCARD_ERR_NOT_INITIALIZED;
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
     }
 
-    SD_ChipSelect(true);
-
     ret = SDCARD_WaitNotBusy();
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
@@ -1149,32 +1413,12 @@ int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t
     }
 
     /* CMD24 (WRITE_BLOCK) command */
-    uint8_t cmd[] = {
-        0x40 | 0x18 /* CMD24 */,
-        (blockNum >> 24) & 0xFF, /* ARG */
-        (blockNum >> 16) & 0xFF,
-        (blockNum >> 8) & 0xFF,
-        blockNum & 0xFF,
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(cmd, cmd, sizeof(cmd), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
+    ret = SDCARD_SendCommand(0x18, blockNum);
     if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
         SD_PRINTF("SD Write Single Block Error %d\r\n", __LINE__);
         return ret;
     }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write Single Block Error %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write Single Block Error %d\r\n", __LINE__);
-        return status;
-    }
 
     r1 = SDCARD_ReadR1();
     if(r1 < 0) {
@@ -1190,70 +1434,8 @@ int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t
     }
 
     /*
-     * Transmit Data Token (CMD24)
-     */
-    uint8_t dataToken = DATA_TOKEN_CMD24;
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(&dataToken, &dataToken, sizeof(dataToken), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
-    if(ret != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write CMD24 Token Error %d\r\n", __LINE__);
-        return ret;
-    }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write CMD24 Token Timeout %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write CMD24 Token Error %d\r\n", __LINE__);
-        return status;
-    }
-
-    /*
-     * Transmit block
-     */
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(buff, block_data, SDCARD_BLOCK_SIZE, SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
-    if(ret != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write Block Error %d\r\n", __LINE__);
-        return ret;
-    }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write Block Timeout %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write Block Error %d\r\n", __LINE__);
-        return status;
-    }
-
-    /*
-     * Transmit crc
+     * Transmit Data Token (CMD24), block and crc
      */
-    uint8_t crc[2] = { 0xFF, 0xFF };
-    while(pdTRUE == xSemaphoreTake(semHandle, 0));  // clear any old sem
-    ret = BSP_SPI_transact(crc, crc, sizeof(crc), SPI_MODE0, NULL, (BSP_SPI_CLK_T)CONFIG_SDCARD_SPI_FREQ_IDX, semHandle, &status);
-    if(ret != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write crc error %d\r\n", __LINE__);
-        return ret;
-    }
-    if(pdTRUE != xSemaphoreTake(semHandle, SD_DEFAULT_TIMEOUT)) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write crc timeout %d\r\n", __LINE__);
-        return SPI_ERR_TIMEOUT;
-    }
-    if(status != SPI_ERR_NONE) {
-        SD_ChipSelect(false);
-        SD_PRINTF("SD Write crc error %d\r\n", __LINE__);
-        return status;
-    }
-
     /*
         dataResp:
         xxx0abc1
@@ -1262,21 +1444,46 @@ int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t
             110 - Data rejected due to write error
     */
     uint8_t dataResp;
-    ret = SDCARD_ReadBytes(&dataResp, sizeof(dataResp));
-    if(ret != SDCARD_ERR_NONE) {
+    ret = SDCARD_SendDataBlock(DATA_TOKEN_CMD24, buff, &dataResp);
+    if(ret != SPI_ERR_NONE) {
         SD_ChipSelect(false);
-        SD_PRINTF("SD Write single block error %d\r\n", __LINE__);
+        SD_PRINTF("SD Write Single Block Error %d\r\n", __LINE__);
         return ret;
     }
     if((dataResp & 0x1F) != 0x05) { // data rejected
         SD_PRINTF("SD Write single block rejected %d\r\n", __LINE__);
         SD_ChipSelect(false);
-        return SDCARD_ERR_WRITE_REJECTED;
+        return ((dataResp & 0x1F) == 0x0B) ? SDCARD_ERR_CRC : SDCARD_ERR_WRITE_REJECTED;
+    }
+
+    return SDCARD_ERR_NONE;
+}
+
+
+static int32_t SDCARD_WriteSingleBlockTry(uint32_t blockNum, const uint8_t * buff,  size_t buffLen)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    if((buff == NULL) || (buffLen != SDCARD_BLOCK_SIZE)) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+
+    if(bInit != true) {
+        return SDCARD_ERR_NOT_INITIALIZED;
+    }
+    if(SD_IsSelected()) {
+        /* own stream still open */
+        return SDCARD_ERR_INVALID_STATE;
+    }
+
+    ret = SDCARD_WriteBlockStart(blockNum, buff);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
     }
     ret = SDCARD_WaitNotBusy();
     if(ret != SDCARD_ERR_NONE) {
         SD_ChipSelect(false);
-        SD_PRINTF("SD Write S.ingle Block Error %d\r\n", __LINE__);
+        SD_PRINTF("SD Write Single Block Error %d\r\n", __LINE__);
         return ret;
     }
 
@@ -1285,125 +1492,305 @@ int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t
 }
 
 
-#if 0
-int SDCARD_ReadBegin(uint32_t blockNum) {
-    SDCARD_Select();
+int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff,  size_t buffLen)
+{
+    int32_t ret;
 
-    if(SDCARD_WaitNotBusy() < 0) { // keep this!
-        SDCARD_Unselect();
-        return -1;
-    }
+    do {
+        ret = SDCARD_WriteSingleBlockTry(blockNum, buff, buffLen);
+    } while((ret != SDCARD_ERR_NONE) && SDCARD_ClockStepDown(ret));
+    return ret;
+}
 
-    /* CMD18 (READ_MULTIPLE_BLOCK) command */
-    uint8_t cmd[] = {
-        0x40 | 0x12 /* CMD18 */,
-        (blockNum >> 24) & 0xFF, /* ARG */
-        (blockNum >> 16) & 0xFF,
-        (blockNum >> 8) & 0xFF,
-        blockNum & 0xFF,
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, (uint8_t*)cmd, sizeof(cmd), HAL_MAX_DELAY);
 
-    if(SDCARD_ReadR1() != 0x00) {
-        SDCARD_Unselect();
-        return -2;
+int32_t SDCARD_WriteSingleBlockAsync(uint32_t blockNum, const uint8_t * buff,
+        size_t buffLen, SDCARD_WRITE_CB_T cb, void * ctx)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    if((buff == NULL) || (buffLen != SDCARD_BLOCK_SIZE)) {
+        return SDCARD_ERR_INVALID_ARG;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    if(bInit != true) {
+        return SDCARD_ERR_NOT_INITIALIZED;
+    }
+    if(SD_IsSelected()) {
+        /* own stream still open */
+        return SDCARD_ERR_INVALID_STATE;
+    }
+
+    ret = SDCARD_WriteBlockStart(blockNum, buff);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+    /*
+     * The card keeps programming with chip select released, busy is
+     * resolved by the next command, SDCARD_PollBusy() or SDCARD_Sync().
+     */
+    SDCARD_DeferBusy(cb, ctx);
+    SD_ChipSelect(false);
+    return SDCARD_ERR_NONE;
 }
 
-int SDCARD_ReadData(uint8_t* buff) {
-    uint8_t crc[2];
-    SDCARD_Select();
 
-    if(SDCARD_WaitDataToken(DATA_TOKEN_CMD18) < 0) {
-        SDCARD_Unselect();
-        return -1;
+int32_t SDCARD_ReadBegin(uint32_t blockNum)
+{
+    int32_t ret = SPI_ERR_NONE;
+    int8_t r1;
+
+    if(bInit != true) {
+        return SDCARD_ERR_NOT_INITIALIZED;
+    }
+    if(SD_IsSelected()) {
+        /* own stream still open */
+        return SDCARD_ERR_INVALID_STATE;
     }
 
-    if(SDCARD_ReadBytes(buff, 512) < 0) {
-        SDCARD_Unselect();
-        return -2;
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
     }
 
-    if(SDCARD_ReadBytes(crc, 2) < 0) {
-        SDCARD_Unselect();
-        return -3;
+    ret = SDCARD_WaitNotBusy();
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read Begin Error %d\r\n", __LINE__);
+        return ret;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    /* CMD18 (READ_MULTIPLE_BLOCK) command */
+    ret = SDCARD_SendCommand(0x12, blockNum);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read Begin Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read Begin Error %d\r\n", __LINE__);
+        return r1;
+    }
+    if(r1 != 0x00) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read Begin Error %d (r1: 0x%02x)\r\n", __LINE__, r1);
+        return SDCARD_ERR_R1;
+    }
 
+    /* Chip select is held until SDCARD_ReadEnd() */
+    sdcard.transfer = SD_TRANSFER_READ;
+    return SDCARD_ERR_NONE;
 }
 
-int SDCARD_ReadEnd() {
-    SDCARD_Select();
+
+int32_t SDCARD_ReadData(uint8_t * buff)
+{
+    int32_t ret = SPI_ERR_NONE;
+    uint8_t crc[2];
+
+    if(buff == NULL) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+    if(!SD_IsSelected() || (sdcard.transfer != SD_TRANSFER_READ)) {
+        return SDCARD_ERR_INVALID_STATE;
+    }
+
+    ret = SDCARD_WaitDataToken(DATA_TOKEN_CMD18);
+    if(ret < 0) {
+        SD_PRINTF("SD Read Data Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+    ret = SDCARD_ReadDataBlock(buff, SDCARD_BLOCK_SIZE, crc);
+    if(ret < 0) {
+        SD_PRINTF("SD Read Data Error %d\r\n", __LINE__);
+        return ret;
+    }
+#if CONFIG_SDCARD_STATS
+    /* next token latency is counted from the end of this block */
+    sdcard.lastCmdCycle = BSP_CYCLE_get();
+#endif
+
+    return SDCARD_ERR_NONE;
+}
+
+
+int32_t SDCARD_ReadEnd(void)
+{
+    int32_t ret = SPI_ERR_NONE;
+    int8_t r1;
+
+    if(!SD_IsSelected() || (sdcard.transfer != SD_TRANSFER_READ)) {
+        return SDCARD_ERR_INVALID_STATE;
+    }
+    sdcard.transfer = SD_TRANSFER_IDLE;
 
     /* CMD12 (STOP_TRANSMISSION) */
-    {
-        static const uint8_t cmd[] = { 0x40 | 0x0C /* CMD12 */, 0x00, 0x00, 0x00, 0x00 /* ARG */, (0x7F << 1) | 1 };
-        HAL_SPI_Transmit(&SDCARD_SPI_PORT, (uint8_t*)cmd, sizeof(cmd), HAL_MAX_DELAY);
+    ret = SDCARD_SendCommand(0x0C, 0);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read End Error %d\r\n", __LINE__);
+        return ret;
     }
 
     /*
-    The received byte immediataly following CMD12 is a stuff byte, it should be
-    discarded before receive the response of the CMD12
-    */
+     * The received byte immediately following CMD12 is a stuff byte, it should be
+     * discarded before receive the response of the CMD12
+     */
     uint8_t stuffByte;
-    if(SDCARD_ReadBytes(&stuffByte, sizeof(stuffByte)) < 0) {
-        SDCARD_Unselect();
-        return -1;
+    ret = SDCARD_ReadBytes(&stuffByte, sizeof(stuffByte));
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read End Error %d\r\n", __LINE__);
+        return ret;
     }
 
-    if(SDCARD_ReadR1() != 0x00) {
-        SDCARD_Unselect();
-        return -2;
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read End Error %d\r\n", __LINE__);
+        return r1;
+    }
+    if(r1 != 0x00) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read End Error %d (r1: 0x%02x)\r\n", __LINE__, r1);
+        return SDCARD_ERR_R1;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    /* CMD12 has R1b response */
+    ret = SDCARD_WaitNotBusy();
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Read End Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+    SD_ChipSelect(false);
+    return SDCARD_ERR_NONE;
 }
 
 
-int SDCARD_WriteBegin(uint32_t blockNum) {
-    SDCARD_Select();
+#if CONFIG_SDCARD_PRE_ERASE
+/*
+ * ACMD23 (SET_WR_BLK_ERASE_COUNT) ahead of CMD25, lets the card erase the
+ * blocks to be written before the data arrives. Chip select must be
+ * asserted and the card not busy.
+ */
+static int32_t SDCARD_SetPreEraseCount(uint32_t count)
+{
+    int32_t ret;
+    int8_t r1;
 
-    if(SDCARD_WaitNotBusy() < 0) { // keep this!
-        SDCARD_Unselect();
-        return -1;
+    /* CMD55 (APP_CMD) command */
+    ret = SDCARD_SendCommand(0x37, 0);
+    if(ret != SPI_ERR_NONE) {
+        return ret;
+    }
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        return r1;
+    }
+    if(r1 != 0x00) {
+        return SDCARD_ERR_R1;
     }
 
+    /* ACMD23 (SET_WR_BLK_ERASE_COUNT) command */
+    ret = SDCARD_SendCommand(0x17, (count > SD_PRE_ERASE_MAX) ? SD_PRE_ERASE_MAX : count);
+    if(ret != SPI_ERR_NONE) {
+        return ret;
+    }
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        return r1;
+    }
+    if(r1 != 0x00) {
+        return SDCARD_ERR_R1;
+    }
+    return SDCARD_ERR_NONE;
+}
+#endif /* CONFIG_SDCARD_PRE_ERASE */
+
+
+int32_t SDCARD_WriteBegin(uint32_t blockNum, uint32_t count)
+{
+    int32_t ret = SPI_ERR_NONE;
+    int8_t r1;
+
+    if(bInit != true) {
+        return SDCARD_ERR_NOT_INITIALIZED;
+    }
+    if(SD_IsSelected()) {
+        /* own stream still open */
+        return SDCARD_ERR_INVALID_STATE;
+    }
+
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+
+    ret = SDCARD_WaitNotBusy();
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write Begin Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+#if CONFIG_SDCARD_PRE_ERASE
+    if(count > 1) {
+        ret = SDCARD_SetPreEraseCount(count);
+        if(ret != SDCARD_ERR_NONE) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Write Begin Error %d\r\n", __LINE__);
+            return ret;
+        }
+    }
+#else
+    (void)count;
+#endif /* CONFIG_SDCARD_PRE_ERASE */
+
     /* CMD25 (WRITE_MULTIPLE_BLOCK) command */
-    uint8_t cmd[] = {
-        0x40 | 0x19 /* CMD25 */,
-        (blockNum >> 24) & 0xFF, /* ARG */
-        (blockNum >> 16) & 0xFF,
-        (blockNum >> 8) & 0xFF,
-        blockNum & 0xFF,
-        (0x7F << 1) | 1 /* CRC7 + end bit */
-    };
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, (uint8_t*)cmd, sizeof(cmd), HAL_MAX_DELAY);
+    ret = SDCARD_SendCommand(0x19, blockNum);
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write Begin Error %d\r\n", __LINE__);
+        return ret;
+    }
 
-    if(SDCARD_ReadR1() != 0x00) {
-        SDCARD_Unselect();
-        return -2;
+    r1 = SDCARD_ReadR1();
+    if(r1 < 0) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write Begin Error %d\r\n", __LINE__);
+        return r1;
+    }
+    if(r1 != 0x00) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write Begin Error %d (r1: 0x%02x)\r\n", __LINE__, r1);
+        return SDCARD_ERR_R1;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    /* Chip select is held until SDCARD_WriteEnd() */
+    sdcard.transfer = SD_TRANSFER_WRITE;
+    return SDCARD_ERR_NONE;
 }
 
-int SDCARD_WriteData(const uint8_t* buff) {
-    SDCARD_Select();
 
-    uint8_t dataToken = DATA_TOKEN_CMD25;
-    uint8_t crc[2] = { 0xFF, 0xFF };
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, &dataToken, sizeof(dataToken), HAL_MAX_DELAY);
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, (uint8_t*)buff, 512, HAL_MAX_DELAY);
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, crc, sizeof(crc), HAL_MAX_DELAY);
+int32_t SDCARD_WriteData(const uint8_t * buff)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    if(buff == NULL) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+    if(!SD_IsSelected() || (sdcard.transfer != SD_TRANSFER_WRITE)) {
+        return SDCARD_ERR_INVALID_STATE;
+    }
 
+    /*
+     * Transmit Data Token (CMD25), block and crc
+     */
     /*
         dataResp:
         xxx0abc1
@@ -1412,46 +1799,331 @@ int SDCARD_WriteData(const uint8_t* buff) {
             110 - Data rejected due to write error
     */
     uint8_t dataResp;
-    SDCARD_ReadBytes(&dataResp, sizeof(dataResp));
+    ret = SDCARD_SendDataBlock(DATA_TOKEN_CMD25, buff, &dataResp);
+    if(ret != SPI_ERR_NONE) {
+        SD_PRINTF("SD Write Data Error %d\r\n", __LINE__);
+        return ret;
+    }
     if((dataResp & 0x1F) != 0x05) { // data rejected
-        SDCARD_Unselect();
-        return -1;
+        SD_PRINTF("SD Write Data rejected %d\r\n", __LINE__);
+        return ((dataResp & 0x1F) == 0x0B) ? SDCARD_ERR_CRC : SDCARD_ERR_WRITE_REJECTED;
     }
 
-    if(SDCARD_WaitNotBusy() < 0) {
-        SDCARD_Unselect();
-        return -2;
+    ret = SDCARD_WaitNotBusy();
+    if(ret != SPI_ERR_NONE) {
+        SD_PRINTF("SD Write Data Error %d\r\n", __LINE__);
+        return ret;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    return SDCARD_ERR_NONE;
 }
 
-int SDCARD_WriteEnd() {
-    SDCARD_Select();
+
+/*
+ * Sends the stop transaction token. Chip select is still asserted on
+ * success, the card is busy programming.
+ */
+static int32_t SDCARD_WriteStop(void)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    if(!SD_IsSelected() || (sdcard.transfer != SD_TRANSFER_WRITE)) {
+        return SDCARD_ERR_INVALID_STATE;
+    }
+    sdcard.transfer = SD_TRANSFER_IDLE;
 
     uint8_t stopTran = 0xFD; // stop transaction token for CMD25
-    HAL_SPI_Transmit(&SDCARD_SPI_PORT, &stopTran, sizeof(stopTran), HAL_MAX_DELAY);
+    ret = SDCARD_Transfer(&stopTran, NULL, sizeof(stopTran));
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write End Error %d\r\n", __LINE__);
+        return ret;
+    }
 
-    // skip one byte before readyng "busy"
-    // this is required by the spec and is necessary for some real SD-cards!
+    /*
+     * Skip one byte before reading "busy".
+     * This is required by the spec and is necessary for some real SD-cards!
+     */
     uint8_t skipByte;
-    SDCARD_ReadBytes(&skipByte, sizeof(skipByte));
+    ret = SDCARD_ReadBytes(&skipByte, sizeof(skipByte));
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write End Error %d\r\n", __LINE__);
+        return ret;
+    }
 
-    if(SDCARD_WaitNotBusy() < 0) {
-        SDCARD_Unselect();
-        return -1;
+    return SDCARD_ERR_NONE;
+}
+
+
+int32_t SDCARD_WriteEnd(void)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    ret = SDCARD_WriteStop();
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
     }
 
-    SDCARD_Unselect();
-    return 0;
+    ret = SDCARD_WaitNotBusy();
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Write End Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+    SD_ChipSelect(false);
+    return SDCARD_ERR_NONE;
 }
-#endif
+
+
+int32_t SDCARD_WriteEndAsync(SDCARD_WRITE_CB_T cb, void * ctx)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    ret = SDCARD_WriteStop();
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+
+    SDCARD_DeferBusy(cb, ctx);
+    SD_ChipSelect(false);
+    return SDCARD_ERR_NONE;
+}
+
+
+int32_t SDCARD_PollBusy(void)
+{
+    int32_t ret = SPI_ERR_NONE;
+    uint8_t busy;
+
+    if(sdcard.busyPending != true) {
+        return SDCARD_ERR_NONE;
+    }
+
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+    if(sdcard.busyPending != true) {
+        /* resolved by another task meanwhile */
+        SD_ChipSelect(false);
+        return SDCARD_ERR_NONE;
+    }
+    do {
+        /* scan the whole burst, the card may go ready within it */
+        ret = SDCARD_PollByte(&busy);
+    } while((ret == SPI_ERR_NONE) && (busy != 0xFF) && (sdPoll.idx < sdPoll.len));
+    SD_ChipSelect(false);
+
+    if(ret != SPI_ERR_NONE) {
+        SDCARD_BusyComplete(ret);
+        return ret;
+    }
+    if(busy == 0xFF) {
+        SDCARD_BusyComplete(SDCARD_ERR_NONE);
+        return SDCARD_ERR_NONE;
+    }
+    if((xTaskGetTickCount() - sdcard.busyStart) > SD_WAIT_BUSY_TIMEOUT) {
+        SD_PRINTF("SD Poll Busy Timeout\r\n");
+        SDCARD_BusyComplete(SDCARD_ERR_TIMEOUT);
+        return SDCARD_ERR_TIMEOUT;
+    }
+    return SDCARD_ERR_BUSY;
+}
+
+
+int32_t SDCARD_Sync(void)
+{
+    int32_t ret = SPI_ERR_NONE;
+
+    if(sdcard.busyPending != true) {
+        return SDCARD_ERR_NONE;
+    }
+
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+    ret = SDCARD_WaitNotBusy();
+    SD_ChipSelect(false);
+    return ret;
+}
+
+
+static int32_t SDCARD_ReadMultiBlockTry(uint32_t blockNum, uint8_t * buff, uint32_t count)
+{
+    int32_t ret = SDCARD_ERR_NONE;
+    int32_t retEnd;
+
+    if((buff == NULL) || (count == 0)) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+    if(count == 1) {
+        return SDCARD_ReadSingleBlockTry(blockNum, buff, SDCARD_BLOCK_SIZE);
+    }
+
+    ret = SDCARD_ReadBegin(blockNum);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        ret = SDCARD_ReadData(&buff[i * SDCARD_BLOCK_SIZE]);
+        if(ret != SDCARD_ERR_NONE) {
+            break;
+        }
+    }
+    /* Always stop the transmission, even on error */
+    retEnd = SDCARD_ReadEnd();
+
+    return (ret != SDCARD_ERR_NONE) ? ret : retEnd;
+}
+
+
+int32_t SDCARD_ReadMultiBlock(uint32_t blockNum, uint8_t * buff, uint32_t count)
+{
+    int32_t ret;
+
+    do {
+        ret = SDCARD_ReadMultiBlockTry(blockNum, buff, count);
+    } while((ret != SDCARD_ERR_NONE) && SDCARD_ClockStepDown(ret));
+    return ret;
+}
+
+
+static int32_t SDCARD_WriteMultiBlockTry(uint32_t blockNum, const uint8_t * buff, uint32_t count)
+{
+    int32_t ret = SDCARD_ERR_NONE;
+    int32_t retEnd;
+
+    if((buff == NULL) || (count == 0)) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+    if(count == 1) {
+        return SDCARD_WriteSingleBlockTry(blockNum, buff, SDCARD_BLOCK_SIZE);
+    }
+
+    ret = SDCARD_WriteBegin(blockNum, count);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        ret = SDCARD_WriteData(&buff[i * SDCARD_BLOCK_SIZE]);
+        if(ret != SDCARD_ERR_NONE) {
+            break;
+        }
+    }
+    /* Always send the stop token, even on error */
+    retEnd = SDCARD_WriteEnd();
+
+    return (ret != SDCARD_ERR_NONE) ? ret : retEnd;
+}
+
+
+int32_t SDCARD_WriteMultiBlock(uint32_t blockNum, const uint8_t * buff, uint32_t count)
+{
+    int32_t ret;
+
+    do {
+        ret = SDCARD_WriteMultiBlockTry(blockNum, buff, count);
+    } while((ret != SDCARD_ERR_NONE) && SDCARD_ClockStepDown(ret));
+    return ret;
+}
+
+int32_t SDCARD_Erase(uint32_t startLBA, uint32_t endLBA)
+{
+    static const uint8_t cmdIdx[] = {
+        0x20,   // CMD32 (ERASE_WR_BLK_START_ADDR)
+        0x21,   // CMD33 (ERASE_WR_BLK_END_ADDR)
+        0x26    // CMD38 (ERASE)
+    };
+    const uint32_t arg[] = {startLBA, endLBA, 0};
+    int32_t ret = SPI_ERR_NONE;
+    int8_t r1;
+
+    if(bInit != true) {
+        return SDCARD_ERR_NOT_INITIALIZED;
+    }
+    if((startLBA > endLBA) || (endLBA >= sdcard.max_block_count)) {
+        return SDCARD_ERR_INVALID_ARG;
+    }
+    if(SD_IsSelected()) {
+        /* own stream still open */
+        return SDCARD_ERR_INVALID_STATE;
+    }
+
+    ret = SD_ChipSelect(true);
+    if(ret != SDCARD_ERR_NONE) {
+        return ret;
+    }
+
+    for(uint32_t i = 0; i < sizeof(cmdIdx); i++) {
+        ret = SDCARD_WaitNotBusy();
+        if(ret != SPI_ERR_NONE) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Erase Error %d\r\n", __LINE__);
+            return ret;
+        }
+        ret = SDCARD_SendCommand(cmdIdx[i], arg[i]);
+        if(ret != SPI_ERR_NONE) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Erase Error %d\r\n", __LINE__);
+            return ret;
+        }
+        r1 = SDCARD_ReadR1();
+        if(r1 < 0) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Erase Error %d\r\n", __LINE__);
+            return r1;
+        }
+        if(r1 != 0x00) {
+            SD_ChipSelect(false);
+            SD_PRINTF("SD Erase Error %d (r1: 0x%02x)\r\n", __LINE__, r1);
+            return SDCARD_ERR_R1;
+        }
+    }
+
+    /*
+     * CMD38 has R1b response. Without the SD status erase timeout fields
+     * allow 250ms per allocation unit.
+     */
+    const uint32_t nAU = ((endLBA - startLBA) / SD_ERASE_AU_BLOCKS) + 1;
+    ret = SDCARD_WaitNotBusyFor(SD_WAIT_BUSY_TIMEOUT + (nAU * SD_ERASE_AU_TIMEOUT));
+    if(ret != SPI_ERR_NONE) {
+        SD_ChipSelect(false);
+        SD_PRINTF("SD Erase Error %d\r\n", __LINE__);
+        return ret;
+    }
+
+    SD_ChipSelect(false);
+    return SDCARD_ERR_NONE;
+}
+
 
 uint32_t SDCARD_GetBlockCount(void)
 {
     return (sdcard.max_block_count);
 }
 
+
+uint32_t SDCARD_GetClockHz(void)
+{
+    return BSP_SPI_getClockHz(SDCARD_SpiClock());
+}
+
+#if CONFIG_SDCARD_STATS
+const SDCARD_STATS_T * SDCARD_GetStats(void)
+{
+    return &sdStats;
+}
+
+
+void SDCARD_ResetStats(void)
+{
+    memset(&sdStats, 0, sizeof(sdStats));
+}
+#endif /* CONFIG_SDCARD_STATS */
+
+
 #endif /* CONFIG_USE_SDCARD */
 
@@ -28,6 +28,11 @@
 #define SDCARD_ERR_WAIT_DATA_TOKEN      (SPI_ERR_LASTENTRY-7)
 #define SDCARD_ERR_NOT_INITIALIZED      (SPI_ERR_LASTENTRY-8)
 #define SDCARD_ERR_WRITE_REJECTED       (SPI_ERR_LASTENTRY-9)
+#define SDCARD_ERR_INVALID_STATE        (SPI_ERR_LASTENTRY-10)
+#define SDCARD_ERR_BUSY                 (SPI_ERR_LASTENTRY-11)
+#define SDCARD_ERR_CRC                  (SPI_ERR_LASTENTRY-12)
+#define SDCARD_ERR_DATA_ERROR_TOKEN     (SPI_ERR_LASTENTRY-13)  // card reported a read error
+#define SDCARD_ERR_LASTENTRY            (SPI_ERR_LASTENTRY-14)
 
 #define SDCARD_BLOCK_SIZE               (512)   // READ_BL_LEN or
                                                 // WRITE_BL_LEN
@@ -35,6 +40,30 @@
 #define SDCARD_SECTOR_SIZE              (65536) // 64kB
 #define SDCARD_CID_DATA_SIZE            (16)
 #define SDCARD_CSD_DATA_SIZE            (16)
+#define SDCARD_CMD_COUNT                (64)    // 6-bit command index
+
+/*
+ * Async write completion. status is SDCARD_ERR_NONE once the card has
+ * finished programming, or the error that ended the busy wait. Called from
+ * the task that resolves the busy (next SD command, SDCARD_PollBusy() or
+ * SDCARD_Sync()) with the driver locked, it must not call back into the
+ * SD driver.
+ */
+typedef void (*SDCARD_WRITE_CB_T)(int32_t status, void * ctx);
+
+typedef struct {
+    uint32_t count;
+    uint32_t totalUs;
+    uint32_t maxUs;
+} SDCARD_CMD_STAT_T;
+
+typedef struct {
+    SDCARD_CMD_STAT_T r1[SDCARD_CMD_COUNT];     // command sent -> R1 received
+    SDCARD_CMD_STAT_T token[SDCARD_CMD_COUNT];  // command sent -> data token
+    uint32_t pollTransactions;                  // SPI bursts used for polling
+    uint32_t crcErrors;                         // read blocks failing CRC16
+    uint32_t clkStepDowns;                      // SPI clock reductions
+} SDCARD_STATS_T;
 
 int32_t SDCARD_Init(void);
 bool SDCARD_InitDone(void);
@@ -44,18 +73,56 @@ int32_t SDCARD_ReadCardIdentification(uint8_t * buff, size_t buffLen);
 int32_t SDCARD_ReadCardSpecificData(uint8_t * buff, size_t buffLen);
 int32_t SDCARD_ReadSingleBlock(uint32_t blockNum, uint8_t * buff, size_t buffLen);
 int32_t SDCARD_WriteSingleBlock(uint32_t blockNum, const uint8_t * buff, size_t buffLen);
+// Single block and contiguous multi block calls lower the SPI clock and
+// retry on CRC errors or data token timeouts, not on a data error token. The streaming calls below only
+// return the error.
+// The driver is locked to one task while the card is selected. Calls from
+// other tasks wait for the current command or stream to end.
 
-// Read Multiple Blocks
+// Read Multiple Blocks (CMD18)
+// Chip select is held from Begin until End. End must be called even if
+// ReadData fails, to stop the transmission.
 int32_t SDCARD_ReadBegin(uint32_t blockNum);
 int32_t SDCARD_ReadData(uint8_t * buff); // sizeof(buff) == 512!
-int32_t SDCARD_ReadEnd();
+int32_t SDCARD_ReadEnd(void);
 
-// Write Multiple Blocks
-int32_t SDCARD_WriteBegin(uint32_t blockNum);
+// Write Multiple Blocks (CMD25)
+// Chip select is held from Begin until End. End must be called even if
+// WriteData fails, to send the stop transaction token.
+// count is the number of blocks about to be written, sent as ACMD23
+// pre-erase hint. 0 if unknown.
+int32_t SDCARD_WriteBegin(uint32_t blockNum, uint32_t count);
 int32_t SDCARD_WriteData(const uint8_t * buff); // sizeof(buff) == 512!
-int32_t SDCARD_WriteEnd();
+int32_t SDCARD_WriteEnd(void);
+
+// Async writes: return once the card accepted the data, without waiting
+// for it to finish programming. buff may be reused on return, cb may be NULL.
+int32_t SDCARD_WriteSingleBlockAsync(uint32_t blockNum, const uint8_t * buff,
+        size_t buffLen, SDCARD_WRITE_CB_T cb, void * ctx);
+int32_t SDCARD_WriteEndAsync(SDCARD_WRITE_CB_T cb, void * ctx);
+// Non-blocking check of a pending async write.
+// Returns SDCARD_ERR_BUSY while the card is still programming.
+int32_t SDCARD_PollBusy(void);
+// Block until a pending async write completes
+int32_t SDCARD_Sync(void);
+
+// Contiguous buffer helpers, sizeof(buff) == count * 512
+int32_t SDCARD_ReadMultiBlock(uint32_t blockNum, uint8_t * buff, uint32_t count);
+int32_t SDCARD_WriteMultiBlock(uint32_t blockNum, const uint8_t * buff, uint32_t count);
+
+// Erase blocks startLBA to endLBA inclusive (CMD32/CMD33/CMD38). Erased
+// blocks read back as all 0x00 or all 0xFF depending on the card.
+int32_t SDCARD_Erase(uint32_t startLBA, uint32_t endLBA);
 
 uint32_t SDCARD_GetBlockCount(void);
+// Current SPI clock, after any runtime step-down
+uint32_t SDCARD_GetClockHz(void);
+
+#if CONFIG_SDCARD_STATS
+// Per-command latency, measured with the DWT cycle counter
+const SDCARD_STATS_T * SDCARD_GetStats(void);
+void SDCARD_ResetStats(void);
+#endif /* CONFIG_SDCARD_STATS */
 
 // TODO: read lock flag? CMD13, SEND_STATUS
 
@@ -16,9 +16,12 @@
 #include "stdbool.h"
 #include "limits.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
 #include "sdcard.h"
+#include "sd_crc.h"
 #include "test_sdcard.h"
+#include "bsp/bsp_cycle.h"
 
 static bool bInit = false;
 static uint8_t blockData[SDCARD_BLOCK_SIZE];
@@ -37,7 +40,8 @@ static BaseType_t CmdSdCardInit(
         return 0;
     }
 
-    snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK, SPI clock %lu Hz\r\n\r\n",
+            SDCARD_GetClockHz());
     return 0;
 }
 
@@ -467,6 +471,445 @@ static const CLI_Command_Definition_t sdcard_write = {
     -1
 };
 
+#define SD_BENCH_CHUNK_BLOCKS   (8)
+
+static uint32_t SdBenchKBps(uint32_t count, TickType_t ticks)
+{
+    if(ticks == 0) {
+        ticks = 1;
+    }
+    return (uint32_t)(((uint64_t)count * SDCARD_BLOCK_SIZE * configTICK_RATE_HZ) / ((uint64_t)ticks * 1024));
+}
+
+static void SdBenchWriteDone(int32_t status, void * ctx)
+{
+    uint32_t * pCount = (uint32_t *)ctx;
+    if(status == SDCARD_ERR_NONE) {
+        (*pCount)++;
+    }
+}
+
+static BaseType_t CmdSdCardBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t internalState = 0;
+    static uint32_t blockNum = 0;
+    static uint32_t count = 0;
+    static uint8_t benchData[SD_BENCH_CHUNK_BLOCKS * SDCARD_BLOCK_SIZE];
+    int32_t i32Temp;
+    char * ptrStrParam;
+    char tmpStr[12];
+    BaseType_t strParamLen;
+    char * ptrEnd;
+    int32_t ret = SDCARD_ERR_NONE;
+    TickType_t tickStart;
+    TickType_t ticks;
+    uint32_t done;
+    uint32_t n;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(internalState == 0) {
+        /*
+         * Block Number
+         */
+        ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam == NULL) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 1 not found!\r\n\r\n");
+            return 0;
+        }
+        if(strParamLen > (sizeof(tmpStr) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 1 len exceeded buffer!\r\n\r\n");
+            return 0;
+        }
+        memcpy(tmpStr, ptrStrParam, strParamLen);
+        tmpStr[strParamLen] = '\0';
+        errno = 0;
+        i32Temp = strtol(tmpStr, &ptrEnd, 0);
+        if((ptrEnd == tmpStr) || (*ptrEnd != '\0') ||
+           (((i32Temp == LONG_MIN) || (i32Temp == LONG_MAX)) && (errno == ERANGE))) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        blockNum = (uint32_t)i32Temp;
+        /*
+         * Block Count
+         */
+        ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString, 2, &strParamLen);
+        if(ptrStrParam == NULL) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 2 not found!\r\n\r\n");
+            return 0;
+        }
+        if(strParamLen > (sizeof(tmpStr) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 2 len exceeded buffer!\r\n\r\n");
+            return 0;
+        }
+        memcpy(tmpStr, ptrStrParam, strParamLen);
+        tmpStr[strParamLen] = '\0';
+        errno = 0;
+        i32Temp = strtol(tmpStr, &ptrEnd, 0);
+        if((ptrEnd == tmpStr) || (*ptrEnd != '\0') || (i32Temp <= 0) ||
+           (((i32Temp == LONG_MIN) || (i32Temp == LONG_MAX)) && (errno == ERANGE))) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter 2 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        count = (uint32_t)i32Temp;
+        for(uint32_t i = 0; i < sizeof(benchData); i++) {
+            benchData[i] = (uint8_t)i;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tBlocks %lu..%lu\r\n", blockNum, blockNum + count - 1);
+        internalState++;
+        return 1;
+    } else if(internalState == 1) {
+        /* Single block write (CMD24) */
+        tickStart = xTaskGetTickCount();
+        for(done = 0; done < count; done++) {
+            ret = SDCARD_WriteSingleBlock(blockNum + done,
+                    &benchData[(done % SD_BENCH_CHUNK_BLOCKS) * SDCARD_BLOCK_SIZE],
+                    SDCARD_BLOCK_SIZE);
+            if(ret != SDCARD_ERR_NONE) {
+                break;
+            }
+        }
+        ticks = xTaskGetTickCount() - tickStart;
+        if(ret != SDCARD_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tSDCARD_WriteSingleBlock error %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCMD24 write: %lu ms, %lu KB/s\r\n", ticks * portTICK_PERIOD_MS,
+                SdBenchKBps(count, ticks));
+        internalState++;
+        return 1;
+    } else if(internalState == 2) {
+        /* Multiple block write (CMD25) */
+        tickStart = xTaskGetTickCount();
+        for(done = 0; done < count; done += n) {
+            n = count - done;
+            if(n > SD_BENCH_CHUNK_BLOCKS) {
+                n = SD_BENCH_CHUNK_BLOCKS;
+            }
+            ret = SDCARD_WriteMultiBlock(blockNum + done, benchData, n);
+            if(ret != SDCARD_ERR_NONE) {
+                break;
+            }
+        }
+        ticks = xTaskGetTickCount() - tickStart;
+        if(ret != SDCARD_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tSDCARD_WriteMultiBlock error %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCMD25 write: %lu ms, %lu KB/s\r\n", ticks * portTICK_PERIOD_MS,
+                SdBenchKBps(count, ticks));
+        internalState++;
+        return 1;
+    } else if(internalState == 3) {
+        /* Single block write (CMD24), busy resolved by the next write */
+        static uint32_t completed;
+        completed = 0;
+        tickStart = xTaskGetTickCount();
+        for(done = 0; done < count; done++) {
+            ret = SDCARD_WriteSingleBlockAsync(blockNum + done,
+                    &benchData[(done % SD_BENCH_CHUNK_BLOCKS) * SDCARD_BLOCK_SIZE],
+                    SDCARD_BLOCK_SIZE, SdBenchWriteDone, &completed);
+            if(ret != SDCARD_ERR_NONE) {
+                break;
+            }
+        }
+        if(ret == SDCARD_ERR_NONE) {
+            ret = SDCARD_Sync();
+        }
+        ticks = xTaskGetTickCount() - tickStart;
+        if(ret != SDCARD_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tSDCARD_WriteSingleBlockAsync error %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCMD24 async write: %lu ms, %lu KB/s, %lu completed\r\n",
+                ticks * portTICK_PERIOD_MS, SdBenchKBps(count, ticks), completed);
+        internalState++;
+        return 1;
+    } else if(internalState == 4) {
+        /* Single block read (CMD17) */
+        tickStart = xTaskGetTickCount();
+        for(done = 0; done < count; done++) {
+            ret = SDCARD_ReadSingleBlock(blockNum + done, blockData, sizeof(blockData));
+            if(ret != SDCARD_ERR_NONE) {
+                break;
+            }
+        }
+        ticks = xTaskGetTickCount() - tickStart;
+        if(ret != SDCARD_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tSDCARD_ReadSingleBlock error %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCMD17 read: %lu ms, %lu KB/s\r\n", ticks * portTICK_PERIOD_MS,
+                SdBenchKBps(count, ticks));
+        internalState++;
+        return 1;
+    } else if(internalState == 5) {
+        /* Multiple block read (CMD18) */
+        tickStart = xTaskGetTickCount();
+        for(done = 0; done < count; done += n) {
+            n = count - done;
+            if(n > SD_BENCH_CHUNK_BLOCKS) {
+                n = SD_BENCH_CHUNK_BLOCKS;
+            }
+            ret = SDCARD_ReadMultiBlock(blockNum + done, benchData, n);
+            if(ret != SDCARD_ERR_NONE) {
+                break;
+            }
+        }
+        ticks = xTaskGetTickCount() - tickStart;
+        if(ret != SDCARD_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tSDCARD_ReadMultiBlock error %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCMD18 read: %lu ms, %lu KB/s\r\n\r\n", ticks * portTICK_PERIOD_MS,
+                SdBenchKBps(count, ticks));
+        internalState = 0;
+    } else {
+        internalState = 0;
+    }
+    return 0;
+}
+
+static const CLI_Command_Definition_t sdcard_bench = {
+    "sd_bench",
+    "sd_bench <block address> <count>:\r\n"
+    "\tCompare single and multiple block throughput.\r\n"
+    "\tWARNING: overwrites <count> blocks starting at <block address>\r\n\r\n",
+    CmdSdCardBench,
+    2
+};
+
+static BaseType_t CmdSdCardErase(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    uint32_t lba[2];
+    int32_t i32Temp;
+    char * ptrStrParam;
+    char tmpStr[12];
+    BaseType_t strParamLen;
+    char * ptrEnd;
+    TickType_t ticks;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    for(uint32_t i = 0; i < 2; i++) {
+        ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString, i + 1, &strParamLen);
+        if(ptrStrParam == NULL) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter %lu not found!\r\n\r\n", i + 1);
+            return 0;
+        }
+        if(strParamLen > (sizeof(tmpStr) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter %lu len exceeded buffer!\r\n\r\n", i + 1);
+            return 0;
+        }
+        memcpy(tmpStr, ptrStrParam, strParamLen);
+        tmpStr[strParamLen] = '\0';
+        errno = 0;
+        i32Temp = strtol(tmpStr, &ptrEnd, 0);
+        if((ptrEnd == tmpStr) || (*ptrEnd != '\0') || (i32Temp < 0) ||
+           (((i32Temp == LONG_MIN) || (i32Temp == LONG_MAX)) && (errno == ERANGE))) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter %lu value is invalid!\r\n\r\n", i + 1);
+            return 0;
+        }
+        lba[i] = (uint32_t)i32Temp;
+    }
+
+    ticks = xTaskGetTickCount();
+    ret = SDCARD_Erase(lba[0], lba[1]);
+    ticks = xTaskGetTickCount() - ticks;
+    if(ret != SDCARD_ERR_NONE) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tSDCARD_Erase error %ld\r\n\r\n", ret);
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tOK, %lu blocks in %lu ms\r\n\r\n", lba[1] - lba[0] + 1,
+            ticks * portTICK_PERIOD_MS);
+    return 0;
+}
+
+static const CLI_Command_Definition_t sdcard_erase = {
+    "sd_erase",
+    "sd_erase <start block> <end block>:\r\n"
+    "\tErase blocks start to end inclusive (CMD32/CMD33/CMD38)\r\n\r\n",
+    CmdSdCardErase,
+    2
+};
+
+/*
+ * Known answers: CMD0/CMD8/CMD17 command CRC7 from the SD physical layer
+ * spec examples, CRC16 of an erased (all 0xFF) 512-byte block.
+ */
+static BaseType_t CmdSdCrcTest(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+    static const uint8_t cmd8[] = { 0x48, 0x00, 0x00, 0x01, 0xAA };
+    static const uint8_t cmd17[] = { 0x51, 0x00, 0x00, 0x00, 0x00 };
+    static uint8_t block[SDCARD_BLOCK_SIZE];
+    uint8_t crc7[3];
+    uint16_t crc16;
+    uint32_t cycles;
+    bool pass;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    crc7[0] = SD_CRC7(cmd0, sizeof(cmd0));
+    crc7[1] = SD_CRC7(cmd8, sizeof(cmd8));
+    crc7[2] = SD_CRC7(cmd17, sizeof(cmd17));
+    memset(block, 0xFF, sizeof(block));
+    cycles = BSP_CYCLE_get();
+    crc16 = SD_CRC16(block, sizeof(block));
+    cycles = BSP_CYCLE_get() - cycles;
+
+    pass = (crc7[0] == 0x4A) && (crc7[1] == 0x43) && (crc7[2] == 0x2A) &&
+           (crc16 == 0x7FA1);
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tCRC7 CMD0 %02x CMD8 %02x CMD17 %02x\r\n"
+            "\tCRC16 %04x (%lu cycles/block)\r\n"
+            "\t%s\r\n\r\n",
+            crc7[0], crc7[1], crc7[2], crc16, cycles,
+            pass ? "PASS" : "FAIL");
+    return 0;
+}
+
+static const CLI_Command_Definition_t sdcard_crc_test = {
+    "sd_crc_test",
+    "sd_crc_test:\r\n"
+    "\tCheck SD CRC7/CRC16 against known values\r\n\r\n",
+    CmdSdCrcTest,
+    0
+};
+
+#if CONFIG_SDCARD_STATS
+static const char * SdStatCmdName(uint32_t cmdIdx)
+{
+    switch(cmdIdx) {
+    case 0:  return "GO_IDLE_STATE";
+    case 8:  return "SEND_IF_COND";
+    case 9:  return "SEND_CSD";
+    case 10: return "SEND_CID";
+    case 12: return "STOP_TRANSMISSION";
+    case 17: return "READ_SINGLE_BLOCK";
+    case 18: return "READ_MULTIPLE_BLOCK";
+    case 23: return "SET_WR_BLK_ERASE_COUNT";
+    case 24: return "WRITE_BLOCK";
+    case 25: return "WRITE_MULTIPLE_BLOCK";
+    case 32: return "ERASE_WR_BLK_START_ADDR";
+    case 33: return "ERASE_WR_BLK_END_ADDR";
+    case 38: return "ERASE";
+    case 41: return "SD_SEND_OP_COND";
+    case 55: return "APP_CMD";
+    case 58: return "READ_OCR";
+    default: return "";
+    }
+}
+
+static BaseType_t CmdSdCardStats(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t internalState = 0;
+    static uint32_t cmdIdx = 0;
+    const SDCARD_STATS_T * pStats = SDCARD_GetStats();
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(internalState == 0) {
+        ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam != NULL) {
+            if((strParamLen == 5) && (strncmp(ptrStrParam, "reset", 5) == 0)) {
+                SDCARD_ResetStats();
+                snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+            } else {
+                snprintf(pcWriteBuffer, xWriteBufferLen,
+                        "\tError: Parameter 1 value is invalid!\r\n\r\n");
+            }
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tPoll transactions: %lu\r\n"
+                "\tCRC errors: %lu\r\n"
+                "\tClock step-downs: %lu (now %lu Hz)\r\n"
+                "\tCMD  count  R1 avg/max (us)  token avg/max (us)\r\n",
+                pStats->pollTransactions,
+                pStats->crcErrors,
+                pStats->clkStepDowns, SDCARD_GetClockHz());
+        cmdIdx = 0;
+        internalState++;
+        return 1;
+    } else if(internalState == 1) {
+        while(cmdIdx < SDCARD_CMD_COUNT) {
+            const SDCARD_CMD_STAT_T * pR1 = &pStats->r1[cmdIdx];
+            const SDCARD_CMD_STAT_T * pToken = &pStats->token[cmdIdx];
+            cmdIdx++;
+            if(pR1->count == 0) {
+                continue;
+            }
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\t%-4lu %-6lu %6lu/%-8lu %6lu/%-8lu %s\r\n",
+                    cmdIdx - 1,
+                    pR1->count,
+                    pR1->totalUs / pR1->count, pR1->maxUs,
+                    (pToken->count != 0) ? (pToken->totalUs / pToken->count) : 0,
+                    pToken->maxUs,
+                    SdStatCmdName(cmdIdx - 1));
+            return 1;
+        }
+        strcat(pcWriteBuffer, "\r\n");
+        internalState = 0;
+    } else {
+        internalState = 0;
+    }
+    return 0;
+}
+
+static const CLI_Command_Definition_t sdcard_stats = {
+    "sd_stats",
+    "sd_stats [reset]:\r\n"
+    "\tShow or reset SD command latency statistics\r\n\r\n",
+    CmdSdCardStats,
+    -1
+};
+#endif /* CONFIG_SDCARD_STATS */
+
 void TEST_SDCARD_Init(void)
 {
     if(bInit) {
@@ -478,6 +921,12 @@ void TEST_SDCARD_Init(void)
     FreeRTOS_CLIRegisterCommand(&sdcard_ocr);
     FreeRTOS_CLIRegisterCommand(&sdcard_read);
     FreeRTOS_CLIRegisterCommand(&sdcard_write);
+    FreeRTOS_CLIRegisterCommand(&sdcard_bench);
+    FreeRTOS_CLIRegisterCommand(&sdcard_erase);
+    FreeRTOS_CLIRegisterCommand(&sdcard_crc_test);
+#if CONFIG_SDCARD_STATS
+    FreeRTOS_CLIRegisterCommand(&sdcard_stats);
+#endif
     bInit = true;
 }
 
@@ -22,6 +22,15 @@
 #define SPI_MANAGER_DEFAULT_TIMEOUT     (100)
 #define SPI_MANAGER_TRANSFER_COMPLETE   (0x01UL)
 #define SPI_MANAGER_TRANSFER_ERROR      (0x02UL)
+/*
+ * DMA completion is signalled on its own notification index so that a bus
+ * owner's default notification (e.g. CAN Rx/Tx bits) is left untouched
+ */
+#define SPI_DMA_NOTIFY_INDEX            (1)
+
+#if (configTASK_NOTIFICATION_ARRAY_ENTRIES <= SPI_DMA_NOTIFY_INDEX)
+#error "SPI DMA needs configTASK_NOTIFICATION_ARRAY_ENTRIES >= 2"
+#endif
 
 static uint32_t const DEFAULT_SPI_BAUDRATEPRESCALER[N_BSP_SPI_CLK] = {
     LL_SPI_BAUDRATEPRESCALER_DIV2,
@@ -35,9 +44,9 @@ static uint32_t const DEFAULT_SPI_BAUDRATEPRESCALER[N_BSP_SPI_CLK] = {
 };
 
 typedef struct {
-    void * pTxBuf;
-    void * pRxBuf;
-    size_t len;
+    BSP_SPI_SEGMENT_T seg;              // single segment (BSP_SPI_transact)
+    const BSP_SPI_SEGMENT_T * pSeg;     // segment list, NULL to use seg
+    size_t nSeg;
     uint32_t br;
     SPI_MODE_T mode;
     SPI_ChipSelect cs;
@@ -54,6 +63,16 @@ static StaticSemaphore_t semStruct_SpiManager;          // <-- TODO: Use TaskNot
 static QueueHandle_t queueHandle_transact = NULL;
 static StaticQueue_t queueStruct_transact;
 static uint8_t queueStorage[SPI_TRANSACT_QUEUE_LEN * sizeof(SPI_TRANSACTION_T)];
+/* Fixed DMA source/target for transfers without a Tx or Rx buffer */
+static const uint8_t txDummy = 0xFF;
+static uint8_t rxDummy;
+/* Task blocked on the current DMA transfer, manager or bus owner */
+static volatile TaskHandle_t dmaWaitTask = NULL;
+#if CONFIG_SPI_BUS_OWNERSHIP
+static SemaphoreHandle_t mutexHandle_bus = NULL;
+static StaticSemaphore_t mutexStruct_bus;
+static TaskHandle_t busOwner = NULL;
+#endif
 
 void DMA1_Channel3_IRQHandler(void)
 {
@@ -76,40 +95,188 @@ void DMA1_Channel4_IRQHandler(void)
     if(LL_DMA_IsActiveFlag_TC4(DMA1)) {
         LL_DMA_ClearFlag_TC4(DMA1);
         LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_4);
-        xTaskNotifyFromISR(taskHandle_SpiManager, SPI_MANAGER_TRANSFER_COMPLETE, eSetBits, &taskWoken);
+        if(dmaWaitTask != NULL) {
+            xTaskNotifyIndexedFromISR(dmaWaitTask, SPI_DMA_NOTIFY_INDEX,
+                    SPI_MANAGER_TRANSFER_COMPLETE, eSetBits, &taskWoken);
+        }
     } else if(LL_DMA_IsActiveFlag_TE4(DMA1)) {
         LL_DMA_ClearFlag_TE4(DMA1);
         LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_4);
-        xTaskNotifyFromISR(taskHandle_SpiManager, SPI_MANAGER_TRANSFER_ERROR, eSetBits, &taskWoken);
+        if(dmaWaitTask != NULL) {
+            xTaskNotifyIndexedFromISR(dmaWaitTask, SPI_DMA_NOTIFY_INDEX,
+                    SPI_MANAGER_TRANSFER_ERROR, eSetBits, &taskWoken);
+        }
     }
     portYIELD_FROM_ISR(taskWoken);
 }
 
 
+static int32_t SPI_TransferSegment(const BSP_SPI_SEGMENT_T * pSeg)
+{
+    uint32_t notifyValue = 0;
+    uint32_t bits;
+    TimeOut_t timeOut;
+    TickType_t ticksLeft = SPI_MANAGER_DEFAULT_TIMEOUT;
+
+    /*
+     * Initialize DMA for this segment
+     */
+    // Tx DMA, 0xFF from a fixed byte when there is no Tx buffer
+    LL_DMA_ConfigTransfer(DMA1,
+            LL_DMA_CHANNEL_3,
+            LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_PRIORITY_HIGH |
+            LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+            ((pSeg->pTxBuf != NULL) ? LL_DMA_MEMORY_INCREMENT : LL_DMA_MEMORY_NOINCREMENT) |
+            LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE
+            );
+    LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_3,
+            (pSeg->pTxBuf != NULL) ? (uint32_t)(pSeg->pTxBuf) : (uint32_t)&txDummy,
+            LL_SPI_DMA_GetRegAddr(SPI1),
+            LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+    LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_3, pSeg->len);
+    LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_3, LL_DMAMUX_REQ_SPI1_TX);
+    // Rx DMA, still run without an Rx buffer to drain the Rx FIFO
+    // and signal completion once the last byte is clocked out
+    LL_DMA_ConfigTransfer(DMA1,
+            LL_DMA_CHANNEL_4,
+            LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_PRIORITY_HIGH |
+            LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+            ((pSeg->pRxBuf != NULL) ? LL_DMA_MEMORY_INCREMENT : LL_DMA_MEMORY_NOINCREMENT) |
+            LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE
+            );
+    LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_4,
+            LL_SPI_DMA_GetRegAddr(SPI1),
+            (pSeg->pRxBuf != NULL) ? (uint32_t)(pSeg->pRxBuf) : (uint32_t)&rxDummy,
+            LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_4, pSeg->len);
+    LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_4, LL_DMAMUX_REQ_SPI1_RX);
+    /*
+     * Clear previous notification, if any, e.g. a late completion from a
+     * transfer that timed out
+     */
+    dmaWaitTask = xTaskGetCurrentTaskHandle();
+    xTaskNotifyStateClearIndexed(NULL, SPI_DMA_NOTIFY_INDEX);
+    ulTaskNotifyValueClearIndexed(NULL, SPI_DMA_NOTIFY_INDEX, ULONG_MAX);
+    /*
+     * Start DMA
+     */
+    LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_3);
+    LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_4);
+    LL_DMA_EnableIT_TE(DMA1, LL_DMA_CHANNEL_3);
+    LL_DMA_EnableIT_TE(DMA1, LL_DMA_CHANNEL_4);
+    LL_SPI_SetRxFIFOThreshold(SPI1, LL_SPI_RX_FIFO_TH_QUARTER);
+    LL_SPI_EnableDMAReq_TX(SPI1);
+    LL_SPI_EnableDMAReq_RX(SPI1);
+    LL_SPI_Enable(SPI1);
+    LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_3);
+    LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_4);
+    /*
+     * Wait for DMA complete transfer or Error
+     */
+    vTaskSetTimeOutState(&timeOut);
+    while((notifyValue & (SPI_MANAGER_TRANSFER_COMPLETE | SPI_MANAGER_TRANSFER_ERROR)) == 0) {
+        if((pdTRUE == xTaskCheckForTimeOut(&timeOut, &ticksLeft)) ||
+           (pdFALSE == xTaskNotifyWaitIndexed(SPI_DMA_NOTIFY_INDEX, 0, ULONG_MAX, &bits, ticksLeft))) {
+            /* Timed out */
+            LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_3);
+            LL_DMA_DisableChannel(DMA1, LL_DMA_CHANNEL_4);
+            dmaWaitTask = NULL;
+            return SPI_ERR_TIMEOUT;
+        }
+        notifyValue |= bits;
+    }
+    dmaWaitTask = NULL;
+    if((notifyValue & SPI_MANAGER_TRANSFER_ERROR) != 0) {
+        /* DMA Error */
+        return SPI_ERR_DMA_TRANSFER_ERROR;
+    }
+    return SPI_ERR_NONE;
+}
+
+
+static bool SPI_IsValidSegment(const BSP_SPI_SEGMENT_T * pSeg)
+{
+    return (pSeg->len != 0) && ((pSeg->pTxBuf != NULL) || (pSeg->pRxBuf != NULL));
+}
+
+
+static void SPI_Configure(uint32_t br, SPI_MODE_T mode)
+{
+//    LL_SPI_Disable(SPI1);
+    /*
+     * Update SPI clock
+     */
+    LL_SPI_SetBaudRatePrescaler(SPI1, DEFAULT_SPI_BAUDRATEPRESCALER[br]);
+    /*
+     * Update transaction Mode
+     */
+    switch(mode) {
+        case SPI_MODE0: {
+            LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
+            LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
+            break;
+        }
+        case SPI_MODE1: {
+            LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
+            LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_2EDGE);
+            break;
+        }
+        case SPI_MODE2: {
+            LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_HIGH);
+            LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
+            break;
+        }
+        case SPI_MODE3: {
+            LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_HIGH);
+            LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_2EDGE);
+            break;
+        }
+        default: {
+            /* Default to SPI_MODE0 */
+            LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
+            LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
+            break;
+        }
+    }
+    LL_SPI_Enable(SPI1);
+}
+
+
 static void SPI_ManagerTask(void * pvParam)
 {
     SPI_TRANSACTION_T entry;
-    uint32_t notifyValue;
+    const BSP_SPI_SEGMENT_T * pSeg;
+    size_t nSeg;
+    int32_t status;
 
     while(bInit != true) {
         vTaskDelay(1);
     }
 
-    /* Configure Interrupt Priority */
-    NVIC_SetPriority(DMA1_Channel3_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
-    NVIC_SetPriority(DMA1_Channel4_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
-    /* Enable Interrupt */
-    NVIC_EnableIRQ(DMA1_Channel3_IRQn);;
-    NVIC_EnableIRQ(DMA1_Channel4_IRQn);;
-
     while(1) {
         if(pdTRUE == xQueueReceive(queueHandle_transact, &entry, portMAX_DELAY)) {
+            if(entry.pSeg != NULL) {
+                pSeg = entry.pSeg;
+                nSeg = entry.nSeg;
+            } else {
+                pSeg = &entry.seg;
+                nSeg = 1;
+            }
             /* Check validity */
-            if((entry.len == 0) || (entry.pTxBuf == NULL) ||
-               (entry.pRxBuf == NULL) || (entry.br >= N_BSP_SPI_CLK)) {
+            status = SPI_ERR_NONE;
+            if((nSeg == 0) || (nSeg > BSP_SPI_MAX_SEGMENTS) ||
+               (entry.br >= N_BSP_SPI_CLK)) {
+                status = SPI_ERR_INVALID_ARG;
+            }
+            for(size_t i = 0; (status == SPI_ERR_NONE) && (i < nSeg); i++) {
+                if(!SPI_IsValidSegment(&pSeg[i])) {
+                    status = SPI_ERR_INVALID_ARG;
+                }
+            }
+            if(status != SPI_ERR_NONE) {
                 /* Invalid */
                 if(entry.pStatus != NULL) {
-                    *(entry.pStatus) = SPI_ERR_INVALID_ARG;
+                    *(entry.pStatus) = status;
                 }
                 if(entry.semRequestor != NULL) {
                     xSemaphoreGive(entry.semRequestor);
@@ -117,82 +284,15 @@ static void SPI_ManagerTask(void * pvParam)
                 continue;
             }
 
-//            LL_SPI_Disable(SPI1);
-            /*
-             * Update SPI clock
-             */
-            LL_SPI_SetBaudRatePrescaler(SPI1, DEFAULT_SPI_BAUDRATEPRESCALER[entry.br]);
-            /*
-             * Update transaction Mode
-             */
-            switch(entry.mode) {
-                case SPI_MODE0: {
-                    LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
-                    LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
-                    break;
-                }
-                case SPI_MODE1: {
-                    LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
-                    LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_2EDGE);
-                    break;
-                }
-                case SPI_MODE2: {
-                    LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_HIGH);
-                    LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
-                    break;
-                }
-                case SPI_MODE3: {
-                    LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_HIGH);
-                    LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_2EDGE);
-                    break;
-                }
-                default: {
-                    /* Default to SPI_MODE0 */
-                    LL_SPI_SetClockPolarity(SPI1, LL_SPI_POLARITY_LOW);
-                    LL_SPI_SetClockPhase(SPI1, LL_SPI_PHASE_1EDGE);
-                    break;
-                }
-            }
-            LL_SPI_Enable(SPI1);
+#if CONFIG_SPI_BUS_OWNERSHIP
+            /* Wait for the bus owner, if any, to release it */
+            xSemaphoreTake(mutexHandle_bus, portMAX_DELAY);
+#endif
+            SPI_Configure(entry.br, entry.mode);
             /*
              * Updated transaction data width
              */
             /// Data Width is fixed for now at 8 bits.
-            /*
-             * Initialize DMA for this transaction
-             */
-            // Tx DMA
-            LL_DMA_ConfigTransfer(DMA1,
-                    LL_DMA_CHANNEL_3,
-                    LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_PRIORITY_HIGH |
-                    LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
-                    LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE |
-                    LL_DMA_MDATAALIGN_BYTE
-                    );
-            LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_3,
-                    (uint32_t)(entry.pTxBuf),
-                    LL_SPI_DMA_GetRegAddr(SPI1),
-                    LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
-            LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_3, entry.len);
-            LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_3, LL_DMAMUX_REQ_SPI1_TX);
-            // Rx DMA
-            LL_DMA_ConfigTransfer(DMA1,
-                    LL_DMA_CHANNEL_4,
-                    LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_PRIORITY_HIGH |
-                    LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
-                    LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE |
-                    LL_DMA_MDATAALIGN_BYTE
-                    );
-            LL_DMA_ConfigAddresses(DMA1, LL_DMA_CHANNEL_4,
-                    LL_SPI_DMA_GetRegAddr(SPI1),
-                    (uint32_t)(entry.pRxBuf),
-                    LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
-            LL_DMA_SetDataLength(DMA1, LL_DMA_CHANNEL_4, entry.len);
-            LL_DMA_SetPeriphRequest(DMA1, LL_DMA_CHANNEL_4, LL_DMAMUX_REQ_SPI1_RX);
-            /*
-             * Clear previous notification, if any
-             */
-            xTaskNotifyStateClear(NULL);
 
             /*
              * Chip Select
@@ -201,33 +301,13 @@ static void SPI_ManagerTask(void * pvParam)
                 entry.cs(true);
             }
             /*
-             * Start DMA
+             * Segments run back-to-back, stop at the first failure
              */
-            LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_3);
-            LL_DMA_EnableIT_TC(DMA1, LL_DMA_CHANNEL_4);
-            LL_DMA_EnableIT_TE(DMA1, LL_DMA_CHANNEL_3);
-            LL_DMA_EnableIT_TE(DMA1, LL_DMA_CHANNEL_4);
-            LL_SPI_SetRxFIFOThreshold(SPI1, LL_SPI_RX_FIFO_TH_QUARTER);
-            LL_SPI_EnableDMAReq_TX(SPI1);
-            LL_SPI_EnableDMAReq_RX(SPI1);
-            LL_SPI_Enable(SPI1);
-            LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_3);
-            LL_DMA_EnableChannel(DMA1, LL_DMA_CHANNEL_4);
-            /*
-             * Wait for DMA complete transfer or Error
-             */
-            if(pdFALSE == xTaskNotifyWait(0, ULONG_MAX, &notifyValue, SPI_MANAGER_DEFAULT_TIMEOUT)) {
-                /* Timed out */
-                if(entry.pStatus != NULL) {
-                    *(entry.pStatus) = SPI_ERR_TIMEOUT;
-                }
-                if(entry.semRequestor != NULL) {
-                    xSemaphoreGive(entry.semRequestor);
-                }
-                if(entry.cs != NULL) {
-                    entry.cs(false);
+            for(size_t i = 0; i < nSeg; i++) {
+                status = SPI_TransferSegment(&pSeg[i]);
+                if(status != SPI_ERR_NONE) {
+                    break;
                 }
-                continue;
             }
             /*
              * Chip De-Select
@@ -235,27 +315,17 @@ static void SPI_ManagerTask(void * pvParam)
             if(entry.cs != NULL) {
                 entry.cs(false);
             }
+#if CONFIG_SPI_BUS_OWNERSHIP
+            xSemaphoreGive(mutexHandle_bus);
+#endif
             /*
              * Post to requester
              */
-            if((notifyValue & SPI_MANAGER_TRANSFER_COMPLETE) != 0) {
-                /* Success */
-                if(entry.pStatus != NULL) {
-                    *(entry.pStatus) = SPI_ERR_NONE;
-                }
-                if(entry.semRequestor != NULL) {
-                    xSemaphoreGive(entry.semRequestor);
-                }
+            if(entry.pStatus != NULL) {
+                *(entry.pStatus) = status;
             }
-
-            if((notifyValue & SPI_MANAGER_TRANSFER_ERROR) != 0) {
-                /* DMA Error */
-                if(entry.pStatus != NULL) {
-                    *(entry.pStatus) = SPI_ERR_DMA_TRANSFER_ERROR;
-                }
-                if(entry.semRequestor != NULL) {
-                    xSemaphoreGive(entry.semRequestor);
-                }
+            if(entry.semRequestor != NULL) {
+                xSemaphoreGive(entry.semRequestor);
             }
         }
     }
@@ -319,6 +389,14 @@ void BSP_SPI_init(void)
     SPI_InitStruct.CRCPoly = 7;
     configASSERT(SUCCESS == LL_SPI_Init(SPI1, &SPI_InitStruct));
     LL_SPI_SetStandard(SPI1, LL_SPI_PROTOCOL_MOTOROLA);
+    /*
+     * DMA Interrupt, enabled here since a bus owner may start a transfer
+     * before the manager task first runs
+     */
+    NVIC_SetPriority(DMA1_Channel3_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_SetPriority(DMA1_Channel4_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel4_IRQn);
     /*
      * SPI Manager Task
      */
@@ -335,6 +413,13 @@ void BSP_SPI_init(void)
      */
     semHandle_SpiManager = xSemaphoreCreateBinaryStatic(&semStruct_SpiManager);
     configASSERT(semHandle_SpiManager != NULL);
+#if CONFIG_SPI_BUS_OWNERSHIP
+    /*
+     * Bus Ownership Mutex
+     */
+    mutexHandle_bus = xSemaphoreCreateMutexStatic(&mutexStruct_bus);
+    configASSERT(mutexHandle_bus != NULL);
+#endif
     /*
      * Transaction Request Queue
      */
@@ -351,7 +436,34 @@ void BSP_SPI_init(void)
     bInit = true;
 }
 
-int32_t BSP_SPI_transact(void * pTxBuf,
+uint32_t BSP_SPI_getClockHz(BSP_SPI_CLK_T clk)
+{
+    if(clk >= N_BSP_SPI_CLK) {
+        return 0;
+    }
+    return (CONFIG_APB2_PERIPH_FREQ >> ((uint32_t)clk + 1));
+}
+
+static int32_t SPI_Enqueue(const SPI_TRANSACTION_T * pEntry)
+{
+    bool bInsideISR = (pdTRUE == xPortIsInsideInterrupt());
+
+    if(bInsideISR) {
+        BaseType_t taskWoken = pdFALSE;
+        if(pdPASS == xQueueSendFromISR(queueHandle_transact, pEntry, &taskWoken)) {
+            portYIELD_FROM_ISR(taskWoken);
+        } else {
+            return SPI_ERR_Q_FULL;
+        }
+    } else {
+        if(pdPASS != xQueueSend(queueHandle_transact, pEntry, 0)) {
+            return SPI_ERR_Q_FULL;
+        }
+    }
+    return SPI_ERR_NONE;
+}
+
+int32_t BSP_SPI_transact(const void * pTxBuf,
                       void * pRxBuf,
                       size_t length,
                       SPI_MODE_T mode,
@@ -361,31 +473,131 @@ int32_t BSP_SPI_transact(void * pTxBuf,
                       int32_t * pStatus)
 {
     SPI_TRANSACTION_T entry = {0};
-    bool bInsideISR = (pdTRUE == xPortIsInsideInterrupt());
 
-    if((pTxBuf == NULL) || (pRxBuf == NULL) ||
+    if(((pTxBuf == NULL) && (pRxBuf == NULL)) ||
        (length == 0) || (clk >= N_BSP_SPI_CLK)) {
         return SPI_ERR_INVALID_ARG;
     }
-    entry.pTxBuf = pTxBuf;
-    entry.pRxBuf = pRxBuf;
-    entry.len = length;
+    entry.seg.pTxBuf = pTxBuf;
+    entry.seg.pRxBuf = pRxBuf;
+    entry.seg.len = length;
+    entry.pSeg = NULL;
+    entry.nSeg = 1;
     entry.mode = mode;
     entry.cs = cs;
     entry.br = (uint32_t)clk;
     entry.semRequestor = semRequester;
     entry.pStatus = pStatus;
-    if(bInsideISR) {
-        BaseType_t taskWoken = pdFALSE;
-        if(pdPASS == xQueueSendFromISR(queueHandle_transact, &entry, &taskWoken)) {
-            portYIELD_FROM_ISR(taskWoken);
-        } else {
-            return SPI_ERR_Q_FULL;
+    return SPI_Enqueue(&entry);
+}
+
+int32_t BSP_SPI_transactSeg(const BSP_SPI_SEGMENT_T * pSeg,
+                      size_t nSeg,
+                      SPI_MODE_T mode,
+                      SPI_ChipSelect cs,
+                      BSP_SPI_CLK_T clk,
+                      SemaphoreHandle_t semRequester,
+                      int32_t * pStatus)
+{
+    SPI_TRANSACTION_T entry = {0};
+
+    if((pSeg == NULL) || (nSeg == 0) || (nSeg > BSP_SPI_MAX_SEGMENTS) ||
+       (clk >= N_BSP_SPI_CLK)) {
+        return SPI_ERR_INVALID_ARG;
+    }
+    for(size_t i = 0; i < nSeg; i++) {
+        if(!SPI_IsValidSegment(&pSeg[i])) {
+            return SPI_ERR_INVALID_ARG;
         }
-    } else {
-        if(pdPASS != xQueueSend(queueHandle_transact, &entry, 0)) {
-            return SPI_ERR_Q_FULL;
+    }
+    entry.pSeg = pSeg;
+    entry.nSeg = nSeg;
+    entry.mode = mode;
+    entry.cs = cs;
+    entry.br = (uint32_t)clk;
+    entry.semRequestor = semRequester;
+    entry.pStatus = pStatus;
+    return SPI_Enqueue(&entry);
+}
+
+#if CONFIG_SPI_BUS_OWNERSHIP
+int32_t BSP_SPI_acquire(SPI_MODE_T mode, BSP_SPI_CLK_T clk, TickType_t timeout)
+{
+    TaskHandle_t self;
+
+    if((bInit != true) || (pdTRUE == xPortIsInsideInterrupt())) {
+        return SPI_ERR_INVALID_STATE;
+    }
+    if((mode >= N_SPI_MODE) || (clk >= N_BSP_SPI_CLK)) {
+        return SPI_ERR_INVALID_ARG;
+    }
+    self = xTaskGetCurrentTaskHandle();
+    if(busOwner == self) {
+        /* Not recursive */
+        return SPI_ERR_INVALID_STATE;
+    }
+    if(pdTRUE != xSemaphoreTake(mutexHandle_bus, timeout)) {
+        return SPI_ERR_TIMEOUT;
+    }
+    busOwner = self;
+    SPI_Configure((uint32_t)clk, mode);
+    return SPI_ERR_NONE;
+}
+
+int32_t BSP_SPI_setClock(BSP_SPI_CLK_T clk)
+{
+    if(busOwner != xTaskGetCurrentTaskHandle()) {
+        return SPI_ERR_INVALID_STATE;
+    }
+    if(clk >= N_BSP_SPI_CLK) {
+        return SPI_ERR_INVALID_ARG;
+    }
+    LL_SPI_SetBaudRatePrescaler(SPI1, DEFAULT_SPI_BAUDRATEPRESCALER[clk]);
+    return SPI_ERR_NONE;
+}
+
+int32_t BSP_SPI_transferSeg(const BSP_SPI_SEGMENT_T * pSeg, size_t nSeg)
+{
+    int32_t status = SPI_ERR_NONE;
+
+    if(busOwner != xTaskGetCurrentTaskHandle()) {
+        return SPI_ERR_INVALID_STATE;
+    }
+    if((pSeg == NULL) || (nSeg == 0) || (nSeg > BSP_SPI_MAX_SEGMENTS)) {
+        return SPI_ERR_INVALID_ARG;
+    }
+    for(size_t i = 0; i < nSeg; i++) {
+        if(!SPI_IsValidSegment(&pSeg[i])) {
+            return SPI_ERR_INVALID_ARG;
+        }
+    }
+    for(size_t i = 0; i < nSeg; i++) {
+        status = SPI_TransferSegment(&pSeg[i]);
+        if(status != SPI_ERR_NONE) {
+            break;
         }
     }
+    return status;
+}
+
+int32_t BSP_SPI_transfer(const void * pTxBuf, void * pRxBuf, size_t length)
+{
+    const BSP_SPI_SEGMENT_T seg = { pTxBuf, pRxBuf, length };
+    return BSP_SPI_transferSeg(&seg, 1);
+}
+
+int32_t BSP_SPI_release(void)
+{
+    if(busOwner != xTaskGetCurrentTaskHandle()) {
+        return SPI_ERR_INVALID_STATE;
+    }
+    busOwner = NULL;
+    xSemaphoreGive(mutexHandle_bus);
     return SPI_ERR_NONE;
 }
+
+bool BSP_SPI_isOwner(void)
+{
+    return (busOwner != NULL) && (busOwner == xTaskGetCurrentTaskHandle());
+}
+#endif /* CONFIG_SPI_BUS_OWNERSHIP */
@@ -12,7 +12,34 @@
 #include "stdbool.h"
 #include "semphr.h"
 
-#if (CONFIG_APB2_PERIPH_FREQ == 40000000)
+/*
+ * SPI1 runs from APB2, BSP_SPI_CLK_T index n is APB2 / 2^(n+1)
+ */
+#if (CONFIG_APB2_PERIPH_FREQ == 160000000)
+typedef enum {
+    BSP_SPI_CLK_80MHZ = 0,
+    BSP_SPI_CLK_40MHZ,
+    BSP_SPI_CLK_20MHZ,
+    BSP_SPI_CLK_10MHZ,
+    BSP_SPI_CLK_5MHZ,
+    BSP_SPI_CLK_2500KHZ,
+    BSP_SPI_CLK_1250KHZ,
+    BSP_SPI_CLK_625KHZ,
+    N_BSP_SPI_CLK
+} BSP_SPI_CLK_T;
+#elif (CONFIG_APB2_PERIPH_FREQ == 80000000)
+typedef enum {
+    BSP_SPI_CLK_40MHZ = 0,
+    BSP_SPI_CLK_20MHZ,
+    BSP_SPI_CLK_10MHZ,
+    BSP_SPI_CLK_5MHZ,
+    BSP_SPI_CLK_2500KHZ,
+    BSP_SPI_CLK_1250KHZ,
+    BSP_SPI_CLK_625KHZ,
+    BSP_SPI_CLK_312KHZ,
+    N_BSP_SPI_CLK
+} BSP_SPI_CLK_T;
+#elif (CONFIG_APB2_PERIPH_FREQ == 40000000)
 typedef enum {
     BSP_SPI_CLK_20MHZ = 0,
     BSP_SPI_CLK_10MHZ,
@@ -25,7 +52,7 @@ typedef enum {
     N_BSP_SPI_CLK
 } BSP_SPI_CLK_T;
 #else
-#error "APB2 must be 40MHz!"
+#error "APB2 must be 40MHz, 80MHz or 160MHz!"
 #endif
 
 #define SPI_ERR_NONE                    (0)
@@ -36,8 +63,20 @@ typedef enum {
 #define SPI_ERR_DMA_TRANSFER_ERROR      (-5)
 #define SPI_ERR_LASTENTRY               (-6)
 
+#define BSP_SPI_MAX_SEGMENTS            (8)
+
 typedef void (* SPI_ChipSelect)(bool bSelect);
 
+/*
+ * One leg of a scatter/gather transaction. pTxBuf/pRxBuf may be NULL with
+ * the same meaning as in BSP_SPI_transact(), but not both.
+ */
+typedef struct {
+    const void * pTxBuf;
+    void * pRxBuf;
+    size_t len;
+} BSP_SPI_SEGMENT_T;
+
 typedef enum {
     SPI_MODE0 = 0,
     SPI_MODE1,
@@ -48,7 +87,12 @@ typedef enum {
 
 
 void BSP_SPI_init(void);
-int32_t BSP_SPI_transact(void * pTxBuf,
+uint32_t BSP_SPI_getClockHz(BSP_SPI_CLK_T clk);
+/*
+ * pTxBuf == NULL: transmit 0xFF (receive only)
+ * pRxBuf == NULL: discard received bytes (transmit only)
+ */
+int32_t BSP_SPI_transact(const void * pTxBuf,
                       void * pRxBuf,
                       size_t length,
                       SPI_MODE_T mode,
@@ -56,6 +100,35 @@ int32_t BSP_SPI_transact(void * pTxBuf,
                       BSP_SPI_CLK_T clk,
                       SemaphoreHandle_t semRequester,
                       int32_t * pStatus);
+/*
+ * Runs nSeg segments back-to-back under one chip select and gives
+ * semRequester once. pSeg and the buffers must stay valid until then.
+ */
+int32_t BSP_SPI_transactSeg(const BSP_SPI_SEGMENT_T * pSeg,
+                      size_t nSeg,
+                      SPI_MODE_T mode,
+                      SPI_ChipSelect cs,
+                      BSP_SPI_CLK_T clk,
+                      SemaphoreHandle_t semRequester,
+                      int32_t * pStatus);
+
+#if CONFIG_SPI_BUS_OWNERSHIP
+/*
+ * Bus ownership: the owner task runs DMA transfers from its own context
+ * instead of going through the manager queue. Queued transactions wait
+ * until the owner releases the bus. The owner must not call
+ * BSP_SPI_transact()/BSP_SPI_transactSeg() while holding the bus. DMA
+ * completion is waited on with task notification index 1, the owner's
+ * default notification (index 0) is not touched.
+ * Chip select is left to the owner.
+ */
+int32_t BSP_SPI_acquire(SPI_MODE_T mode, BSP_SPI_CLK_T clk, TickType_t timeout);
+int32_t BSP_SPI_setClock(BSP_SPI_CLK_T clk);
+int32_t BSP_SPI_transfer(const void * pTxBuf, void * pRxBuf, size_t length);
+int32_t BSP_SPI_transferSeg(const BSP_SPI_SEGMENT_T * pSeg, size_t nSeg);
+int32_t BSP_SPI_release(void);
+bool BSP_SPI_isOwner(void);
+#endif
 
 
 #endif /* BSP_BSP_SPI_H_ */
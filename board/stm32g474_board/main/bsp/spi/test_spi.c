@@ -11,12 +11,15 @@
 #include "stdlib.h"
 #include "limits.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 #include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
 #include "test_spi.h"
 #include "bsp_spi.h"
+#include "bsp/bsp_cycle.h"
 
 #define TEST_SPI_BUFSZ      (64)
+#define TEST_SPI_BENCH_MAX  (10000)
 
 static bool bInit = false;
 static uint8_t spiBuffer[TEST_SPI_BUFSZ] = {0};
@@ -143,6 +146,148 @@ static const CLI_Command_Definition_t spi_transact = {
     -1
 };
 
+static int32_t SpiBenchGetParam(const char *pcCommandString, UBaseType_t idx,
+                                int32_t * pValue)
+{
+    char * ptrStrParam;
+    char tmpStr[12];
+    BaseType_t strParamLen;
+    char * ptrEnd;
+
+    ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString,
+                                idx, &strParamLen);
+    if((ptrStrParam == NULL) || (strParamLen > (sizeof(tmpStr) - 1))) {
+        return -1;
+    }
+    memcpy(tmpStr, ptrStrParam, strParamLen);
+    tmpStr[strParamLen] = '\0';
+    errno = 0;
+    *pValue = strtol(tmpStr, &ptrEnd, 0);
+    if((ptrEnd == tmpStr) || (*ptrEnd != '\0') ||
+       (((*pValue == LONG_MIN) || (*pValue == LONG_MAX)) && (errno == ERANGE))) {
+        return -1;
+    }
+    return 0;
+}
+
+static BaseType_t CmdSpiBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t internalState = 0;
+    static int32_t count = 0;
+    static int32_t len = 0;
+    TickType_t ticks;
+    uint32_t cycles;
+    int32_t i;
+    int32_t ret = SPI_ERR_NONE;
+    int32_t status;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(internalState == 0) {
+        if((0 != SpiBenchGetParam(pcCommandString, 1, &count)) ||
+           (count <= 0) || (count > TEST_SPI_BENCH_MAX)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Invalid count!\r\n\r\n");
+            return 0;
+        }
+        if((0 != SpiBenchGetParam(pcCommandString, 2, &len)) ||
+           (len <= 0) || (len > TEST_SPI_BUFSZ)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Invalid length!\r\n\r\n");
+            return 0;
+        }
+        memset(spiBuffer, 0xFF, sizeof(spiBuffer));
+        /*
+         * Queued through the SPI manager task
+         */
+        ticks = xTaskGetTickCount();
+        cycles = BSP_CYCLE_get();
+        for(i = 0; i < count; i++) {
+            while(pdTRUE == xSemaphoreTake(semHandle, 0));
+            ret = BSP_SPI_transact(spiBuffer, spiBuffer, len, SPI_MODE0, NULL,
+                        BSP_SPI_CLK_20MHZ, semHandle, &status);
+            if(ret != SPI_ERR_NONE) {
+                break;
+            }
+            if(pdTRUE != xSemaphoreTake(semHandle, 100)) {
+                ret = SPI_ERR_TIMEOUT;
+                break;
+            }
+            if(status != SPI_ERR_NONE) {
+                ret = status;
+                break;
+            }
+        }
+        cycles = BSP_CYCLE_get() - cycles;
+        ticks = xTaskGetTickCount() - ticks;
+        if(ret != SPI_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tQueued failed at %ld, err %ld\r\n\r\n", i, ret);
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tQueued: %ld x %ld bytes in %lu ms, %lu us/transaction\r\n",
+                count, len, (uint32_t)(ticks * portTICK_PERIOD_MS),
+                BSP_CYCLE_to_us(cycles) / (uint32_t)count);
+        internalState++;
+        return 1;
+    } else if(internalState == 1) {
+#if CONFIG_SPI_BUS_OWNERSHIP
+        /*
+         * Direct transfers while owning the bus
+         */
+        ret = BSP_SPI_acquire(SPI_MODE0, BSP_SPI_CLK_20MHZ, 100);
+        if(ret != SPI_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tAcquire failed %ld\r\n\r\n", ret);
+            internalState = 0;
+            return 0;
+        }
+        ticks = xTaskGetTickCount();
+        cycles = BSP_CYCLE_get();
+        for(i = 0; i < count; i++) {
+            ret = BSP_SPI_transfer(spiBuffer, spiBuffer, len);
+            if(ret != SPI_ERR_NONE) {
+                break;
+            }
+        }
+        cycles = BSP_CYCLE_get() - cycles;
+        ticks = xTaskGetTickCount() - ticks;
+        BSP_SPI_release();
+        if(ret != SPI_ERR_NONE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tOwned failed at %ld, err %ld\r\n\r\n", i, ret);
+            internalState = 0;
+            return 0;
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tOwned:  %ld x %ld bytes in %lu ms, %lu us/transaction\r\n",
+                count, len, (uint32_t)(ticks * portTICK_PERIOD_MS),
+                BSP_CYCLE_to_us(cycles) / (uint32_t)count);
+#else
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tOwned:  bus ownership disabled\r\n");
+#endif
+        internalState++;
+        return 1;
+    } else {
+        internalState = 0;
+        snprintf(pcWriteBuffer, xWriteBufferLen, "\r\n");
+        return 0;
+    }
+}
+
+static const CLI_Command_Definition_t spi_bench = {
+    "spi_bench",
+    "spi_bench <count> <len>:\r\n"
+    "\tCompare queued and bus-owner transfer latency (no chip select)\r\n\r\n",
+    CmdSpiBench,
+    2
+};
+
 void TEST_SPI_init(void)
 {
     if(bInit != true) {
@@ -152,6 +297,7 @@ void TEST_SPI_init(void)
         configASSERT(NULL != semHandle);
 
         FreeRTOS_CLIRegisterCommand(&spi_transact);
+        FreeRTOS_CLIRegisterCommand(&spi_bench);
 
         bInit = true;
     }
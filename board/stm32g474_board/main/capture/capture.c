@@ -0,0 +1,597 @@
+/*
+ * capture.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_CAPTURE
+
+#include "string.h"
+#include "stdio.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stm32g4xx.h"
+#include "capture.h"
+#include "test_capture.h"
+#include "bsp/bsp_cycle.h"
+#include "filesystem/lfs_writer.h"
+#include "filesystem/rawlog.h"
+
+#define CAPTURE_BATCH_SIZE          (CONFIG_CAPTURE_BATCH_SIZE)
+#define CAPTURE_EPOCH_MS            (3600000UL)     // offsets stay below 2^32 us
+#define CAPTURE_FPS_WINDOW_MS       (1000)
+#define CAPTURE_START_RECORD_SIZE   (CAPTURE_HDR_SIZE + 4 + 1)
+/* Worst case added by one frame, a start record may come before it */
+#define CAPTURE_FRAME_ROOM          (CAPTURE_START_RECORD_SIZE + CAPTURE_RECORD_MAX)
+#if CONFIG_USE_RAWLOG
+#define CAPTURE_WRITER_TASK_STACK_SIZE  (512)
+#define CAPTURE_WRITER_TASK_PRIORITY    (CONFIG_CAPTURE_WRITER_TASK_PRIORITY)
+#define CAPTURE_RAWLOG_BUF_COUNT        (CONFIG_CAPTURE_RAWLOG_BUF_COUNT)
+#endif
+
+#if CAPTURE_BATCH_SIZE < CAPTURE_FRAME_ROOM
+#error "Capture batch must hold at least one record"
+#endif
+
+/*
+ * While bActive the session state (batch, fill, seq, clocks, stream) is
+ * owned by the bus task. CAPTURE_stop() only posts stopReq, the bus task
+ * hands in its last batch, clears bActive and gives semStopped.
+ */
+typedef struct {
+    volatile bool bActive;
+    volatile bool stopReq;
+    SemaphoreHandle_t semStopped;
+    StaticSemaphore_t semStoppedStruct;
+    SemaphoreHandle_t mutex;    // stats
+    StaticSemaphore_t mutexStruct;
+    int32_t stream;             // CAPTURE_SINK_LFS
+    uint32_t seq;
+    /* DWT cycles extended to 64 bits, counted from the session start */
+    uint32_t lastCycles;
+    uint64_t cycles;
+    uint64_t epochCycles;
+    uint32_t epochTick;
+    TickType_t windowStart;
+    uint32_t windowFrames;
+    uint32_t fill;
+    uint8_t batch[CAPTURE_BATCH_SIZE];
+#if CONFIG_USE_RAWLOG
+    /*
+     * CAPTURE_SINK_RAWLOG, single producer single consumer ring as in
+     * lfs_writer. The bus task publishes batches by incrementing rawHead,
+     * the writer task appends them and releases them by incrementing rawTail.
+     */
+    uint8_t rawBuf[CAPTURE_RAWLOG_BUF_COUNT][CAPTURE_BATCH_SIZE];
+    uint32_t rawLen[CAPTURE_RAWLOG_BUF_COUNT];
+    volatile uint32_t rawHead;  // bus task only
+    volatile uint32_t rawTail;  // writer task only
+#endif
+    CAPTURE_STATS_T stats;
+} CAPTURE_BUS_T;
+
+static bool bInit = false;
+static CAPTURE_SINK_T sessionSink = CAPTURE_SINK_LFS;
+static CAPTURE_BUS_T bus[N_CAN_ID];
+#if CONFIG_USE_RAWLOG
+static TaskHandle_t taskHandle_writer = NULL;
+static StaticTask_t taskStruct_writer;
+static StackType_t taskStackStorage[CAPTURE_WRITER_TASK_STACK_SIZE];
+static SemaphoreHandle_t semWork = NULL;
+static StaticSemaphore_t semWorkStruct;
+static volatile bool flushReq = false;
+static int32_t flushStatus;
+static SemaphoreHandle_t semFlushed = NULL;
+static StaticSemaphore_t semFlushedStruct;
+#endif
+
+
+static void CAPTURE_PutU16(uint8_t * pDst, uint16_t value)
+{
+    pDst[0] = (uint8_t)value;
+    pDst[1] = (uint8_t)(value >> 8);
+}
+
+
+static void CAPTURE_PutU32(uint8_t * pDst, uint32_t value)
+{
+    pDst[0] = (uint8_t)value;
+    pDst[1] = (uint8_t)(value >> 8);
+    pDst[2] = (uint8_t)(value >> 16);
+    pDst[3] = (uint8_t)(value >> 24);
+}
+
+
+static uint8_t CAPTURE_Sum8(const uint8_t * pSrc, size_t len)
+{
+    uint8_t sum = 0;
+
+    while(len--) {
+        sum += *pSrc++;
+    }
+    return sum;
+}
+
+
+/* Header and checksum around a payload already placed at pDst + CAPTURE_HDR_SIZE */
+static size_t CAPTURE_Seal(uint8_t * pDst, uint8_t type, uint32_t seq,
+                           uint32_t offsetUs, size_t payloadLen)
+{
+    const size_t len = CAPTURE_HDR_SIZE + payloadLen + 1;
+
+    pDst[0] = CAPTURE_TAG;
+    CAPTURE_PutU16(&pDst[1], (uint16_t)len);
+    CAPTURE_PutU32(&pDst[3], offsetUs);
+    CAPTURE_PutU32(&pDst[7], seq);
+    pDst[11] = type;
+    pDst[len - 1] = (uint8_t)(0 - CAPTURE_Sum8(pDst, len - 1));
+    return len;
+}
+
+
+size_t CAPTURE_encodeFrame(uint8_t * pDst, size_t size, uint8_t type,
+                           uint32_t seq, uint32_t offsetUs, uint32_t id,
+                           uint8_t flags, const uint8_t * data, uint8_t len)
+{
+    uint8_t * const pPayload = &pDst[CAPTURE_HDR_SIZE];
+
+    if((pDst == NULL) || (len > CONFIG_CANFD_DATA_SIZE) ||
+       ((len != 0) && (data == NULL)) ||
+       (size < (CAPTURE_HDR_SIZE + CAPTURE_FRAME_HDR_SIZE + len + 1))) {
+        return 0;
+    }
+    CAPTURE_PutU32(&pPayload[0], id);
+    pPayload[4] = flags;
+    pPayload[5] = len;
+    memcpy(&pPayload[CAPTURE_FRAME_HDR_SIZE], data, len);
+    return CAPTURE_Seal(pDst, type, seq, offsetUs, CAPTURE_FRAME_HDR_SIZE + len);
+}
+
+
+/*
+ * The DWT counter wraps every ~26s. Each bus extends it with the signed
+ * difference to the previous stamp, which holds as long as the bus task
+ * looks at the clock at least every few seconds, see CAPTURE_poll().
+ */
+static uint32_t CAPTURE_OffsetUs(CAPTURE_BUS_T * me, uint32_t stamp)
+{
+    const uint32_t cyclesPerUs = SystemCoreClock / 1000000U;
+    const int32_t delta = (int32_t)(stamp - me->lastCycles);
+
+    me->lastCycles = stamp;
+    me->cycles += delta;
+    if(me->cycles <= me->epochCycles) {
+        /* Stamped before the last poll or epoch change */
+        return 0;
+    }
+    return (uint32_t)((me->cycles - me->epochCycles) / cyclesPerUs);
+}
+
+
+/* Starts a new epoch with a start record when the offset gets too large */
+static void CAPTURE_StartRecord(CAPTURE_BUS_T * me, CAN_ID_T id)
+{
+    uint8_t * const pDst = &me->batch[me->fill];
+
+    CAPTURE_PutU32(&pDst[CAPTURE_HDR_SIZE], me->epochTick);
+    me->fill += CAPTURE_Seal(pDst, CAPTURE_TYPE_START | (id << CAPTURE_BUS_SHIFT),
+                             me->seq++, 0, sizeof(uint32_t));
+    me->stats.records++;
+}
+
+
+#if CONFIG_USE_RAWLOG
+/* Writer side, returns true if a batch was appended */
+static bool CAPTURE_Drain(CAPTURE_BUS_T * me)
+{
+    const uint32_t idx = me->rawTail % CAPTURE_RAWLOG_BUF_COUNT;
+    int32_t ret;
+
+    if(me->rawTail == me->rawHead) {
+        return false;
+    }
+    __DMB();
+
+    ret = RAWLOG_append(me->rawBuf[idx], me->rawLen[idx]);
+    xSemaphoreTake(me->mutex, portMAX_DELAY);
+    if(ret == RAWLOG_ERR_NONE) {
+        me->stats.bytes += me->rawLen[idx];
+    } else {
+        me->stats.droppedBytes += me->rawLen[idx];
+        if(me->stats.error == 0) {
+            me->stats.error = ret;
+        }
+    }
+    xSemaphoreGive(me->mutex);
+
+    /* Done with the batch before handing it back */
+    __DMB();
+    me->rawTail++;
+    return true;
+}
+
+
+/*
+ * Chunk seals and card I/O of the raw log stay out of the bus tasks, a
+ * slow append only fills the batch rings.
+ */
+static void CAPTURE_WriterTask(void * pvParam)
+{
+    while(bInit != true) {
+        vTaskDelay(1);
+    }
+
+    while(1) {
+        xSemaphoreTake(semWork, portMAX_DELAY);
+        for(uint32_t i = 0; i < N_CAN_ID; i++) {
+            while(CAPTURE_Drain(&bus[i]));
+        }
+        if(flushReq) {
+            flushStatus = RAWLOG_flush();
+            flushReq = false;
+            xSemaphoreGive(semFlushed);
+        }
+    }
+}
+#endif
+
+
+/* Bus task, called with me->mutex held */
+static void CAPTURE_Flush(CAPTURE_BUS_T * me)
+{
+    if(me->fill == 0) {
+        return;
+    }
+    if(me->fill > me->stats.maxBatch) {
+        me->stats.maxBatch = me->fill;
+    }
+    me->stats.batches++;
+
+    if(sessionSink == CAPTURE_SINK_LFS) {
+#if CONFIG_USE_LFS_WRITER
+        const size_t n = LFS_WRITER_write(me->stream, me->batch, me->fill);
+        me->stats.bytes += n;
+        me->stats.droppedBytes += me->fill - n;
+#endif
+    } else {
+#if CONFIG_USE_RAWLOG
+        if((me->rawHead - me->rawTail) >= CAPTURE_RAWLOG_BUF_COUNT) {
+            /* Every batch is waiting for the writer task */
+            me->stats.droppedBytes += me->fill;
+        } else {
+            const uint32_t idx = me->rawHead % CAPTURE_RAWLOG_BUF_COUNT;
+
+            memcpy(me->rawBuf[idx], me->batch, me->fill);
+            me->rawLen[idx] = me->fill;
+            /* Batch contents must be visible before the new head */
+            __DMB();
+            me->rawHead++;
+            xSemaphoreGive(semWork);
+        }
+#endif
+    }
+    me->fill = 0;
+}
+
+
+/* Bus task side of CAPTURE_stop(), the last batch is already flushed */
+static void CAPTURE_End(CAPTURE_BUS_T * me)
+{
+#if CONFIG_USE_LFS_WRITER
+    if(sessionSink == CAPTURE_SINK_LFS) {
+        /* The bus task is the stream producer, CAPTURE_stop() closes after this */
+        LFS_WRITER_flush(me->stream);
+    }
+#endif
+    me->stopReq = false;
+    __DMB();
+    me->bActive = false;
+    xSemaphoreGive(me->semStopped);
+}
+
+
+static void CAPTURE_Frame(CAN_ID_T id, uint8_t type, uint32_t stamp, uint32_t canId,
+                          uint8_t flags, const uint8_t * data, uint8_t len)
+{
+    CAPTURE_BUS_T * const me = &bus[id];
+    uint32_t offsetUs;
+    size_t n;
+
+    offsetUs = CAPTURE_OffsetUs(me, stamp);
+    if((me->fill + CAPTURE_FRAME_ROOM) > CAPTURE_BATCH_SIZE) {
+        /* Not CAPTURE_commit(), a pending stop must wait for this frame */
+        xSemaphoreTake(me->mutex, portMAX_DELAY);
+        CAPTURE_Flush(me);
+        xSemaphoreGive(me->mutex);
+    }
+    if(offsetUs >= (CAPTURE_EPOCH_MS * 1000UL)) {
+        me->epochCycles += (uint64_t)CAPTURE_EPOCH_MS * (SystemCoreClock / 1000U);
+        me->epochTick += CAPTURE_EPOCH_MS;
+        offsetUs -= CAPTURE_EPOCH_MS * 1000UL;
+        CAPTURE_StartRecord(me, id);
+    }
+    n = CAPTURE_encodeFrame(&me->batch[me->fill], CAPTURE_BATCH_SIZE - me->fill,
+                            type | (id << CAPTURE_BUS_SHIFT), me->seq, offsetUs,
+                            canId, flags, data, len);
+    if(n != 0) {
+        me->fill += n;
+        me->seq++;
+        me->stats.records++;
+        me->windowFrames++;
+    }
+}
+
+
+void CAPTURE_init(void)
+{
+    if(bInit == true) {
+        return;
+    }
+
+    memset(bus, 0, sizeof(bus));
+    for(uint32_t i = 0; i < N_CAN_ID; i++) {
+        bus[i].stream = -1;
+        bus[i].mutex = xSemaphoreCreateMutexStatic(&bus[i].mutexStruct);
+        configASSERT(bus[i].mutex != NULL);
+        bus[i].semStopped = xSemaphoreCreateBinaryStatic(&bus[i].semStoppedStruct);
+        configASSERT(bus[i].semStopped != NULL);
+    }
+#if CONFIG_USE_RAWLOG
+    semWork = xSemaphoreCreateBinaryStatic(&semWorkStruct);
+    configASSERT(semWork != NULL);
+    semFlushed = xSemaphoreCreateBinaryStatic(&semFlushedStruct);
+    configASSERT(semFlushed != NULL);
+
+    taskHandle_writer = xTaskCreateStatic(CAPTURE_WriterTask,
+                                    "capture",
+                                    CAPTURE_WRITER_TASK_STACK_SIZE,
+                                    (void *)0,
+                                    CAPTURE_WRITER_TASK_PRIORITY,
+                                    taskStackStorage,
+                                    &taskStruct_writer);
+    configASSERT(taskHandle_writer != NULL);
+#endif
+
+#if CONFIG_TEST_CAPTURE
+    TEST_CAPTURE_init();
+#endif
+
+    bInit = true;
+}
+
+
+bool CAPTURE_start(CAPTURE_SINK_T sink, const char * prefix)
+{
+    const uint32_t startCycles = BSP_CYCLE_get();
+    const TickType_t startTick = xTaskGetTickCount();
+    char path[32];
+    uint32_t i;
+
+    if((bInit != true) || (sink >= N_CAPTURE_SINK) || CAPTURE_isActive()) {
+        return false;
+    }
+#if !CONFIG_USE_LFS_WRITER
+    if(sink == CAPTURE_SINK_LFS) {
+        return false;
+    }
+#endif
+#if !CONFIG_USE_RAWLOG
+    if(sink == CAPTURE_SINK_RAWLOG) {
+        return false;
+    }
+#endif
+
+    sessionSink = sink;
+    for(i = 0; i < N_CAN_ID; i++) {
+        CAPTURE_BUS_T * const me = &bus[i];
+
+        xSemaphoreTake(me->mutex, portMAX_DELAY);
+#if CONFIG_USE_LFS_WRITER
+        if(sink == CAPTURE_SINK_LFS) {
+            snprintf(path, sizeof(path), "%s%lu.bin", (prefix != NULL) ? prefix : "can", i + 1);
+            me->stream = LFS_WRITER_open(path);
+            if(me->stream < 0) {
+                xSemaphoreGive(me->mutex);
+                break;
+            }
+        }
+#endif
+        me->seq = 0;
+        me->lastCycles = startCycles;
+        me->cycles = 0;
+        me->epochCycles = 0;
+        me->epochTick = startTick;
+        me->windowStart = startTick;
+        me->windowFrames = 0;
+        me->fill = 0;
+        memset(&me->stats, 0, sizeof(me->stats));
+        CAPTURE_StartRecord(me, (CAN_ID_T)i);
+        __DMB();
+        me->bActive = true;
+        xSemaphoreGive(me->mutex);
+    }
+
+    if(i != N_CAN_ID) {
+        /* Not enough writer streams */
+        CAPTURE_stop();
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * The bus tasks end their sessions on the next commit or poll, which is
+ * at most CAN_TASK_WAIT_TICKS away. Closing the sink waits for that.
+ */
+void CAPTURE_stop(void)
+{
+    bool bWait[N_CAN_ID];
+    uint32_t i;
+
+    for(i = 0; i < N_CAN_ID; i++) {
+        bWait[i] = bus[i].bActive;
+        if(bWait[i]) {
+            bus[i].stopReq = true;
+        }
+    }
+    for(i = 0; i < N_CAN_ID; i++) {
+        if(bWait[i]) {
+            xSemaphoreTake(bus[i].semStopped, portMAX_DELAY);
+        }
+    }
+
+#if CONFIG_USE_LFS_WRITER
+    if(sessionSink == CAPTURE_SINK_LFS) {
+        for(i = 0; i < N_CAN_ID; i++) {
+            CAPTURE_BUS_T * const me = &bus[i];
+            int32_t ret;
+
+            if(me->stream < 0) {
+                continue;
+            }
+            ret = LFS_WRITER_close(me->stream);
+            me->stream = -1;
+            xSemaphoreTake(me->mutex, portMAX_DELAY);
+            if(me->stats.error == 0) {
+                me->stats.error = ret;
+            }
+            xSemaphoreGive(me->mutex);
+        }
+    }
+#endif
+#if CONFIG_USE_RAWLOG
+    if(sessionSink == CAPTURE_SINK_RAWLOG) {
+        /* The writer task appends what is left in the rings first */
+        flushReq = true;
+        xSemaphoreGive(semWork);
+        xSemaphoreTake(semFlushed, portMAX_DELAY);
+        if(flushStatus != RAWLOG_ERR_NONE) {
+            for(i = 0; i < N_CAN_ID; i++) {
+                xSemaphoreTake(bus[i].mutex, portMAX_DELAY);
+                if(bus[i].stats.error == 0) {
+                    bus[i].stats.error = flushStatus;
+                }
+                xSemaphoreGive(bus[i].mutex);
+            }
+        }
+    }
+#endif
+}
+
+
+bool CAPTURE_isActive(void)
+{
+    for(uint32_t i = 0; i < N_CAN_ID; i++) {
+        if(bus[i].bActive) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void CAPTURE_rx(CAN_ID_T id, const CAN_RX_T * pRec)
+{
+    if((id >= N_CAN_ID) || (bus[id].bActive != true)) {
+        return;
+    }
+    CAPTURE_Frame(id, (pRec->flags & CAN_RX_FLAG_FD) ? CAPTURE_TYPE_RX_CANFD : CAPTURE_TYPE_RX_CAN,
+                  pRec->timestamp, pRec->id, pRec->flags & (CAPTURE_FLAG_BRS | CAPTURE_FLAG_ESI),
+                  pRec->data, pRec->len);
+    bus[id].stats.rxFrames++;
+}
+
+
+void CAPTURE_tx(CAN_ID_T id, const CAN_TX_T * pElem, uint32_t timestamp)
+{
+    const FDCAN_TxHeaderTypeDef * const pHdr = &pElem->header;
+    uint32_t canId = pHdr->Identifier;
+    uint8_t flags = 0;
+
+    if((id >= N_CAN_ID) || (bus[id].bActive != true)) {
+        return;
+    }
+    if(pHdr->IdType == FDCAN_EXTENDED_ID) {
+        canId |= CAPTURE_ID_EXT;
+    }
+    if(pHdr->TxFrameType == FDCAN_REMOTE_FRAME) {
+        canId |= CAPTURE_ID_RTR;
+    }
+    if(pHdr->BitRateSwitch == FDCAN_BRS_ON) {
+        flags |= CAPTURE_FLAG_BRS;
+    }
+    CAPTURE_Frame(id, (pHdr->FDFormat == FDCAN_FD_CAN) ? CAPTURE_TYPE_TX_CANFD : CAPTURE_TYPE_TX_CAN,
+                  timestamp, canId, flags, pElem->data,
+                  (uint8_t)BSP_CAN_dlc_to_bytes(pHdr->DataLength));
+    bus[id].stats.txFrames++;
+}
+
+
+void CAPTURE_commit(CAN_ID_T id)
+{
+    CAPTURE_BUS_T * me;
+    TickType_t elapsed;
+
+    if((bInit != true) || (id >= N_CAN_ID)) {
+        return;
+    }
+    me = &bus[id];
+
+    xSemaphoreTake(me->mutex, portMAX_DELAY);
+    if(me->bActive != true) {
+        xSemaphoreGive(me->mutex);
+        return;
+    }
+    CAPTURE_Flush(me);
+    elapsed = (xTaskGetTickCount() - me->windowStart) * portTICK_PERIOD_MS;
+    if(elapsed >= CAPTURE_FPS_WINDOW_MS) {
+        me->stats.fps = (me->windowFrames * 1000UL) / elapsed;
+        if(me->stats.fps > me->stats.peakFps) {
+            me->stats.peakFps = me->stats.fps;
+        }
+        me->windowFrames = 0;
+        me->windowStart = xTaskGetTickCount();
+    }
+    xSemaphoreGive(me->mutex);
+
+    if(me->stopReq) {
+        CAPTURE_End(me);
+    }
+}
+
+
+void CAPTURE_poll(CAN_ID_T id)
+{
+    if((id >= N_CAN_ID) || (bus[id].bActive != true)) {
+        return;
+    }
+    /* Keeps the extended clock and the frame rate going on a quiet bus */
+    (void)CAPTURE_OffsetUs(&bus[id], BSP_CYCLE_get());
+    CAPTURE_commit(id);
+}
+
+
+const CAPTURE_STATS_T * CAPTURE_getStats(CAN_ID_T id)
+{
+    if(id >= N_CAN_ID) {
+        return NULL;
+    }
+    return &bus[id].stats;
+}
+
+
+void CAPTURE_resetStats(void)
+{
+    for(uint32_t i = 0; i < N_CAN_ID; i++) {
+        xSemaphoreTake(bus[i].mutex, portMAX_DELAY);
+        memset(&bus[i].stats, 0, sizeof(bus[i].stats));
+        xSemaphoreGive(bus[i].mutex);
+    }
+}
+
+#endif /* CONFIG_USE_CAPTURE */
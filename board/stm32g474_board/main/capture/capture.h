@@ -0,0 +1,113 @@
+/*
+ * capture.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef CAPTURE_CAPTURE_H_
+#define CAPTURE_CAPTURE_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_CAPTURE
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "bsp/can/bsp_can.h"
+
+/*
+ * Record layout, multi-byte fields are little endian
+ *
+ * [0]     : tag (0xFF)
+ * [1..2]  : length of the whole record, tag to checksum
+ * [3..6]  : timestamp offset in us from the last start record
+ * [7..10] : SEQ number, per bus
+ * [11]    : packet type in bits 3..0, bus (0 = CAN1) in bits 7..4
+ *             0x00: Start Time in Ticks
+ *             0x01: Tx CAN standard
+ *             0x02: Rx CAN standard
+ *             0x03: Tx CAN-FD
+ *             0x04: Rx CAN-FD
+ * [12..N] : payload
+ * [N]     : checksum8, all bytes of the record sum up to 0
+ *
+ * Start payload : [0..3] tick (ms) the offsets count from
+ * Frame payload : [0..3] identifier, CAPTURE_ID_EXT / CAPTURE_ID_RTR
+ *                 [4]    CAPTURE_FLAG_xxx
+ *                 [5]    data length in bytes
+ *                 [6..]  data
+ */
+#define CAPTURE_TAG                 (0xFF)
+#define CAPTURE_HDR_SIZE            (12)
+#define CAPTURE_FRAME_HDR_SIZE      (6)
+#define CAPTURE_RECORD_MAX          (CAPTURE_HDR_SIZE + CAPTURE_FRAME_HDR_SIZE + CONFIG_CANFD_DATA_SIZE + 1)
+
+#define CAPTURE_TYPE_START          (0x00)
+#define CAPTURE_TYPE_TX_CAN         (0x01)
+#define CAPTURE_TYPE_RX_CAN         (0x02)
+#define CAPTURE_TYPE_TX_CANFD       (0x03)
+#define CAPTURE_TYPE_RX_CANFD       (0x04)
+#define CAPTURE_TYPE_MASK           (0x0F)
+#define CAPTURE_BUS_SHIFT           (4)
+
+/* Same bits as in CAN_RX_T */
+#define CAPTURE_ID_EXT              (CAN_RX_ID_EXT)
+#define CAPTURE_ID_RTR              (CAN_RX_ID_RTR)
+#define CAPTURE_FLAG_BRS            (CAN_RX_FLAG_BRS)
+#define CAPTURE_FLAG_ESI            (CAN_RX_FLAG_ESI)
+
+typedef enum {
+    CAPTURE_SINK_LFS = 0,       // one littlefs file per bus through lfs_writer
+    CAPTURE_SINK_RAWLOG,        // all buses into the raw log through the capture writer task
+    N_CAPTURE_SINK
+} CAPTURE_SINK_T;
+
+typedef struct {
+    uint32_t rxFrames;
+    uint32_t txFrames;
+    uint32_t records;
+    uint64_t bytes;             // encoded bytes handed to the sink
+    uint32_t droppedBytes;      // not accepted by the sink
+    uint32_t batches;
+    uint32_t maxBatch;          // bytes
+    uint32_t fps;               // frames/s over the last second
+    uint32_t peakFps;
+    int32_t error;              // first sink error
+} CAPTURE_STATS_T;
+
+void CAPTURE_init(void);
+/*
+ * Starts a capture session. prefix is the file name prefix for
+ * CAPTURE_SINK_LFS, bus n is written to "<prefix><n>.bin".
+ */
+bool CAPTURE_start(CAPTURE_SINK_T sink, const char * prefix);
+/*
+ * Asks the bus tasks to end the session and waits until they handed in
+ * their last batch, then closes the files or flushes the raw log.
+ */
+void CAPTURE_stop(void);
+bool CAPTURE_isActive(void);
+
+/*
+ * Called from the bus task, records are batched until CAPTURE_commit().
+ * CAPTURE_commit() also ends the session of the bus after CAPTURE_stop().
+ */
+void CAPTURE_rx(CAN_ID_T bus, const CAN_RX_T * pRec);
+void CAPTURE_tx(CAN_ID_T bus, const CAN_TX_T * pElem, uint32_t timestamp);
+void CAPTURE_commit(CAN_ID_T bus);
+/* Called from the bus task at least once a second while the bus is idle */
+void CAPTURE_poll(CAN_ID_T bus);
+
+/* Returns the record length, 0 if it does not fit in size bytes */
+size_t CAPTURE_encodeFrame(uint8_t * pDst, size_t size, uint8_t type,
+                           uint32_t seq, uint32_t offsetUs, uint32_t id,
+                           uint8_t flags, const uint8_t * data, uint8_t len);
+
+const CAPTURE_STATS_T * CAPTURE_getStats(CAN_ID_T bus);
+void CAPTURE_resetStats(void);
+
+#endif /* CONFIG_USE_CAPTURE */
+
+#endif /* CAPTURE_CAPTURE_H_ */
@@ -0,0 +1,163 @@
+/*
+ * test_capture.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_CAPTURE
+
+#include "string.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "capture.h"
+#include "test_capture.h"
+
+static bool bInit = false;
+
+
+static BaseType_t CmdCapStart(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    CAPTURE_SINK_T sink;
+    char prefix[20] = "can";
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if((ptrStrParam != NULL) && (strParamLen == 3) && (strncmp(ptrStrParam, "lfs", 3) == 0)) {
+        sink = CAPTURE_SINK_LFS;
+    } else if((ptrStrParam != NULL) && (strParamLen == 3) && (strncmp(ptrStrParam, "raw", 3) == 0)) {
+        sink = CAPTURE_SINK_RAWLOG;
+    } else {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 2, &strParamLen);
+    if(ptrStrParam != NULL) {
+        if(strParamLen > (sizeof(prefix) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter2 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        memcpy(prefix, ptrStrParam, strParamLen);
+        prefix[strParamLen] = '\0';
+    }
+
+    if(CAPTURE_start(sink, prefix) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tCAPTURE_start failed\r\n\r\n");
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+    return 0;
+}
+
+static const CLI_Command_Definition_t cap_start = {
+    "cap_start",
+    "cap_start <lfs|raw> [prefix]:\r\n"
+    "\tStarts capturing all buses, to <prefix><bus>.bin or the raw log\r\n\r\n",
+    CmdCapStart,
+    -1
+};
+
+
+static BaseType_t CmdCapStop(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+    CAPTURE_stop();
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+    return 0;
+}
+
+static const CLI_Command_Definition_t cap_stop = {
+    "cap_stop",
+    "cap_stop:\r\n"
+    "\tStops capturing and closes the sink\r\n\r\n",
+    CmdCapStop,
+    0
+};
+
+
+/* One bus per call */
+static BaseType_t CmdCapStat(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t id = 0;
+    const CAPTURE_STATS_T * pStats;
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(id == 0) {
+        ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam != NULL) {
+            if((strParamLen == 5) && (strncmp(ptrStrParam, "reset", 5) == 0)) {
+                CAPTURE_resetStats();
+                snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
+            } else {
+                snprintf(pcWriteBuffer, xWriteBufferLen,
+                        "\tError: Parameter1 value is invalid!\r\n\r\n");
+            }
+            return 0;
+        }
+    }
+
+    pStats = CAPTURE_getStats((CAN_ID_T)id);
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tCAN%lu: %s\r\n"
+            "\t  Rx %lu, Tx %lu frames, %lu records\r\n"
+            "\t  %lu frames/s, peak %lu frames/s\r\n"
+            "\t  %lu KB written, %lu bytes dropped, error %ld\r\n"
+            "\t  %lu batches, largest %lu bytes\r\n",
+            id + 1, CAPTURE_isActive() ? "capturing" : "idle",
+            pStats->rxFrames, pStats->txFrames, pStats->records,
+            pStats->fps, pStats->peakFps,
+            (uint32_t)(pStats->bytes / 1024), pStats->droppedBytes, pStats->error,
+            pStats->batches, pStats->maxBatch);
+    id++;
+    if(id < N_CAN_ID) {
+        return 1;
+    }
+    strncat(pcWriteBuffer, "\r\n", xWriteBufferLen - strlen(pcWriteBuffer) - 1);
+    id = 0;
+    return 0;
+}
+
+static const CLI_Command_Definition_t cap_stat = {
+    "cap_stat",
+    "cap_stat [reset]:\r\n"
+    "\tShows the capture statistics of each bus\r\n\r\n",
+    CmdCapStat,
+    -1
+};
+
+
+void TEST_CAPTURE_init(void)
+{
+    if(bInit) {
+        return;
+    }
+    FreeRTOS_CLIRegisterCommand(&cap_start);
+    FreeRTOS_CLIRegisterCommand(&cap_stop);
+    FreeRTOS_CLIRegisterCommand(&cap_stat);
+    bInit = true;
+}
+
+#endif /* CONFIG_TEST_CAPTURE */
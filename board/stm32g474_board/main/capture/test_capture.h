@@ -0,0 +1,19 @@
+/*
+ * test_capture.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef CAPTURE_TEST_CAPTURE_H_
+#define CAPTURE_TEST_CAPTURE_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_CAPTURE
+
+void TEST_CAPTURE_init(void);
+
+#endif /* CONFIG_TEST_CAPTURE */
+
+#endif /* CAPTURE_TEST_CAPTURE_H_ */
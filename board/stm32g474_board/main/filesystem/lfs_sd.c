@@ -14,32 +14,196 @@
 #include "lfs.h"
 #include "lfs_sd.h"
 #include "sdcard.h"
+#include "blockdev/blockdev.h"
 #include "cli.h"
-
-#define LFS_LOOKAHEAD_SIZE          (8192)
+#include "bsp/bsp_cycle.h"
+#if CONFIG_USE_RAWLOG
+#include "rawlog.h"
+#endif
+
+#define LFS_LOOKAHEAD_SIZE          (CONFIG_LFS_SD_LOOKAHEAD_SIZE)
+#define LFS_CACHE_SIZE              (CONFIG_LFS_SD_CACHE_SIZE)
+#define LFS_SD_MAX_FILES            (CONFIG_LFS_SD_MAX_OPEN_FILES)
+#define LFS_SD_MAX_RINGS            (CONFIG_LFS_SD_MAX_RINGS)
+#define LFS_SD_RING_SEGMENT         (CONFIG_LFS_SD_RING_SEGMENT_SIZE)
+/*
+ * File descriptors and rings carry the slot in bits 7..0 and a generation
+ * above, a handle dropped by lfs_sd_simPowerCut() fails with LFS_ERR_BADF
+ * instead of reaching whoever opens the slot next.
+ */
+#define LFS_SD_ID(slot, gen)        ((int32_t)(((gen) << 8) | (slot)))
+#define LFS_SD_ID_SLOT(id)          ((uint32_t)(id) & 0xFF)
+#define LFS_SD_ID_GEN(id)           ((uint32_t)(id) >> 8)
+#define LFS_SD_GEN_MASK             (0x7FFFFF)
+
+#if (LFS_SD_MAX_FILES > 0xFF) || (LFS_SD_MAX_RINGS > 0xFF)
+#error "lfs_sd handle slots must fit in 8 bits"
+#endif
+#define LFS_SD_RING_PATH_MAX        (32)
+#define LFS_SD_RING_MAGIC           (0x474E4952)    // "RING"
+#define LFS_SD_RING_ATTR            (0x52)          // 'R'
+#define LFS_SD_HINT_MAGIC           (0x544E4948)    // "HINT"
+#define LFS_SD_HINT_ATTR            (0x41)          // 'A', on the root directory
+
+/* littlefs renamed its allocator state in v2.9 */
+#if LFS_VERSION >= 0x00020009
+#define LFS_SD_ALLOC_START(p)       ((p)->lookahead.start)
+#else
+#define LFS_SD_ALLOC_START(p)       ((p)->free.off)
+#endif
 #define LFS_SD_PRINT_DEBUG_ENABLE   (1)
 #define LFS_SD_PRINTF(x, ...)       (LFS_SD_PRINT_DEBUG_ENABLE != 0) ? CLI_printf("lfs_sd: "x, ##__VA_ARGS__) : (void)0
 
+typedef struct {
+    bool bOpen;
+    uint32_t gen;
+    lfs_file_t file;
+    struct lfs_file_config cfg;
+    uint32_t unsynced;          // bytes written since the last sync, filesMutex
+    TickType_t lastSync;
+    TickType_t lastWrite;
+    TaskHandle_t writer;        // task of the last write, syncs the deadlines
+} LFS_SD_FILE_T;
+
+/* Kept as a custom attribute of the ring directory */
+typedef struct {
+    uint32_t magic;
+    uint32_t segSize;
+    uint32_t segCount;
+    uint32_t head;              // next byte written, ring offset
+    uint32_t tail;              // oldest byte kept, ring offset
+} LFS_SD_RING_HDR_T;
+
+/*
+ * Allocator hint. After mount littlefs starts looking for free blocks at a
+ * pseudo-random block, every lookahead window it scans costs a traversal
+ * of the whole filesystem. Starting at the window where the last session
+ * found free blocks avoids scanning full windows. Any start is correct,
+ * the hint only has to be in range.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t blockCount;
+    uint32_t start;             // first block of the lookahead window
+} LFS_SD_HINT_T;
+
+typedef struct {
+    bool bOpen;
+    uint32_t gen;
+    char path[LFS_SD_RING_PATH_MAX];
+    LFS_SD_RING_HDR_T hdr;
+    int32_t fd;                 // segment holding head
+} LFS_SD_RING_T;
+
 static struct lfs_config cfg = {0};
-static struct lfs_file_config cfgFile = {0};
-static lfs_file_t file = {0};
 static lfs_t lfs;
 static bool bInit = false;
 static bool bMount = false;
-static bool bFileOpen = false;
-static uint8_t lfs_readBuffer[SDCARD_BLOCK_SIZE];
-static uint8_t lfs_progBuffer[SDCARD_BLOCK_SIZE];
+static uint8_t lfs_readBuffer[LFS_CACHE_SIZE];
+static uint8_t lfs_progBuffer[LFS_CACHE_SIZE];
 static uint8_t lfs_lookAheadBuffer[LFS_LOOKAHEAD_SIZE];
+/* Handle pool, each handle owns one file cache of the arena */
+static LFS_SD_FILE_T files[LFS_SD_MAX_FILES];
+static uint8_t fileCacheArena[LFS_SD_MAX_FILES][LFS_CACHE_SIZE];
+static SemaphoreHandle_t filesMutex = NULL;
+static StaticSemaphore_t filesMutexStruct;
+static LFS_SD_RING_T rings[LFS_SD_MAX_RINGS];
+static LFS_SD_MOUNT_STATS_T mountStats = {0};
+static uint32_t hintSaved = UINT32_MAX;
 static uint8_t dummyBuffer[SDCARD_BLOCK_SIZE];
-static uint8_t fileCacheBuffer[SDCARD_BLOCK_SIZE];
+static LFS_SD_ERASE_T eraseStrategy = (LFS_SD_ERASE_T)CONFIG_LFS_SD_ERASE_STRATEGY;
+static LFS_SD_SYNC_POLICY_T syncPolicy = {
+    .mode = (LFS_SD_SYNC_T)CONFIG_LFS_SD_SYNC_MODE,
+    .bytes = CONFIG_LFS_SD_SYNC_BYTES,
+    .ms = CONFIG_LFS_SD_SYNC_MS
+};
+static LFS_SD_SYNC_STATS_T syncStats = {0};
+static uint32_t eraseCount = 0;
+static TickType_t eraseTicks = 0;
 
 #define BLOCK_SIZE_FACTOR           (128)
+#define LFS_SD_BENCH_FILE           ".bench"
+#if CONFIG_USE_RAWLOG
+#define LFS_SD_RESERVED_BLOCKS      (RAWLOG_BLOCKS)     // raw log at the end of the card
+#else
+#define LFS_SD_RESERVED_BLOCKS      (0)
+#endif
+
+#if ((LFS_CACHE_SIZE % SDCARD_BLOCK_SIZE) != 0) || \
+    (((SDCARD_BLOCK_SIZE * BLOCK_SIZE_FACTOR) % LFS_CACHE_SIZE) != 0)
+#error "Cache size must be a multiple of 512 and divide the 64kB block"
+#endif
+
+#if ((LFS_LOOKAHEAD_SIZE % 8) != 0)
+#error "Lookahead size must be a multiple of 8"
+#endif
 
 #ifdef LFS_THREADSAFE
 static SemaphoreHandle_t lfs_mutex_handle = NULL;
 static StaticSemaphore_t lfs_mutexStruct;
 #endif /* LFS_THREADSAFE */
 
+static int32_t sd_dev_read(uint32_t lba, void * pBuff, uint32_t count)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_read(BLOCKDEV_CLIENT_LFS, lba, pBuff, count);
+#else
+    return SDCARD_ReadMultiBlock(lba, pBuff, count);
+#endif
+}
+
+
+static int32_t sd_dev_prog(uint32_t lba, const void * pBuff, uint32_t count)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_write(BLOCKDEV_CLIENT_LFS, lba, pBuff, count);
+#else
+    return SDCARD_WriteMultiBlock(lba, pBuff, count);
+#endif
+}
+
+
+static int32_t sd_dev_trim(uint32_t lba, uint32_t count)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_erase(BLOCKDEV_CLIENT_LFS, lba, count);
+#else
+    return SDCARD_Erase(lba, lba + count - 1);
+#endif
+}
+
+
+static int32_t sd_dev_sync(void)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_sync(BLOCKDEV_CLIENT_LFS);
+#else
+    return SDCARD_ERR_NONE;
+#endif
+}
+
+static uint32_t sd_dev_getBlockCount(void)
+{
+    const uint32_t count = SDCARD_GetBlockCount();
+
+    if(count <= LFS_SD_RESERVED_BLOCKS) {
+        return 0;
+    }
+    return count - LFS_SD_RESERVED_BLOCKS;
+}
+
+
+static const LFS_SD_BDEV_T sdDev = {
+    .read = sd_dev_read,
+    .prog = sd_dev_prog,
+    .trim = sd_dev_trim,
+    .sync = sd_dev_sync,
+    .getBlockCount = sd_dev_getBlockCount
+};
+static const LFS_SD_BDEV_T * pDev = &sdDev;
+static LFS_SD_IOSTAT_T ioStats = {0};
+
+
 static int sd_read(const struct lfs_config *c, lfs_block_t block,
             lfs_off_t off, void *buffer, lfs_size_t size)
 {
@@ -47,9 +211,14 @@ static int sd_read(const struct lfs_config *c, lfs_block_t block,
         return LFS_ERR_INVAL;
     }
 
-    const uint32_t sdBlockNbr = (block * BLOCK_SIZE_FACTOR) + off;
+    /* off and size are multiples of read_size (512) */
+    const uint32_t sdBlockNbr = (block * BLOCK_SIZE_FACTOR) + (off / SDCARD_BLOCK_SIZE);
+    const uint32_t cycles = BSP_CYCLE_get();
+    const int32_t ret = pDev->read(sdBlockNbr, buffer, size / SDCARD_BLOCK_SIZE);
 
-    const int32_t ret = SDCARD_ReadSingleBlock(sdBlockNbr, buffer, size);
+    ioStats.readUs += BSP_CYCLE_to_us(BSP_CYCLE_get() - cycles);
+    ioStats.reads++;
+    ioStats.readBlocks += size / SDCARD_BLOCK_SIZE;
     if(SDCARD_ERR_NONE != ret) {
         LFS_SD_PRINTF("SD read error %ld\r\n", ret);
         return LFS_ERR_IO;
@@ -65,9 +234,14 @@ static int sd_prog(const struct lfs_config *c, lfs_block_t block,
         return LFS_ERR_INVAL;
     }
 
-    const uint32_t sdBlockNbr = (block * BLOCK_SIZE_FACTOR) + off;
+    /* off and size are multiples of prog_size (512) */
+    const uint32_t sdBlockNbr = (block * BLOCK_SIZE_FACTOR) + (off / SDCARD_BLOCK_SIZE);
+    const uint32_t cycles = BSP_CYCLE_get();
+    const int32_t ret = pDev->prog(sdBlockNbr, buffer, size / SDCARD_BLOCK_SIZE);
 
-    const int32_t ret = SDCARD_WriteSingleBlock(sdBlockNbr, buffer, size);
+    ioStats.progUs += BSP_CYCLE_to_us(BSP_CYCLE_get() - cycles);
+    ioStats.progs++;
+    ioStats.progBlocks += size / SDCARD_BLOCK_SIZE;
     if(SDCARD_ERR_NONE != ret) {
         LFS_SD_PRINTF("SD write error %ld\r\n", ret);
         return LFS_ERR_IO;
@@ -76,17 +250,54 @@ static int sd_prog(const struct lfs_config *c, lfs_block_t block,
 }
 
 
-static int sd_erase(const struct lfs_config *c, lfs_block_t block)
+static int32_t sd_erase_fill(uint32_t sdBlockNbr)
 {
+    int32_t ret = SDCARD_ERR_NONE;
+
     memset(dummyBuffer, 0xFF, sizeof(dummyBuffer));
     for(uint32_t off = 0; off < BLOCK_SIZE_FACTOR; off++) {
-        // SD dummy erase
-        const uint32_t sdBlockNbr = (block * BLOCK_SIZE_FACTOR) + off;
-        const int32_t ret = SDCARD_WriteSingleBlock(sdBlockNbr, dummyBuffer, sizeof(dummyBuffer));
+        ret = pDev->prog(sdBlockNbr + off, dummyBuffer, 1);
         if(SDCARD_ERR_NONE != ret) {
-            LFS_SD_PRINTF("SD erase error %ld\r\n", ret);
-            return LFS_ERR_IO;
+            break;
+        }
+    }
+    ioStats.progs += BLOCK_SIZE_FACTOR;
+    ioStats.progBlocks += BLOCK_SIZE_FACTOR;
+    return ret;
+}
+
+
+static int sd_erase(const struct lfs_config *c, lfs_block_t block)
+{
+    const uint32_t sdBlockNbr = block * BLOCK_SIZE_FACTOR;
+    const TickType_t tickStart = xTaskGetTickCount();
+    const uint32_t cycles = BSP_CYCLE_get();
+    int32_t ret = SDCARD_ERR_NONE;
+
+    switch(eraseStrategy) {
+        case LFS_SD_ERASE_TRIM: {
+            ret = pDev->trim(sdBlockNbr, BLOCK_SIZE_FACTOR);
+            ioStats.eraseBlocks += BLOCK_SIZE_FACTOR;
+            break;
         }
+        case LFS_SD_ERASE_FILL: {
+            ret = sd_erase_fill(sdBlockNbr);
+            ioStats.eraseBlocks += BLOCK_SIZE_FACTOR;
+            break;
+        }
+        default: {
+            /* littlefs does not rely on erased contents */
+            break;
+        }
+    }
+    eraseCount++;
+    eraseTicks += xTaskGetTickCount() - tickStart;
+    ioStats.eraseUs += BSP_CYCLE_to_us(BSP_CYCLE_get() - cycles);
+    ioStats.erases++;
+
+    if(SDCARD_ERR_NONE != ret) {
+        LFS_SD_PRINTF("SD erase error %ld\r\n", ret);
+        return LFS_ERR_IO;
     }
     return LFS_ERR_OK;
 }
@@ -94,6 +305,15 @@ static int sd_erase(const struct lfs_config *c, lfs_block_t block)
 
 static int sd_sync(const struct lfs_config *c)
 {
+    const uint32_t cycles = BSP_CYCLE_get();
+    const int32_t ret = pDev->sync();
+
+    ioStats.syncUs += BSP_CYCLE_to_us(BSP_CYCLE_get() - cycles);
+    ioStats.syncs++;
+    if(SDCARD_ERR_NONE != ret) {
+        LFS_SD_PRINTF("SD sync error %ld\r\n", ret);
+        return LFS_ERR_IO;
+    }
     return LFS_ERR_OK;
 }
 
@@ -181,18 +401,23 @@ static void lfs_sd_init(void)
     cfg.read_size = SDCARD_BLOCK_SIZE;
     cfg.prog_size = SDCARD_BLOCK_SIZE;
     cfg.block_size = SDCARD_BLOCK_SIZE * BLOCK_SIZE_FACTOR;
-    cfg.block_count = SDCARD_GetBlockCount() / BLOCK_SIZE_FACTOR;
+    cfg.block_count = pDev->getBlockCount() / BLOCK_SIZE_FACTOR;
     cfg.block_cycles = 512;
-    cfg.cache_size = SDCARD_BLOCK_SIZE;
+    cfg.cache_size = LFS_CACHE_SIZE;
     cfg.lookahead_size = LFS_LOOKAHEAD_SIZE;
     cfg.read_buffer = lfs_readBuffer;
     cfg.prog_buffer = lfs_progBuffer;
     cfg.lookahead_buffer = lfs_lookAheadBuffer;
     cfg.name_max = 255;
 
-    memset(&cfgFile, 0, sizeof(cfgFile));
-    cfgFile.buffer = fileCacheBuffer;
-    cfgFile.attr_count = 0;
+    memset(files, 0, sizeof(files));
+    for(uint32_t i = 0; i < LFS_SD_MAX_FILES; i++) {
+        files[i].cfg.buffer = fileCacheArena[i];
+        files[i].cfg.attr_count = 0;
+    }
+    /* Recursive, syncs may run with the pool already locked */
+    filesMutex = xSemaphoreCreateRecursiveMutexStatic(&filesMutexStruct);
+    configASSERT(filesMutex != NULL);
 
     bInit = true;
 }
@@ -216,22 +441,71 @@ struct lfs_config * lfs_sd_stat()
     return(lfs.cfg);
 }
 
+static void lfs_sd_loadHint(void)
+{
+    LFS_SD_HINT_T hint;
+    const lfs_ssize_t ret = lfs_getattr(&lfs, "/", LFS_SD_HINT_ATTR, &hint, sizeof(hint));
+
+    mountStats.bHint = (ret == sizeof(hint)) && (hint.magic == LFS_SD_HINT_MAGIC) &&
+                       (hint.blockCount == cfg.block_count) && (hint.start < cfg.block_count);
+    if(mountStats.bHint) {
+        /* Nothing is allocated yet, the first scan starts here */
+        LFS_SD_ALLOC_START(&lfs) = hint.start;
+        hintSaved = hint.start;
+    } else {
+        hintSaved = UINT32_MAX;
+    }
+    mountStats.allocStart = LFS_SD_ALLOC_START(&lfs);
+}
+
+
+/* Only writes when the allocator moved to another window */
+static void lfs_sd_saveHint(void)
+{
+    LFS_SD_HINT_T hint;
+
+    hint.start = LFS_SD_ALLOC_START(&lfs);
+    if(hint.start == hintSaved) {
+        return;
+    }
+    hint.magic = LFS_SD_HINT_MAGIC;
+    hint.blockCount = cfg.block_count;
+    if(lfs_setattr(&lfs, "/", LFS_SD_HINT_ATTR, &hint, sizeof(hint)) == LFS_ERR_OK) {
+        hintSaved = hint.start;
+    }
+}
+
+
 lfs_t * lfs_sd_mount()
 {
+    TickType_t tickStart;
+
     if(bInit != true) {
         lfs_sd_init();
     }
+    if(bMount) {
+        return &lfs;
+    }
 
+    tickStart = xTaskGetTickCount();
     const int32_t retMount = lfs_mount(&lfs, &cfg);
     if(LFS_ERR_OK != retMount) {
         LFS_SD_PRINTF("Mount failed %ld\r\n", retMount);
         return NULL;
     }
+    lfs_sd_loadHint();
+    mountStats.mountMs = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
     bMount = true;
     return &lfs;
 }
 
 
+const LFS_SD_MOUNT_STATS_T * lfs_sd_getMountStats(void)
+{
+    return &mountStats;
+}
+
+
 int32_t lfs_sd_umount()
 {
     int32_t ret = LFS_ERR_OK;
@@ -242,9 +516,21 @@ int32_t lfs_sd_umount()
     }
 
     if(bMount) {
-        if(bFileOpen) {
-            lfs_sd_fclose();
+        /* Their owners would keep using the handles */
+        for(uint32_t i = 0; i < LFS_SD_MAX_RINGS; i++) {
+            if(rings[i].bOpen) {
+                return LFS_SD_ERR_BUSY;
+            }
+        }
+        xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+        for(uint32_t i = 0; i < LFS_SD_MAX_FILES; i++) {
+            if(files[i].bOpen) {
+                xSemaphoreGiveRecursive(filesMutex);
+                return LFS_SD_ERR_BUSY;
+            }
         }
+        xSemaphoreGiveRecursive(filesMutex);
+        lfs_sd_saveHint();
         ret = lfs_unmount(&lfs);
         bMount = false;
     }
@@ -349,66 +635,276 @@ int32_t lfs_sd_ls(const char * path, char * outBuffer, size_t bufferLen)
 }
 
 
-lfs_file_t * lfs_sd_fopen(const char * pathName)
+/* Returns the open handle of fd, NULL if fd is not open */
+static LFS_SD_FILE_T * lfs_sd_getFile(int32_t fd)
+{
+    LFS_SD_FILE_T * pFile;
+
+    if((fd < 0) || (LFS_SD_ID_SLOT(fd) >= LFS_SD_MAX_FILES) || (bMount != true)) {
+        return NULL;
+    }
+    pFile = &files[LFS_SD_ID_SLOT(fd)];
+    return (pFile->bOpen && (pFile->gen == LFS_SD_ID_GEN(fd))) ? pFile : NULL;
+}
+
+
+int32_t lfs_sd_fopenFlags(const char * pathName, int flags)
 {
-    lfs_file_t * ret = NULL;
+    LFS_SD_FILE_T * pFile;
+    uint32_t slot;
+    int32_t ret;
 
     if(NULL == pathName) {
         LFS_SD_PRINTF("Error: invalid arg\r\n");
-        return NULL;
+        return LFS_ERR_INVAL;
     }
     if(bMount != true) {
         LFS_SD_PRINTF("Error: LFS not mounted\r\n");
-        return NULL;
+        return LFS_ERR_IO;
     }
-    if(bFileOpen) {
-        LFS_SD_PRINTF("Error: Previous file still open.\r\n");
-        return NULL;
+
+    /* Reserve a handle, the open itself runs outside the pool lock */
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    for(slot = 0; slot < LFS_SD_MAX_FILES; slot++) {
+        if(files[slot].bOpen != true) {
+            files[slot].bOpen = true;
+            files[slot].gen = (files[slot].gen + 1) & LFS_SD_GEN_MASK;
+            files[slot].unsynced = 0;
+            files[slot].writer = NULL;
+            break;
+        }
+    }
+    xSemaphoreGiveRecursive(filesMutex);
+    if(slot == LFS_SD_MAX_FILES) {
+        LFS_SD_PRINTF("Error: No free file handle.\r\n");
+        return LFS_ERR_NOMEM;
     }
 
-    if(LFS_ERR_OK == lfs_file_opencfg(&lfs, &file, pathName, LFS_O_CREAT | LFS_O_RDWR, &cfgFile)) {
-        bFileOpen = true;
-        ret = &file;
-    } else {
-        bFileOpen = false;
+    pFile = &files[slot];
+    ret = lfs_file_opencfg(&lfs, &pFile->file, pathName, flags, &pFile->cfg);
+    if(LFS_ERR_OK != ret) {
+        pFile->bOpen = false;
+        return ret;
     }
+    pFile->lastSync = xTaskGetTickCount();
+    pFile->lastWrite = pFile->lastSync;
+    return LFS_SD_ID(slot, pFile->gen);
+}
+
+
+int32_t lfs_sd_fopen(const char * pathName)
+{
+    return lfs_sd_fopenFlags(pathName, LFS_O_CREAT | LFS_O_RDWR);
+}
+
+
+/* Bytes written to open files and not yet committed by a sync */
+static uint32_t lfs_sd_atRisk(void)
+{
+    uint32_t atRisk = 0;
+
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    for(uint32_t i = 0; i < LFS_SD_MAX_FILES; i++) {
+        if(files[i].bOpen) {
+            atRisk += files[i].unsynced;
+        }
+    }
+    xSemaphoreGiveRecursive(filesMutex);
+    return atRisk;
+}
+
+
+static int32_t lfs_sd_syncFile(LFS_SD_FILE_T * pFile)
+{
+    TickType_t tickStart;
+    uint32_t pending;
+    uint32_t ms;
+    int32_t ret;
+
+    /* Bytes written while the sync runs stay unsynced */
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    pending = pFile->unsynced;
+    xSemaphoreGiveRecursive(filesMutex);
+
+    tickStart = xTaskGetTickCount();
+    ret = lfs_file_sync(&lfs, &pFile->file);
+    ms = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+    if(ret == LFS_ERR_OK) {
+        lfs_sd_saveHint();
+    }
+
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    if(ret == LFS_ERR_OK) {
+        pFile->unsynced -= pending;
+    }
+    pFile->lastSync = xTaskGetTickCount();
+    syncStats.syncs++;
+    syncStats.syncMs += ms;
+    if(ms > syncStats.maxSyncMs) {
+        syncStats.maxSyncMs = ms;
+    }
+    xSemaphoreGiveRecursive(filesMutex);
     return ret;
 }
 
 
-int32_t lfs_sd_fwrite(const char * strData, size_t len)
+int32_t lfs_sd_fwrite(int32_t fd, const void * data, size_t len)
 {
-    if((NULL == strData) || (len == 0)) {
+    const TickType_t syncTicks = pdMS_TO_TICKS(syncPolicy.ms);
+    LFS_SD_FILE_T * pFile;
+    uint32_t atRisk;
+    bool bSync;
+    int32_t ret;
+
+    if((NULL == data) || (len == 0)) {
         LFS_SD_PRINTF("Error: invalid arg\r\n");
         return LFS_ERR_INVAL;
     }
-    if(bMount != true) {
-        LFS_SD_PRINTF("Error: LFS not mounted\r\n");
-        return LFS_ERR_IO;
+    pFile = lfs_sd_getFile(fd);
+    if(pFile == NULL) {
+        LFS_SD_PRINTF("Error: File not opened\r\n");
+        return LFS_ERR_BADF;
     }
-    if(bFileOpen != true) {
+    ret = lfs_file_write(&lfs, &pFile->file, data, len);
+    if(ret <= 0) {
+        return ret;
+    }
+    ioStats.appends++;
+    ioStats.appendBytes += ret;
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    pFile->unsynced += ret;
+    pFile->lastWrite = xTaskGetTickCount();
+    pFile->writer = xTaskGetCurrentTaskHandle();
+    atRisk = lfs_sd_atRisk();
+    if(atRisk > syncStats.maxAtRisk) {
+        syncStats.maxAtRisk = atRisk;
+    }
+    bSync = ((syncPolicy.mode == LFS_SD_SYNC_BYTES) && (pFile->unsynced >= syncPolicy.bytes)) ||
+            ((syncPolicy.mode == LFS_SD_SYNC_PERIOD) &&
+             ((pFile->lastWrite - pFile->lastSync) >= syncTicks));
+    xSemaphoreGiveRecursive(filesMutex);
+
+    if(bSync) {
+        const int32_t retSync = lfs_sd_syncFile(pFile);
+        if(retSync != LFS_ERR_OK) {
+            return retSync;
+        }
+    }
+    return ret;
+}
+
+
+int32_t lfs_sd_fsync(int32_t fd)
+{
+    LFS_SD_FILE_T * pFile = lfs_sd_getFile(fd);
+
+    if(pFile == NULL) {
         LFS_SD_PRINTF("Error: File not opened\r\n");
-        return LFS_ERR_IO;
+        return LFS_ERR_BADF;
+    }
+    return lfs_sd_syncFile(pFile);
+}
+
+
+void lfs_sd_syncPoll(void)
+{
+    const TickType_t syncTicks = pdMS_TO_TICKS(syncPolicy.ms);
+    const TickType_t now = xTaskGetTickCount();
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    LFS_SD_FILE_T * pFile;
+
+    if((bMount != true) ||
+       ((syncPolicy.mode != LFS_SD_SYNC_PERIOD) && (syncPolicy.mode != LFS_SD_SYNC_IDLE))) {
+        return;
+    }
+    /*
+     * Only handles this task wrote last, a sync must not run in the middle
+     * of another task's write sequence. Holds the pool lock so the file
+     * can not be closed under us.
+     */
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    for(uint32_t i = 0; i < LFS_SD_MAX_FILES; i++) {
+        pFile = &files[i];
+        if((pFile->bOpen != true) || (pFile->writer != self) || (pFile->unsynced == 0)) {
+            continue;
+        }
+        /* Period also covers a writer that went quiet before the deadline */
+        if(((syncPolicy.mode == LFS_SD_SYNC_PERIOD) && ((now - pFile->lastSync) >= syncTicks)) ||
+           ((syncPolicy.mode == LFS_SD_SYNC_IDLE) && ((now - pFile->lastWrite) >= syncTicks))) {
+            lfs_sd_syncFile(pFile);
+        }
+    }
+    xSemaphoreGiveRecursive(filesMutex);
+}
+
+
+void lfs_sd_setSyncPolicy(const LFS_SD_SYNC_POLICY_T * pPolicy)
+{
+    if((pPolicy != NULL) && (pPolicy->mode < N_LFS_SD_SYNC)) {
+        syncPolicy = *pPolicy;
+    }
+}
+
+
+const LFS_SD_SYNC_POLICY_T * lfs_sd_getSyncPolicy(void)
+{
+    return &syncPolicy;
+}
+
+
+const LFS_SD_SYNC_STATS_T * lfs_sd_getSyncStats(void)
+{
+    syncStats.atRisk = lfs_sd_atRisk();
+    return &syncStats;
+}
+
+
+void lfs_sd_resetSyncStats(void)
+{
+    memset(&syncStats, 0, sizeof(syncStats));
+}
+
+
+void lfs_sd_simPowerCut(void)
+{
+    if(bMount != true) {
+        return;
+    }
+    /*
+     * Drop the handles without closing them, unmount does not write
+     * anything. Unsynced file data is lost as on a power cut. Their
+     * owners get LFS_ERR_BADF from now on, see LFS_SD_ID().
+     */
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    for(int32_t fd = 0; fd < LFS_SD_MAX_FILES; fd++) {
+        files[fd].bOpen = false;
+        files[fd].unsynced = 0;
+        files[fd].writer = NULL;
+        memset(&files[fd].file, 0, sizeof(files[fd].file));
+    }
+    xSemaphoreGiveRecursive(filesMutex);
+    for(int32_t ring = 0; ring < LFS_SD_MAX_RINGS; ring++) {
+        rings[ring].bOpen = false;
     }
-    return lfs_file_write(&lfs, &file, strData, len);
+    lfs_unmount(&lfs);
+    bMount = false;
 }
 
 
-int32_t lfs_sd_fread(char * outBuffer, size_t bufLen)
+int32_t lfs_sd_fread(int32_t fd, void * outBuffer, size_t bufLen)
 {
+    LFS_SD_FILE_T * pFile;
+
     if((NULL == outBuffer) || (bufLen == 0)) {
         LFS_SD_PRINTF("Error: invalid arg\r\n");
         return LFS_ERR_INVAL;
     }
-    if(bMount != true) {
-        LFS_SD_PRINTF("Error: LFS not mounted\r\n");
-        return LFS_ERR_IO;
-    }
-    if(bFileOpen != true) {
+    pFile = lfs_sd_getFile(fd);
+    if(pFile == NULL) {
         LFS_SD_PRINTF("Error: File not opened\r\n");
-        return LFS_ERR_IO;
+        return LFS_ERR_BADF;
     }
-    return lfs_file_read(&lfs, &file, outBuffer, bufLen);
+    return lfs_file_read(&lfs, &pFile->file, outBuffer, bufLen);
 }
 
 
@@ -441,16 +937,503 @@ int32_t lfs_sd_rm(const char * path)
 }
 
 
-int32_t lfs_sd_fclose()
+int32_t lfs_sd_fclose(int32_t fd)
+{
+    LFS_SD_FILE_T * pFile = lfs_sd_getFile(fd);
+    int32_t ret;
+
+    if(pFile == NULL) {
+        return LFS_ERR_BADF;
+    }
+
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    ret = lfs_file_close(&lfs, &pFile->file);
+    memset(&pFile->file, 0, sizeof(pFile->file));
+    pFile->unsynced = 0;
+    pFile->writer = NULL;
+    pFile->bOpen = false;
+    xSemaphoreGiveRecursive(filesMutex);
+    return ret;
+}
+
+
+void lfs_sd_setEraseStrategy(LFS_SD_ERASE_T strategy)
+{
+    if(strategy < N_LFS_SD_ERASE) {
+        eraseStrategy = strategy;
+    }
+}
+
+
+LFS_SD_ERASE_T lfs_sd_getEraseStrategy(void)
 {
+    return eraseStrategy;
+}
+
+
+/*
+ * Writes nBlocks SD blocks of filler to a scratch file in 512-byte writes,
+ * like a logger appending records, and removes the file again.
+ */
+static int32_t lfs_sd_writeScratch(uint32_t nBlocks, TickType_t * pTicks)
+{
+    TickType_t tickStart;
+    int32_t fd;
     int32_t ret = LFS_ERR_OK;
-    if((bMount == false) || (bFileOpen == false)) {
+    int32_t retClose;
+
+    fd = lfs_sd_fopenFlags(LFS_SD_BENCH_FILE, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_TRUNC);
+    if(fd < 0) {
+        return fd;
+    }
+
+    memset(dummyBuffer, 0xA5, sizeof(dummyBuffer));
+    tickStart = xTaskGetTickCount();
+    for(uint32_t i = 0; i < nBlocks; i++) {
+        ret = lfs_sd_fwrite(fd, dummyBuffer, sizeof(dummyBuffer));
+        if(ret < 0) {
+            break;
+        }
+        ret = LFS_ERR_OK;
+    }
+    retClose = lfs_sd_fclose(fd);
+    *pTicks = xTaskGetTickCount() - tickStart;
+
+    lfs_remove(&lfs, LFS_SD_BENCH_FILE);
+    return (ret != LFS_ERR_OK) ? ret : retClose;
+}
+
+
+int32_t lfs_sd_allocBench(LFS_SD_ERASE_T strategy, uint32_t blocks,
+        LFS_SD_ALLOC_BENCH_T * pResult)
+{
+    const LFS_SD_ERASE_T prevStrategy = eraseStrategy;
+    TickType_t ticks = 0;
+    int32_t ret;
+
+    if((strategy >= N_LFS_SD_ERASE) || (blocks == 0) || (pResult == NULL)) {
+        return LFS_ERR_INVAL;
+    }
+
+    eraseStrategy = strategy;
+    eraseCount = 0;
+    eraseTicks = 0;
+    ret = lfs_sd_writeScratch(blocks * BLOCK_SIZE_FACTOR, &ticks);
+    pResult->totalMs = ticks * portTICK_PERIOD_MS;
+    pResult->erases = eraseCount;
+    pResult->eraseMs = eraseTicks * portTICK_PERIOD_MS;
+    eraseStrategy = prevStrategy;
+    return ret;
+}
+
+
+int32_t lfs_sd_setCacheSize(uint32_t size)
+{
+    if((size == 0) || (size > LFS_CACHE_SIZE) ||
+       ((size % SDCARD_BLOCK_SIZE) != 0) ||
+       (((SDCARD_BLOCK_SIZE * BLOCK_SIZE_FACTOR) % size) != 0)) {
+        return LFS_ERR_INVAL;
+    }
+    if(bInit != true) {
+        lfs_sd_init();
+    }
+    if(bMount) {
+        LFS_SD_PRINTF("Error: LFS mounted\r\n");
+        return LFS_ERR_IO;
+    }
+    cfg.cache_size = size;
+    return LFS_ERR_OK;
+}
+
+
+int32_t lfs_sd_setBlockDev(const LFS_SD_BDEV_T * pBdev)
+{
+    if(pBdev == NULL) {
+        pBdev = &sdDev;
+    }
+    if((pBdev->read == NULL) || (pBdev->prog == NULL) || (pBdev->trim == NULL) ||
+       (pBdev->sync == NULL) || (pBdev->getBlockCount == NULL)) {
+        return LFS_ERR_INVAL;
+    }
+    if(bInit != true) {
+        lfs_sd_init();
+    }
+    if(bMount) {
+        LFS_SD_PRINTF("Error: LFS mounted\r\n");
         return LFS_ERR_IO;
     }
+    pDev = pBdev;
+    cfg.block_count = pDev->getBlockCount() / BLOCK_SIZE_FACTOR;
+    return LFS_ERR_OK;
+}
+
+
+const LFS_SD_BDEV_T * lfs_sd_getSdBlockDev(void)
+{
+    return &sdDev;
+}
+
+
+const LFS_SD_IOSTAT_T * lfs_sd_getIoStats(void)
+{
+    return &ioStats;
+}
+
+
+void lfs_sd_resetIoStats(void)
+{
+    memset(&ioStats, 0, sizeof(ioStats));
+}
+
+
+uint32_t lfs_sd_getCacheSize(void)
+{
+    return (bInit == true) ? cfg.cache_size : LFS_CACHE_SIZE;
+}
+
+
+int32_t lfs_sd_writeBench(uint32_t kbytes, uint32_t * pMs)
+{
+    TickType_t ticks = 0;
+    int32_t ret;
+
+    if((kbytes == 0) || (pMs == NULL)) {
+        return LFS_ERR_INVAL;
+    }
+    ret = lfs_sd_writeScratch((kbytes * 1024) / SDCARD_BLOCK_SIZE, &ticks);
+    *pMs = ticks * portTICK_PERIOD_MS;
+    return ret;
+}
+
+
+/*
+ * Ring files. A ring is a directory of segCount segment files of
+ * LFS_SD_RING_SEGMENT bytes each, written once at creation and then
+ * overwritten in place. littlefs rewrites a file from the write position
+ * to its end, splitting the ring keeps that to one segment. head and tail
+ * live in a custom attribute of the directory, saved after the segment
+ * data is synced, so the header never points past committed data.
+ */
+static LFS_SD_RING_T * lfs_sd_getRing(int32_t ring)
+{
+    LFS_SD_RING_T * pRing;
+
+    if((ring < 0) || (LFS_SD_ID_SLOT(ring) >= LFS_SD_MAX_RINGS)) {
+        return NULL;
+    }
+    pRing = &rings[LFS_SD_ID_SLOT(ring)];
+    return (pRing->bOpen && (pRing->gen == LFS_SD_ID_GEN(ring))) ? pRing : NULL;
+}
+
+
+static void lfs_sd_ringSegName(const LFS_SD_RING_T * pRing, uint32_t seg,
+        char * name, size_t len)
+{
+    snprintf(name, len, "%s/%04lx", pRing->path, seg);
+}
+
+
+static int32_t lfs_sd_ringSaveHdr(LFS_SD_RING_T * pRing)
+{
+    return lfs_setattr(&lfs, pRing->path, LFS_SD_RING_ATTR,
+                       &pRing->hdr, sizeof(pRing->hdr));
+}
+
+
+/* Opens the segment holding head, positioned at head */
+static int32_t lfs_sd_ringOpenSeg(LFS_SD_RING_T * pRing)
+{
+    char name[LFS_SD_RING_PATH_MAX + 8];
+    lfs_soff_t pos;
+
+    lfs_sd_ringSegName(pRing, pRing->hdr.head / pRing->hdr.segSize, name, sizeof(name));
+    pRing->fd = lfs_sd_fopenFlags(name, LFS_O_RDWR);
+    if(pRing->fd < 0) {
+        return pRing->fd;
+    }
+    pos = lfs_file_seek(&lfs, &lfs_sd_getFile(pRing->fd)->file,
+                        pRing->hdr.head % pRing->hdr.segSize, LFS_SEEK_SET);
+    if(pos < 0) {
+        lfs_sd_fclose(pRing->fd);
+        pRing->fd = -1;
+        return pos;
+    }
+    return LFS_ERR_OK;
+}
+
 
-    ret = lfs_file_close(&lfs, &file);
-    memset(&file, 0, sizeof(file));
-    bFileOpen = false;
+static int32_t lfs_sd_ringCreate(LFS_SD_RING_T * pRing, uint32_t segCount)
+{
+    char name[LFS_SD_RING_PATH_MAX + 8];
+    int32_t ret;
+    int32_t fd;
+
+    ret = lfs_mkdir(&lfs, pRing->path);
+    if((ret != LFS_ERR_OK) && (ret != LFS_ERR_EXIST)) {
+        return ret;
+    }
+    ret = LFS_ERR_OK;
+    memset(dummyBuffer, 0, sizeof(dummyBuffer));
+    for(uint32_t seg = 0; seg < segCount; seg++) {
+        lfs_sd_ringSegName(pRing, seg, name, sizeof(name));
+        fd = lfs_sd_fopenFlags(name, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_TRUNC);
+        if(fd < 0) {
+            return fd;
+        }
+        for(uint32_t off = 0; (off < LFS_SD_RING_SEGMENT) && (ret >= 0); off += sizeof(dummyBuffer)) {
+            ret = lfs_sd_fwrite(fd, dummyBuffer, sizeof(dummyBuffer));
+        }
+        fd = lfs_sd_fclose(fd);
+        if(ret >= 0) {
+            ret = fd;
+        }
+        if(ret < 0) {
+            return ret;
+        }
+    }
+    /* Segments left over from a larger ring */
+    for(uint32_t seg = segCount; ; seg++) {
+        lfs_sd_ringSegName(pRing, seg, name, sizeof(name));
+        if(lfs_remove(&lfs, name) != LFS_ERR_OK) {
+            break;
+        }
+    }
+
+    pRing->hdr.magic = LFS_SD_RING_MAGIC;
+    pRing->hdr.segSize = LFS_SD_RING_SEGMENT;
+    pRing->hdr.segCount = segCount;
+    pRing->hdr.head = 0;
+    pRing->hdr.tail = 0;
+    return lfs_sd_ringSaveHdr(pRing);
+}
+
+
+int32_t lfs_sd_ringOpen(const char * path, uint32_t size)
+{
+    const uint32_t segCount = (size + LFS_SD_RING_SEGMENT - 1) / LFS_SD_RING_SEGMENT;
+    LFS_SD_RING_T * pRing;
+    uint32_t slot;
+    int32_t ret;
+
+    if((path == NULL) || (strlen(path) >= LFS_SD_RING_PATH_MAX) || (segCount < 2) ||
+       (segCount > (UINT32_MAX / LFS_SD_RING_SEGMENT))) {
+        return LFS_ERR_INVAL;
+    }
+    if(bMount != true) {
+        LFS_SD_PRINTF("Error: LFS not mounted\r\n");
+        return LFS_ERR_IO;
+    }
+
+    for(slot = 0; slot < LFS_SD_MAX_RINGS; slot++) {
+        if(rings[slot].bOpen != true) {
+            break;
+        }
+    }
+    if(slot == LFS_SD_MAX_RINGS) {
+        return LFS_ERR_NOMEM;
+    }
+    pRing = &rings[slot];
+    strcpy(pRing->path, path);
+    pRing->fd = -1;
+
+    ret = lfs_getattr(&lfs, path, LFS_SD_RING_ATTR, &pRing->hdr, sizeof(pRing->hdr));
+    if((ret != sizeof(pRing->hdr)) || (pRing->hdr.magic != LFS_SD_RING_MAGIC) ||
+       (pRing->hdr.segSize != LFS_SD_RING_SEGMENT) || (pRing->hdr.segCount != segCount)) {
+        LFS_SD_PRINTF("Preallocating ring %s, %lu segments\r\n", path, segCount);
+        ret = lfs_sd_ringCreate(pRing, segCount);
+        if(ret != LFS_ERR_OK) {
+            return ret;
+        }
+    }
+    ret = lfs_sd_ringOpenSeg(pRing);
+    if(ret != LFS_ERR_OK) {
+        return ret;
+    }
+    pRing->gen = (pRing->gen + 1) & LFS_SD_GEN_MASK;
+    pRing->bOpen = true;
+    return LFS_SD_ID(slot, pRing->gen);
+}
+
+
+int32_t lfs_sd_ringWrite(int32_t ring, const void * data, size_t len)
+{
+    LFS_SD_RING_T * pRing = lfs_sd_getRing(ring);
+    const uint8_t * pSrc = (const uint8_t *)data;
+    uint32_t capacity;
+    uint32_t seg;
+    size_t done = 0;
+    size_t n;
+    int32_t ret;
+
+    if((pRing == NULL) || (pRing->fd < 0)) {
+        return LFS_ERR_BADF;
+    }
+    if(data == NULL) {
+        return LFS_ERR_INVAL;
+    }
+    capacity = pRing->hdr.segSize * pRing->hdr.segCount;
+
+    while(done < len) {
+        n = pRing->hdr.segSize - (pRing->hdr.head % pRing->hdr.segSize);
+        if(n > (len - done)) {
+            n = len - done;
+        }
+        ret = lfs_sd_fwrite(pRing->fd, &pSrc[done], n);
+        if(ret <= 0) {
+            return (ret < 0) ? ret : (int32_t)done;
+        }
+        pRing->hdr.head = (pRing->hdr.head + ret) % capacity;
+        done += ret;
+
+        if((pRing->hdr.head % pRing->hdr.segSize) == 0) {
+            /* Segment full, the next one drops the oldest data it holds */
+            ret = lfs_sd_fclose(pRing->fd);
+            pRing->fd = -1;
+            if(ret != LFS_ERR_OK) {
+                return ret;
+            }
+            seg = pRing->hdr.head / pRing->hdr.segSize;
+            if((pRing->hdr.tail / pRing->hdr.segSize) == seg) {
+                pRing->hdr.tail = ((seg + 1) % pRing->hdr.segCount) * pRing->hdr.segSize;
+            }
+            ret = lfs_sd_ringSaveHdr(pRing);
+            if(ret == LFS_ERR_OK) {
+                ret = lfs_sd_ringOpenSeg(pRing);
+            }
+            if(ret != LFS_ERR_OK) {
+                return ret;
+            }
+        } else if(lfs_sd_getFile(pRing->fd)->unsynced == 0) {
+            /* The sync policy committed the segment */
+            ret = lfs_sd_ringSaveHdr(pRing);
+            if(ret != LFS_ERR_OK) {
+                return ret;
+            }
+        }
+    }
+    return (int32_t)done;
+}
+
+
+int32_t lfs_sd_ringSync(int32_t ring)
+{
+    LFS_SD_RING_T * pRing = lfs_sd_getRing(ring);
+    int32_t ret;
+
+    if((pRing == NULL) || (pRing->fd < 0)) {
+        return LFS_ERR_BADF;
+    }
+    ret = lfs_sd_fsync(pRing->fd);
+    if(ret != LFS_ERR_OK) {
+        return ret;
+    }
+    return lfs_sd_ringSaveHdr(pRing);
+}
+
+
+int32_t lfs_sd_ringRead(int32_t ring, uint32_t pos, void * outBuffer, size_t bufLen)
+{
+    LFS_SD_RING_T * pRing = lfs_sd_getRing(ring);
+    char name[LFS_SD_RING_PATH_MAX + 8];
+    uint8_t * pDst = (uint8_t *)outBuffer;
+    LFS_SD_FILE_T * pFile;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t off;
+    size_t done = 0;
+    size_t n;
+    int32_t fd;
+    int32_t ret = LFS_ERR_OK;
+
+    if(pRing == NULL) {
+        return LFS_ERR_BADF;
+    }
+    if(outBuffer == NULL) {
+        return LFS_ERR_INVAL;
+    }
+    capacity = pRing->hdr.segSize * pRing->hdr.segCount;
+    used = (pRing->hdr.head + capacity - pRing->hdr.tail) % capacity;
+    if(pos >= used) {
+        return 0;
+    }
+    if(bufLen > (used - pos)) {
+        bufLen = used - pos;
+    }
+    /*
+     * The segments are read through new handles, which only see what the
+     * head segment's handle has synced. Sync it first, under the pool lock
+     * so the handle can not be closed meanwhile.
+     */
+    xSemaphoreTakeRecursive(filesMutex, portMAX_DELAY);
+    pFile = lfs_sd_getFile(pRing->fd);
+    if((pFile != NULL) && (pFile->unsynced != 0)) {
+        ret = lfs_sd_ringSync(ring);
+    }
+    xSemaphoreGiveRecursive(filesMutex);
+    if(ret != LFS_ERR_OK) {
+        return ret;
+    }
+
+    while((done < bufLen) && (ret >= 0)) {
+        off = (pRing->hdr.tail + pos + done) % capacity;
+        n = pRing->hdr.segSize - (off % pRing->hdr.segSize);
+        if(n > (bufLen - done)) {
+            n = bufLen - done;
+        }
+        lfs_sd_ringSegName(pRing, off / pRing->hdr.segSize, name, sizeof(name));
+        fd = lfs_sd_fopenFlags(name, LFS_O_RDONLY);
+        if(fd < 0) {
+            return fd;
+        }
+        ret = lfs_file_seek(&lfs, &lfs_sd_getFile(fd)->file, off % pRing->hdr.segSize, LFS_SEEK_SET);
+        if(ret >= 0) {
+            ret = lfs_sd_fread(fd, &pDst[done], n);
+        }
+        lfs_sd_fclose(fd);
+        if(ret > 0) {
+            done += ret;
+        } else if(ret == 0) {
+            break;
+        }
+    }
+    return (ret < 0) ? ret : (int32_t)done;
+}
+
+
+int32_t lfs_sd_ringInfo(int32_t ring, LFS_SD_RING_INFO_T * pInfo)
+{
+    LFS_SD_RING_T * pRing = lfs_sd_getRing(ring);
+
+    if(pRing == NULL) {
+        return LFS_ERR_BADF;
+    }
+    if(pInfo == NULL) {
+        return LFS_ERR_INVAL;
+    }
+    pInfo->capacity = pRing->hdr.segSize * pRing->hdr.segCount;
+    pInfo->head = pRing->hdr.head;
+    pInfo->tail = pRing->hdr.tail;
+    pInfo->used = (pRing->hdr.head + pInfo->capacity - pRing->hdr.tail) % pInfo->capacity;
+    return LFS_ERR_OK;
+}
+
+
+int32_t lfs_sd_ringClose(int32_t ring)
+{
+    LFS_SD_RING_T * pRing = lfs_sd_getRing(ring);
+    int32_t ret = LFS_ERR_OK;
+
+    if(pRing == NULL) {
+        return LFS_ERR_BADF;
+    }
+    if(pRing->fd >= 0) {
+        ret = lfs_sd_fclose(pRing->fd);
+        pRing->fd = -1;
+    }
+    if(ret == LFS_ERR_OK) {
+        ret = lfs_sd_ringSaveHdr(pRing);
+    }
+    pRing->bOpen = false;
     return ret;
 }
 
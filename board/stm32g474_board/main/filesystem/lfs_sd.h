@@ -14,21 +14,172 @@
 
 #include "lfs.h"
 
+/* lfs_sd_umount() with files or rings still open */
+#define LFS_SD_ERR_BUSY             (-16)
+
+typedef enum {
+    LFS_SD_ERASE_NONE = 0,      // erase is a no-op
+    LFS_SD_ERASE_TRIM,          // CMD38 range erase
+    LFS_SD_ERASE_FILL,          // write 0xFF to every SD block
+    N_LFS_SD_ERASE
+} LFS_SD_ERASE_T;
+
+typedef enum {
+    LFS_SD_SYNC_CLOSE = 0,      // only on close or lfs_sd_fsync()
+    LFS_SD_SYNC_BYTES,          // when a file has bytes unsynced
+    LFS_SD_SYNC_PERIOD,         // ms after the last sync of a file
+    LFS_SD_SYNC_IDLE,           // ms after the last write to a file
+    N_LFS_SD_SYNC
+} LFS_SD_SYNC_T;
+
+typedef struct {
+    LFS_SD_SYNC_T mode;
+    uint32_t bytes;
+    uint32_t ms;
+} LFS_SD_SYNC_POLICY_T;
+
+typedef struct {
+    uint32_t atRisk;            // unsynced bytes in open files, now
+    uint32_t maxAtRisk;         // highest atRisk seen
+    uint32_t syncs;
+    uint32_t syncMs;            // total time spent syncing
+    uint32_t maxSyncMs;
+} LFS_SD_SYNC_STATS_T;
+
+typedef struct {
+    uint32_t erases;            // littlefs block erases
+    uint32_t eraseMs;           // time spent in them
+    uint32_t totalMs;           // whole write pass
+} LFS_SD_ALLOC_BENCH_T;
+
+/*
+ * Block device below littlefs, addressed in 512-byte SD blocks. Functions
+ * return 0 or a negative error. The SD card (through blockdev when it is
+ * enabled) is the default, a model can be put in its place to measure the
+ * filesystem against other card timings.
+ */
+typedef struct {
+    int32_t (*read)(uint32_t lba, void * pBuff, uint32_t count);
+    int32_t (*prog)(uint32_t lba, const void * pBuff, uint32_t count);
+    int32_t (*trim)(uint32_t lba, uint32_t count);
+    int32_t (*sync)(void);
+    uint32_t (*getBlockCount)(void);
+} LFS_SD_BDEV_T;
+
+/*
+ * I/O cost of the littlefs callbacks. Blocks are 512-byte SD blocks, times
+ * are spent in the block device. appends are the lfs_sd_fwrite() calls the
+ * physical I/O is paid for.
+ */
+typedef struct {
+    uint32_t reads;
+    uint32_t readBlocks;
+    uint64_t readUs;
+    uint32_t progs;
+    uint32_t progBlocks;        // SD blocks written, fill erases included
+    uint64_t progUs;
+    uint32_t erases;            // littlefs block erases
+    uint32_t eraseBlocks;       // SD blocks trimmed or filled
+    uint64_t eraseUs;
+    uint32_t syncs;
+    uint64_t syncUs;
+    uint32_t appends;
+    uint64_t appendBytes;
+} LFS_SD_IOSTAT_T;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t used;              // bytes between tail and head
+} LFS_SD_RING_INFO_T;
+
+typedef struct {
+    uint32_t mountMs;           // last lfs_sd_mount(), hint included
+    bool bHint;                 // a saved allocator hint was used
+    uint32_t allocStart;        // block the first allocation scan starts at
+} LFS_SD_MOUNT_STATS_T;
+
 int32_t lfs_sd_format();
 struct lfs_config * lfs_sd_stat();
 lfs_t * lfs_sd_mount();
+/* Fails with LFS_SD_ERR_BUSY while files or rings are open */
 int32_t lfs_sd_umount();
+const LFS_SD_MOUNT_STATS_T * lfs_sd_getMountStats(void);
 int32_t lfs_sd_df();
 int32_t lfs_sd_capacity();
 int32_t lfs_sd_mkdir(const char * path);
 int32_t lfs_sd_ls(const char * path, char * outBuffer, size_t bufferLen);
 
-lfs_file_t * lfs_sd_fopen(const char * pathName);
-int32_t lfs_sd_fwrite(const char * strData, size_t len);
-int32_t lfs_sd_fread(char * outBuffer, size_t bufLen);
+/*
+ * Files are opened from a pool of CONFIG_LFS_SD_MAX_OPEN_FILES handles,
+ * each with its own cache. lfs_sd_fopen() returns the descriptor (>= 0)
+ * or a negative LFS_ERR_* value, LFS_ERR_NOMEM when no handle is free.
+ * Descriptors are not small indexes, a stale one fails with LFS_ERR_BADF.
+ */
+int32_t lfs_sd_fopen(const char * pathName);
+/* flags are LFS_O_* open flags */
+int32_t lfs_sd_fopenFlags(const char * pathName, int flags);
+int32_t lfs_sd_fwrite(int32_t fd, const void * data, size_t len);
+int32_t lfs_sd_fsync(int32_t fd);
+int32_t lfs_sd_fread(int32_t fd, void * outBuffer, size_t bufLen);
 int32_t lfs_sd_mv(const char * source, const char * target);
 int32_t lfs_sd_rm(const char * path);
-int32_t lfs_sd_fclose();
+int32_t lfs_sd_fclose(int32_t fd);
+
+/*
+ * Sync policy. BYTES and PERIOD are checked by lfs_sd_fwrite(), PERIOD and
+ * IDLE deadlines of files nobody writes to need lfs_sd_syncPoll() to be
+ * called periodically. lfs_sd_syncPoll() only syncs the files last written
+ * by the calling task, so each writing task polls its own.
+ */
+void lfs_sd_syncPoll(void);
+void lfs_sd_setSyncPolicy(const LFS_SD_SYNC_POLICY_T * pPolicy);
+const LFS_SD_SYNC_POLICY_T * lfs_sd_getSyncPolicy(void);
+const LFS_SD_SYNC_STATS_T * lfs_sd_getSyncStats(void);
+void lfs_sd_resetSyncStats(void);
+/*
+ * Fixed-size ring log at path (a directory), size rounded up to whole
+ * CONFIG_LFS_SD_RING_SEGMENT_SIZE segments, at least two. Created and
+ * preallocated on first open or when the size changes, then overwritten
+ * in place, dropping the oldest segment when full. lfs_sd_ringOpen()
+ * returns the ring (>= 0), the ring uses one file handle while open.
+ */
+int32_t lfs_sd_ringOpen(const char * path, uint32_t size);
+int32_t lfs_sd_ringWrite(int32_t ring, const void * data, size_t len);
+int32_t lfs_sd_ringSync(int32_t ring);
+/* pos counts from the oldest byte kept, unsynced ring data is synced first */
+int32_t lfs_sd_ringRead(int32_t ring, uint32_t pos, void * outBuffer, size_t bufLen);
+int32_t lfs_sd_ringInfo(int32_t ring, LFS_SD_RING_INFO_T * pInfo);
+int32_t lfs_sd_ringClose(int32_t ring);
+
+/* Test hook: forgets open files without syncing them and unmounts */
+void lfs_sd_simPowerCut(void);
+
+void lfs_sd_setEraseStrategy(LFS_SD_ERASE_T strategy);
+LFS_SD_ERASE_T lfs_sd_getEraseStrategy(void);
+/*
+ * Writes blocks littlefs blocks to a scratch file with the given erase
+ * strategy and removes it again. Needs a mounted filesystem and a free
+ * file handle. The erase strategy is restored afterwards.
+ */
+int32_t lfs_sd_allocBench(LFS_SD_ERASE_T strategy, uint32_t blocks,
+        LFS_SD_ALLOC_BENCH_T * pResult);
+
+/*
+ * Cache size for read, prog and file caches, a multiple of 512 up to
+ * CONFIG_LFS_SD_CACHE_SIZE. Only while unmounted, applies from the next
+ * mount.
+ */
+int32_t lfs_sd_setCacheSize(uint32_t size);
+uint32_t lfs_sd_getCacheSize(void);
+/* Only while unmounted, NULL restores the SD card */
+int32_t lfs_sd_setBlockDev(const LFS_SD_BDEV_T * pBdev);
+const LFS_SD_BDEV_T * lfs_sd_getSdBlockDev(void);
+const LFS_SD_IOSTAT_T * lfs_sd_getIoStats(void);
+void lfs_sd_resetIoStats(void);
+/* Writes kbytes to a scratch file in 512-byte writes, needs a mounted filesystem */
+int32_t lfs_sd_writeBench(uint32_t kbytes, uint32_t * pMs);
 
 #endif /* CONFIG_USE_LFS_SD */
 #endif /* FILESYSTEM_LFS_SD_H_ */
@@ -0,0 +1,356 @@
+/*
+ * lfs_writer.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_LFS_WRITER
+
+#include "string.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stm32g4xx.h"
+#include "lfs.h"
+#include "lfs_sd.h"
+#include "lfs_writer.h"
+#include "test_lfs_writer.h"
+
+#define LFS_WRITER_TASK_STACK_SIZE      (512)
+#define LFS_WRITER_TASK_PRIORITY        (CONFIG_LFS_WRITER_TASK_PRIORITY)
+#define LFS_WRITER_BUF_SIZE             (CONFIG_LFS_WRITER_BUF_SIZE)
+#define LFS_WRITER_BUF_COUNT            (CONFIG_LFS_WRITER_BUF_COUNT)
+#define LFS_WRITER_FLUSH_TICKS          (pdMS_TO_TICKS(CONFIG_LFS_WRITER_FLUSH_MS))
+#define LFS_WRITER_POLL_TICKS           ((LFS_WRITER_FLUSH_TICKS / 4) + 1)
+#define LFS_WRITER_IO_RETRIES           (3)     // per buffer, then it is dropped
+
+#if (LFS_WRITER_BUF_SIZE % 512) != 0
+#error "Writer buffer size must be a multiple of 512"
+#endif
+
+/*
+ * Single producer, single consumer ring of buffers. The producer fills
+ * buf[head % N] and publishes it by incrementing head, the writer task
+ * writes buf[tail % N] to littlefs and releases it by incrementing tail.
+ * Each index is only written by one side, no lock is needed.
+ */
+typedef struct {
+    volatile bool bOpen;
+    int32_t fd;
+    uint8_t buf[LFS_WRITER_BUF_COUNT][LFS_WRITER_BUF_SIZE];
+    uint32_t len[LFS_WRITER_BUF_COUNT];
+    volatile uint32_t head;     // buffers published, producer only
+    volatile uint32_t tail;     // buffers written, writer only
+    volatile uint32_t fill;     // bytes in buf[head % N], producer only
+    volatile bool flushReq;     // writer asks to publish a partial buffer
+    volatile bool closeReq;
+    uint32_t retries;           // of the buffer at tail, writer only
+    TickType_t lastPublish;
+    int32_t closeStatus;
+    SemaphoreHandle_t semClosed;
+    StaticSemaphore_t semClosedStruct;
+    LFS_WRITER_STATS_T stats;
+} LFS_WRITER_STREAM_T;
+
+static bool bInit = false;
+static TaskHandle_t taskHandle_writer = NULL;
+static StaticTask_t taskStruct_writer;
+static StackType_t taskStackStorage[LFS_WRITER_TASK_STACK_SIZE];
+static SemaphoreHandle_t semWork = NULL;
+static StaticSemaphore_t semWorkStruct;
+static SemaphoreHandle_t mutexHandle = NULL;   // open/close only
+static StaticSemaphore_t mutexStruct;
+static LFS_WRITER_STREAM_T streams[LFS_WRITER_STREAM_COUNT];
+
+
+static LFS_WRITER_STREAM_T * LFS_WRITER_GetStream(int32_t stream)
+{
+    if((stream < 0) || (stream >= LFS_WRITER_STREAM_COUNT) ||
+       (streams[stream].bOpen != true)) {
+        return NULL;
+    }
+    return &streams[stream];
+}
+
+
+/* Producer side */
+static void LFS_WRITER_Publish(LFS_WRITER_STREAM_T * pStream)
+{
+    pStream->len[pStream->head % LFS_WRITER_BUF_COUNT] = pStream->fill;
+    pStream->fill = 0;
+    pStream->flushReq = false;
+    pStream->lastPublish = xTaskGetTickCount();
+    /* Buffer contents must be visible before the new head */
+    __DMB();
+    pStream->head++;
+    if((pStream->head - pStream->tail) > pStream->stats.maxBuffers) {
+        pStream->stats.maxBuffers = pStream->head - pStream->tail;
+    }
+    xSemaphoreGive(semWork);
+}
+
+
+/*
+ * Writer side, returns true if a buffer was written or dropped. A buffer
+ * failing with LFS_ERR_IO, which includes a timeout on the filesystem
+ * lock, stays in the ring and is tried again LFS_WRITER_IO_RETRIES times.
+ * lfs_sd_fwrite() applies the sync policy.
+ */
+static bool LFS_WRITER_Drain(LFS_WRITER_STREAM_T * pStream)
+{
+    const uint32_t idx = pStream->tail % LFS_WRITER_BUF_COUNT;
+    TickType_t tickStart;
+    int32_t ret;
+
+    if(pStream->tail == pStream->head) {
+        return false;
+    }
+    __DMB();
+
+    tickStart = xTaskGetTickCount();
+    ret = lfs_sd_fwrite(pStream->fd, pStream->buf[idx], pStream->len[idx]);
+    tickStart = xTaskGetTickCount() - tickStart;
+    if((tickStart * portTICK_PERIOD_MS) > pStream->stats.maxWriteMs) {
+        pStream->stats.maxWriteMs = tickStart * portTICK_PERIOD_MS;
+    }
+    if((ret == LFS_ERR_IO) && (pStream->retries < LFS_WRITER_IO_RETRIES)) {
+        pStream->retries++;
+        pStream->stats.retries++;
+        return false;
+    }
+    pStream->retries = 0;
+    if(ret < 0) {
+        pStream->stats.droppedBytes += pStream->len[idx];
+        if(pStream->stats.error == LFS_ERR_OK) {
+            pStream->stats.error = ret;
+        }
+    } else {
+        pStream->stats.bytesWritten += ret;
+    }
+
+    /* Done with the buffer before handing it back */
+    __DMB();
+    pStream->tail++;
+    return true;
+}
+
+
+static void LFS_WRITER_Service(LFS_WRITER_STREAM_T * pStream)
+{
+    TickType_t now;
+
+    while(LFS_WRITER_Drain(pStream));
+
+    now = xTaskGetTickCount();
+    if(pStream->closeReq) {
+        /* Buffers published just before the close request */
+        __DMB();
+        while(pStream->tail != pStream->head) {
+            if(LFS_WRITER_Drain(pStream) != true) {
+                /* Retries are bounded, the ring empties */
+                vTaskDelay(LFS_WRITER_POLL_TICKS);
+            }
+        }
+        pStream->closeStatus = lfs_sd_fclose(pStream->fd);
+        if(pStream->closeStatus == LFS_ERR_OK) {
+            pStream->closeStatus = pStream->stats.error;
+        }
+        pStream->closeReq = false;
+        pStream->bOpen = false;
+        xSemaphoreGive(pStream->semClosed);
+        return;
+    }
+    /*
+     * A producer that stopped writing would keep its partial buffer
+     * forever, ask it to publish on its next write or flush.
+     */
+    if((pStream->fill != 0) && ((now - pStream->lastPublish) >= LFS_WRITER_FLUSH_TICKS)) {
+        pStream->flushReq = true;
+    }
+}
+
+
+static void LFS_WRITER_Task(void * pvParam)
+{
+    while(bInit != true) {
+        vTaskDelay(1);
+    }
+
+    while(1) {
+        xSemaphoreTake(semWork, LFS_WRITER_POLL_TICKS);
+        for(uint32_t i = 0; i < LFS_WRITER_STREAM_COUNT; i++) {
+            if(streams[i].bOpen) {
+                LFS_WRITER_Service(&streams[i]);
+            }
+        }
+        lfs_sd_syncPoll();
+    }
+}
+
+
+void LFS_WRITER_init(void)
+{
+    if(bInit == true) {
+        return;
+    }
+
+    memset(streams, 0, sizeof(streams));
+    for(uint32_t i = 0; i < LFS_WRITER_STREAM_COUNT; i++) {
+        streams[i].fd = -1;
+        streams[i].semClosed = xSemaphoreCreateBinaryStatic(&streams[i].semClosedStruct);
+        configASSERT(streams[i].semClosed != NULL);
+    }
+    semWork = xSemaphoreCreateBinaryStatic(&semWorkStruct);
+    configASSERT(semWork != NULL);
+    mutexHandle = xSemaphoreCreateMutexStatic(&mutexStruct);
+    configASSERT(mutexHandle != NULL);
+
+    taskHandle_writer = xTaskCreateStatic(LFS_WRITER_Task,
+                                    "lfs_writer",
+                                    LFS_WRITER_TASK_STACK_SIZE,
+                                    (void *)0,
+                                    LFS_WRITER_TASK_PRIORITY,
+                                    taskStackStorage,
+                                    &taskStruct_writer);
+    configASSERT(taskHandle_writer != NULL);
+
+#if CONFIG_TEST_LFS_WRITER
+    TEST_LFS_WRITER_init();
+#endif
+
+    bInit = true;
+}
+
+
+int32_t LFS_WRITER_open(const char * path)
+{
+    LFS_WRITER_STREAM_T * pStream;
+    int32_t stream;
+    int32_t fd;
+
+    if(path == NULL) {
+        return LFS_ERR_INVAL;
+    }
+    if(bInit != true) {
+        return LFS_ERR_IO;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    for(stream = 0; stream < LFS_WRITER_STREAM_COUNT; stream++) {
+        if(streams[stream].bOpen != true) {
+            break;
+        }
+    }
+    if(stream == LFS_WRITER_STREAM_COUNT) {
+        xSemaphoreGive(mutexHandle);
+        return LFS_ERR_NOMEM;
+    }
+    fd = lfs_sd_fopenFlags(path, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_APPEND);
+    if(fd < 0) {
+        xSemaphoreGive(mutexHandle);
+        return fd;
+    }
+
+    pStream = &streams[stream];
+    pStream->fd = fd;
+    pStream->head = 0;
+    pStream->tail = 0;
+    pStream->fill = 0;
+    pStream->flushReq = false;
+    pStream->closeReq = false;
+    pStream->retries = 0;
+    pStream->lastPublish = xTaskGetTickCount();
+    memset(&pStream->stats, 0, sizeof(pStream->stats));
+    __DMB();
+    pStream->bOpen = true;
+    xSemaphoreGive(mutexHandle);
+    return stream;
+}
+
+
+size_t LFS_WRITER_write(int32_t stream, const void * data, size_t len)
+{
+    LFS_WRITER_STREAM_T * pStream = LFS_WRITER_GetStream(stream);
+    const uint8_t * pSrc = (const uint8_t *)data;
+    size_t done = 0;
+    size_t n;
+
+    if((pStream == NULL) || (data == NULL) || pStream->closeReq) {
+        return 0;
+    }
+
+    while(done < len) {
+        if((pStream->head - pStream->tail) >= LFS_WRITER_BUF_COUNT) {
+            /* Every buffer is waiting for the writer task */
+            pStream->stats.overflowBytes += len - done;
+            pStream->stats.overflows++;
+            break;
+        }
+        n = LFS_WRITER_BUF_SIZE - pStream->fill;
+        if(n > (len - done)) {
+            n = len - done;
+        }
+        memcpy(&pStream->buf[pStream->head % LFS_WRITER_BUF_COUNT][pStream->fill],
+               &pSrc[done], n);
+        pStream->fill += n;
+        done += n;
+        if(pStream->fill == LFS_WRITER_BUF_SIZE) {
+            LFS_WRITER_Publish(pStream);
+        }
+    }
+    pStream->stats.bytesIn += done;
+
+    if(pStream->flushReq && (pStream->fill != 0)) {
+        LFS_WRITER_Publish(pStream);
+    }
+    return done;
+}
+
+
+void LFS_WRITER_flush(int32_t stream)
+{
+    LFS_WRITER_STREAM_T * pStream = LFS_WRITER_GetStream(stream);
+
+    if((pStream != NULL) && (pStream->fill != 0)) {
+        LFS_WRITER_Publish(pStream);
+    }
+}
+
+
+int32_t LFS_WRITER_close(int32_t stream)
+{
+    LFS_WRITER_STREAM_T * pStream = LFS_WRITER_GetStream(stream);
+
+    if(pStream == NULL) {
+        return LFS_ERR_BADF;
+    }
+
+    LFS_WRITER_flush(stream);
+    pStream->closeReq = true;
+    xSemaphoreGive(semWork);
+    xSemaphoreTake(pStream->semClosed, portMAX_DELAY);
+    return pStream->closeStatus;
+}
+
+
+const LFS_WRITER_STATS_T * LFS_WRITER_getStats(int32_t stream)
+{
+    if((stream < 0) || (stream >= LFS_WRITER_STREAM_COUNT)) {
+        return NULL;
+    }
+    return &streams[stream].stats;
+}
+
+
+void LFS_WRITER_resetStats(int32_t stream)
+{
+    if((stream < 0) || (stream >= LFS_WRITER_STREAM_COUNT)) {
+        return;
+    }
+    memset(&streams[stream].stats, 0, sizeof(streams[stream].stats));
+}
+
+#endif /* CONFIG_USE_LFS_WRITER */
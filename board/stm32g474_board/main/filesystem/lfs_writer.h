@@ -0,0 +1,53 @@
+/*
+ * lfs_writer.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef FILESYSTEM_LFS_WRITER_H_
+#define FILESYSTEM_LFS_WRITER_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_LFS_WRITER
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+#define LFS_WRITER_STREAM_COUNT         (CONFIG_LFS_WRITER_STREAMS)
+
+typedef struct {
+    uint32_t bytesIn;           // accepted from the producer
+    uint32_t bytesWritten;      // handed to littlefs
+    uint32_t overflowBytes;     // dropped, ring full
+    uint32_t overflows;         // writes that dropped data
+    uint32_t droppedBytes;      // dropped, littlefs error
+    uint32_t retries;           // buffer writes tried again after LFS_ERR_IO
+    uint32_t maxBuffers;        // ring high watermark
+    uint32_t maxWriteMs;        // longest littlefs write of one buffer
+    int32_t error;              // first littlefs error
+} LFS_WRITER_STATS_T;
+
+void LFS_WRITER_init(void);
+/*
+ * Opens path for appending on a free stream. Returns the stream (>= 0)
+ * or a negative LFS_ERR_* value. Each stream has a single producer task.
+ */
+int32_t LFS_WRITER_open(const char * path);
+/*
+ * Copies data into the stream ring and returns without touching the SD
+ * card. Returns the number of bytes accepted, the rest is counted as
+ * overflow.
+ */
+size_t LFS_WRITER_write(int32_t stream, const void * data, size_t len);
+/* Hands a partially filled buffer to the writer task */
+void LFS_WRITER_flush(int32_t stream);
+/* Drains the ring, closes the file and returns the first error */
+int32_t LFS_WRITER_close(int32_t stream);
+const LFS_WRITER_STATS_T * LFS_WRITER_getStats(int32_t stream);
+void LFS_WRITER_resetStats(int32_t stream);
+
+#endif /* CONFIG_USE_LFS_WRITER */
+#endif /* FILESYSTEM_LFS_WRITER_H_ */
@@ -0,0 +1,394 @@
+/*
+ * rawlog.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_RAWLOG
+
+#include "string.h"
+#include "stddef.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "lfs.h"
+#include "rawlog.h"
+#include "test_rawlog.h"
+#include "blockdev/blockdev.h"
+
+#define RAWLOG_MAGIC                (0x474F4C52)    // "RLOG"
+#define RAWLOG_CRC_INIT             (0xFFFFFFFF)
+#define RAWLOG_SCAN_PROBE           (4)             // torn chunks skipped by the scan
+
+static bool bInit = false;
+static SemaphoreHandle_t mutexHandle = NULL;
+static StaticSemaphore_t mutexStruct;
+static RAWLOG_INFO_T info = {0};
+static uint32_t fill = 0;           // payload bytes in chunkBuf
+static uint32_t chunkBuf[RAWLOG_CHUNK_SIZE / sizeof(uint32_t)];
+static uint32_t blockBuf[SDCARD_BLOCK_SIZE / sizeof(uint32_t)];
+
+
+static int32_t RAWLOG_ReadBlocks(uint32_t lba, void * pBuff, uint32_t count)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_read(BLOCKDEV_CLIENT_RAWLOG, lba, pBuff, count);
+#else
+    return SDCARD_ReadMultiBlock(lba, pBuff, count);
+#endif
+}
+
+
+/* One CMD25 per chunk, or runs of up to CONFIG_BLOCKDEV_MAX_RUN blocks */
+static int32_t RAWLOG_WriteBlocks(uint32_t lba, const void * pBuff, uint32_t count)
+{
+#if CONFIG_USE_BLOCKDEV
+    return BLOCKDEV_write(BLOCKDEV_CLIENT_RAWLOG, lba, pBuff, count);
+#else
+    return SDCARD_WriteMultiBlock(lba, pBuff, count);
+#endif
+}
+
+
+static uint32_t RAWLOG_ChunkLba(uint32_t idx)
+{
+    return info.firstLba + (idx * RAWLOG_CHUNK_BLOCKS);
+}
+
+
+/* Chunk index of the n-th valid chunk, oldest first */
+static uint32_t RAWLOG_ChunkIdx(uint32_t n)
+{
+    return (info.head + info.chunks - info.used + n) % info.chunks;
+}
+
+
+static uint32_t RAWLOG_HdrCrc(const RAWLOG_HDR_T * pHdr)
+{
+    return lfs_crc(RAWLOG_CRC_INIT, pHdr, offsetof(RAWLOG_HDR_T, hdrCrc));
+}
+
+
+/* Reads the first block of a chunk into blockBuf, false if no valid header */
+static bool RAWLOG_ReadHdr(uint32_t idx, RAWLOG_HDR_T * pHdr)
+{
+    info.scanReads++;
+    if(RAWLOG_ReadBlocks(RAWLOG_ChunkLba(idx), blockBuf, 1) != SDCARD_ERR_NONE) {
+        return false;
+    }
+    memcpy(pHdr, blockBuf, sizeof(RAWLOG_HDR_T));
+    return (pHdr->magic == RAWLOG_MAGIC) && (pHdr->len <= RAWLOG_PAYLOAD_SIZE) &&
+           (pHdr->hdrCrc == RAWLOG_HdrCrc(pHdr));
+}
+
+
+/*
+ * First valid header in idx..end-1, looking at most RAWLOG_SCAN_PROBE
+ * chunks ahead. A reset leaves at most that many torn chunks.
+ */
+static bool RAWLOG_Probe(uint32_t idx, uint32_t end, RAWLOG_HDR_T * pHdr, uint32_t * pIdx)
+{
+    for(uint32_t i = idx; (i < end) && (i < (idx + RAWLOG_SCAN_PROBE)); i++) {
+        if(RAWLOG_ReadHdr(i, pHdr)) {
+            *pIdx = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Chunk i of the current lap holds seq base + i, chunk i of the previous
+ * lap base + i - chunks, so seq - i is constant within a lap. Binary
+ * search for the last chunk of the lap of the first valid chunk, torn
+ * chunks are skipped. The head goes right after it and the sequence
+ * continues from there, seq stays monotonic across a tear.
+ */
+static void RAWLOG_Scan(void)
+{
+    RAWLOG_HDR_T hdr;
+    uint32_t first;
+    uint32_t lap;
+    uint32_t lastSeq;
+    uint32_t idx;
+    uint32_t lo;
+    uint32_t hi = info.chunks;
+    uint32_t mid;
+
+    info.scanReads = 0;
+    info.head = 0;
+    info.seq = 0;
+    info.used = 0;
+    if(RAWLOG_Probe(0, info.chunks, &hdr, &first) != true) {
+        /* Empty */
+        return;
+    }
+    lap = hdr.seq - first;
+    lastSeq = hdr.seq;
+    lo = first;
+    while((hi - lo) > 1) {
+        mid = lo + ((hi - lo) / 2);
+        if(RAWLOG_Probe(mid, hi, &hdr, &idx) && ((hdr.seq - idx) == lap)) {
+            lo = idx;
+            lastSeq = hdr.seq;
+        } else {
+            hi = mid;
+        }
+    }
+    info.head = (lo + 1) % info.chunks;
+    info.seq = lastSeq + 1;
+    info.used = lo - first + 1;
+    /* Past torn chunks the rest of the region may be the previous lap */
+    if((info.head != 0) && RAWLOG_Probe(info.head, info.chunks, &hdr, &idx) &&
+       ((hdr.seq - idx) == (lap - info.chunks))) {
+        info.used += info.chunks - idx;
+    }
+}
+
+
+static int32_t RAWLOG_Seal(void)
+{
+    RAWLOG_HDR_T * pHdr = (RAWLOG_HDR_T *)chunkBuf;
+    const uint8_t * pPayload = (const uint8_t *)chunkBuf + RAWLOG_HDR_SIZE;
+    const uint32_t count = (RAWLOG_HDR_SIZE + fill + SDCARD_BLOCK_SIZE - 1) / SDCARD_BLOCK_SIZE;
+    TickType_t tickStart;
+    int32_t ret;
+
+    memset(pHdr, 0, RAWLOG_HDR_SIZE);
+    pHdr->magic = RAWLOG_MAGIC;
+    pHdr->seq = info.seq;
+    pHdr->tick = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    pHdr->len = fill;
+    pHdr->crc = lfs_crc(RAWLOG_CRC_INIT, pPayload, fill);
+    pHdr->hdrCrc = RAWLOG_HdrCrc(pHdr);
+
+    /* Only the blocks holding data, the header tells where it ends */
+    tickStart = xTaskGetTickCount();
+    ret = RAWLOG_WriteBlocks(RAWLOG_ChunkLba(info.head), chunkBuf, count);
+    tickStart = xTaskGetTickCount() - tickStart;
+    if((tickStart * portTICK_PERIOD_MS) > info.maxWriteMs) {
+        info.maxWriteMs = tickStart * portTICK_PERIOD_MS;
+    }
+    if(ret != SDCARD_ERR_NONE) {
+        if(info.error == RAWLOG_ERR_NONE) {
+            info.error = ret;
+        }
+        return ret;
+    }
+
+    info.chunksWritten++;
+    info.head = (info.head + 1) % info.chunks;
+    info.seq++;
+    if(info.used < info.chunks) {
+        info.used++;
+    }
+    fill = 0;
+    return RAWLOG_ERR_NONE;
+}
+
+
+int32_t RAWLOG_init(void)
+{
+    const TickType_t tickStart = xTaskGetTickCount();
+    const uint32_t cardBlocks = SDCARD_GetBlockCount();
+
+    if(bInit) {
+        return RAWLOG_ERR_NONE;
+    }
+    if(cardBlocks <= (RAWLOG_BLOCKS * 2)) {
+        /* Leave at least half of the card to the filesystem */
+        return RAWLOG_ERR_INVALID_ARG;
+    }
+
+    mutexHandle = xSemaphoreCreateMutexStatic(&mutexStruct);
+    configASSERT(mutexHandle != NULL);
+#if CONFIG_USE_BLOCKDEV
+    /* Capture is the hot path, serve it before the filesystem */
+    BLOCKDEV_setPriority(BLOCKDEV_CLIENT_RAWLOG, 0);
+#endif
+
+    memset(&info, 0, sizeof(info));
+    info.firstLba = cardBlocks - RAWLOG_BLOCKS;
+    info.chunks = RAWLOG_BLOCKS / RAWLOG_CHUNK_BLOCKS;
+    fill = 0;
+    RAWLOG_Scan();
+    info.scanMs = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+
+#if CONFIG_TEST_RAWLOG
+    TEST_RAWLOG_init();
+#endif
+
+    bInit = true;
+    return RAWLOG_ERR_NONE;
+}
+
+
+int32_t RAWLOG_append(const void * data, size_t len)
+{
+    const uint8_t * pSrc = (const uint8_t *)data;
+    uint8_t * pPayload = (uint8_t *)chunkBuf + RAWLOG_HDR_SIZE;
+    size_t done = 0;
+    size_t n;
+    int32_t ret = RAWLOG_ERR_NONE;
+
+    if(data == NULL) {
+        return RAWLOG_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return RAWLOG_ERR_NOT_INITIALIZED;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    while((done < len) && (ret == RAWLOG_ERR_NONE)) {
+        n = RAWLOG_PAYLOAD_SIZE - fill;
+        if(n > (len - done)) {
+            n = len - done;
+        }
+        memcpy(&pPayload[fill], &pSrc[done], n);
+        fill += n;
+        done += n;
+        if(fill == RAWLOG_PAYLOAD_SIZE) {
+            ret = RAWLOG_Seal();
+        }
+    }
+    info.bytesIn += done;
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+int32_t RAWLOG_flush(void)
+{
+    int32_t ret = RAWLOG_ERR_NONE;
+
+    if(bInit != true) {
+        return RAWLOG_ERR_NOT_INITIALIZED;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    if(fill != 0) {
+        /* The rest of this chunk stays unused, writes never go back */
+        ret = RAWLOG_Seal();
+    }
+#if CONFIG_USE_BLOCKDEV
+    if(ret == RAWLOG_ERR_NONE) {
+        ret = BLOCKDEV_sync(BLOCKDEV_CLIENT_RAWLOG);
+    }
+#endif
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+int32_t RAWLOG_format(void)
+{
+    int32_t ret;
+
+    if(bInit != true) {
+        return RAWLOG_ERR_NOT_INITIALIZED;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+#if CONFIG_USE_BLOCKDEV
+    ret = BLOCKDEV_erase(BLOCKDEV_CLIENT_RAWLOG, info.firstLba, RAWLOG_BLOCKS);
+#else
+    ret = SDCARD_Erase(info.firstLba, info.firstLba + RAWLOG_BLOCKS - 1);
+#endif
+    if(ret == RAWLOG_ERR_NONE) {
+        info.head = 0;
+        info.seq = 0;
+        info.used = 0;
+        info.error = RAWLOG_ERR_NONE;
+        fill = 0;
+    }
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+int32_t RAWLOG_verify(uint32_t n, RAWLOG_HDR_T * pHdr)
+{
+    const uint8_t * pBlock = (const uint8_t *)blockBuf;
+    uint32_t lba;
+    uint32_t crc;
+    uint32_t left;
+    uint32_t len;
+    int32_t ret = RAWLOG_ERR_NONE;
+
+    if(pHdr == NULL) {
+        return RAWLOG_ERR_INVALID_ARG;
+    }
+    if(bInit != true) {
+        return RAWLOG_ERR_NOT_INITIALIZED;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    if(n >= info.used) {
+        xSemaphoreGive(mutexHandle);
+        return RAWLOG_ERR_NO_DATA;
+    }
+    lba = RAWLOG_ChunkLba(RAWLOG_ChunkIdx(n));
+    if(RAWLOG_ReadHdr(RAWLOG_ChunkIdx(n), pHdr) != true) {
+        xSemaphoreGive(mutexHandle);
+        return RAWLOG_ERR_CRC;
+    }
+    /* The first block is in blockBuf already */
+    left = pHdr->len;
+    len = SDCARD_BLOCK_SIZE - RAWLOG_HDR_SIZE;
+    if(len > left) {
+        len = left;
+    }
+    crc = lfs_crc(RAWLOG_CRC_INIT, &pBlock[RAWLOG_HDR_SIZE], len);
+    left -= len;
+    while((left != 0) && (ret == RAWLOG_ERR_NONE)) {
+        lba++;
+        ret = RAWLOG_ReadBlocks(lba, blockBuf, 1);
+        len = (left > SDCARD_BLOCK_SIZE) ? SDCARD_BLOCK_SIZE : left;
+        crc = lfs_crc(crc, pBlock, len);
+        left -= len;
+    }
+    if((ret == RAWLOG_ERR_NONE) && (crc != pHdr->crc)) {
+        ret = RAWLOG_ERR_CRC;
+    }
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+int32_t RAWLOG_simTear(void)
+{
+    int32_t ret;
+
+    if(bInit != true) {
+        return RAWLOG_ERR_NOT_INITIALIZED;
+    }
+
+    xSemaphoreTake(mutexHandle, portMAX_DELAY);
+    /* A reset in the middle of writing the head chunk */
+    memset(blockBuf, 0xA5, SDCARD_BLOCK_SIZE);
+    ret = RAWLOG_WriteBlocks(RAWLOG_ChunkLba(info.head), blockBuf, 1);
+#if CONFIG_USE_BLOCKDEV
+    if(ret == RAWLOG_ERR_NONE) {
+        ret = BLOCKDEV_sync(BLOCKDEV_CLIENT_RAWLOG);
+    }
+#endif
+    if(ret == RAWLOG_ERR_NONE) {
+        /* The unsealed chunk is lost as well */
+        fill = 0;
+        RAWLOG_Scan();
+    }
+    xSemaphoreGive(mutexHandle);
+    return ret;
+}
+
+
+const RAWLOG_INFO_T * RAWLOG_getInfo(void)
+{
+    return &info;
+}
+
+#endif /* CONFIG_USE_RAWLOG */
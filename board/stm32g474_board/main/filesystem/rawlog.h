@@ -0,0 +1,77 @@
+/*
+ * rawlog.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef FILESYSTEM_RAWLOG_H_
+#define FILESYSTEM_RAWLOG_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_USE_RAWLOG
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "bsp/sdcard/sdcard.h"
+
+#define RAWLOG_ERR_NONE                 (0)
+// Don't overlap with SPI, SD card and blockdev error values
+#define RAWLOG_ERR_INVALID_ARG          (SDCARD_ERR_LASTENTRY-3)
+#define RAWLOG_ERR_NOT_INITIALIZED      (SDCARD_ERR_LASTENTRY-4)
+#define RAWLOG_ERR_NO_DATA              (SDCARD_ERR_LASTENTRY-5)
+#define RAWLOG_ERR_CRC                  (SDCARD_ERR_LASTENTRY-6)
+
+#define RAWLOG_BLOCKS                   ((uint32_t)CONFIG_RAWLOG_SIZE_MB * 2048)
+#define RAWLOG_CHUNK_BLOCKS             ((uint32_t)CONFIG_RAWLOG_CHUNK_KB * 2)
+#define RAWLOG_CHUNK_SIZE               (RAWLOG_CHUNK_BLOCKS * SDCARD_BLOCK_SIZE)
+#define RAWLOG_HDR_SIZE                 (32)
+#define RAWLOG_PAYLOAD_SIZE             (RAWLOG_CHUNK_SIZE - RAWLOG_HDR_SIZE)
+
+/*
+ * Start of every chunk. Chunks are written strictly in order around the
+ * region, seq increases by one per chunk. The recovery scan skips chunks
+ * torn by a reset.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t tick;              // ms since boot when the chunk was sealed
+    uint32_t len;               // payload bytes
+    uint32_t crc;               // payload CRC32
+    uint32_t reserved[2];
+    uint32_t hdrCrc;            // CRC32 of the fields above
+} RAWLOG_HDR_T;
+
+typedef struct {
+    uint32_t firstLba;          // region is the last RAWLOG_BLOCKS of the card
+    uint32_t chunks;
+    uint32_t head;              // next chunk written
+    uint32_t seq;               // sequence number of the next chunk
+    uint32_t used;              // valid chunks, oldest first
+    uint32_t scanReads;         // headers read by the recovery scan
+    uint32_t scanMs;
+    uint32_t chunksWritten;
+    uint32_t bytesIn;
+    uint32_t maxWriteMs;
+    int32_t error;              // first write error
+} RAWLOG_INFO_T;
+
+/* Finds the head after a reset, call once the SD card (and blockdev) is up */
+int32_t RAWLOG_init(void);
+/* Copies into the current chunk, the chunk is written when it is full */
+int32_t RAWLOG_append(const void * data, size_t len);
+/* Writes a partial chunk and waits until everything is on the card */
+int32_t RAWLOG_flush(void);
+/* Trims the region and starts over */
+int32_t RAWLOG_format(void);
+/* Checks the payload CRC of chunk n, counted from the oldest valid chunk */
+int32_t RAWLOG_verify(uint32_t n, RAWLOG_HDR_T * pHdr);
+const RAWLOG_INFO_T * RAWLOG_getInfo(void);
+/* Test hook: tears the head chunk and runs the recovery scan again */
+int32_t RAWLOG_simTear(void);
+
+#endif /* CONFIG_USE_RAWLOG */
+#endif /* FILESYSTEM_RAWLOG_H_ */
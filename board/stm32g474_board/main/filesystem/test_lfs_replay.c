@@ -0,0 +1,322 @@
+/*
+ * test_lfs_replay.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_LFS_REPLAY
+
+#include "string.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "cli.h"
+#include "lfs.h"
+#include "lfs_sd.h"
+#include "test_lfs_replay.h"
+#include "bsp/bsp_cycle.h"
+
+#define REPLAY_MAX_RECORD           (512)
+#define REPLAY_HIST_BUCKETS         (24)    // log2 us, the last one is >= 8s
+
+/*
+ * Latency model in front of the SD card. Every command is delayed by
+ * cmdUs and every programmed block adds busyUs, as a slower card would.
+ */
+typedef struct {
+    uint32_t cmdUs;
+    uint32_t busyUs;            // per SD block programmed
+    uint32_t trimUs;            // per trim command
+} REPLAY_MODEL_T;
+
+static bool bInit = false;
+static REPLAY_MODEL_T model = {0};
+static uint32_t latHist[REPLAY_HIST_BUCKETS];
+
+
+static void ReplayDelayUs(uint32_t us)
+{
+    uint32_t cycles;
+    uint32_t start;
+
+    if(us >= 1000) {
+        vTaskDelay(pdMS_TO_TICKS(us / 1000));
+        us %= 1000;
+    }
+    cycles = us * (SystemCoreClock / 1000000U);
+    start = BSP_CYCLE_get();
+    while((BSP_CYCLE_get() - start) < cycles);
+}
+
+
+static int32_t ReplayRead(uint32_t lba, void * pBuff, uint32_t count)
+{
+    ReplayDelayUs(model.cmdUs);
+    return lfs_sd_getSdBlockDev()->read(lba, pBuff, count);
+}
+
+
+static int32_t ReplayProg(uint32_t lba, const void * pBuff, uint32_t count)
+{
+    const int32_t ret = lfs_sd_getSdBlockDev()->prog(lba, pBuff, count);
+
+    ReplayDelayUs(model.cmdUs + (model.busyUs * count));
+    return ret;
+}
+
+
+static int32_t ReplayTrim(uint32_t lba, uint32_t count)
+{
+    const int32_t ret = lfs_sd_getSdBlockDev()->trim(lba, count);
+
+    ReplayDelayUs(model.cmdUs + model.trimUs);
+    return ret;
+}
+
+
+static int32_t ReplaySync(void)
+{
+    return lfs_sd_getSdBlockDev()->sync();
+}
+
+
+static uint32_t ReplayGetBlockCount(void)
+{
+    return lfs_sd_getSdBlockDev()->getBlockCount();
+}
+
+
+static const LFS_SD_BDEV_T modelDev = {
+    .read = ReplayRead,
+    .prog = ReplayProg,
+    .trim = ReplayTrim,
+    .sync = ReplaySync,
+    .getBlockCount = ReplayGetBlockCount
+};
+
+
+/* Upper bound in us of the bucket holding the given percentile */
+static uint32_t ReplayPercentile(uint32_t total, uint32_t percent)
+{
+    const uint32_t rank = ((total * percent) + 99) / 100;
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < REPLAY_HIST_BUCKETS; i++) {
+        count += latHist[i];
+        if(count >= rank) {
+            return (1UL << i);
+        }
+    }
+    return (1UL << (REPLAY_HIST_BUCKETS - 1));
+}
+
+
+static BaseType_t CmdLfsSimLat(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    REPLAY_MODEL_T newModel = {0};
+    BaseType_t strParamLen;
+    bool bModel;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(CLI_parseU32(pcCommandString, 1, &newModel.cmdUs) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if(CLI_parseU32(pcCommandString, 2, &newModel.busyUs) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((FreeRTOS_CLIGetParameter(pcCommandString, 3, &strParamLen) != NULL) &&
+       (CLI_parseU32(pcCommandString, 3, &newModel.trimUs) != true)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter3 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    bModel = (newModel.cmdUs != 0) || (newModel.busyUs != 0) || (newModel.trimUs != 0);
+
+    lfs_sd_umount();
+    model = newModel;
+    ret = lfs_sd_setBlockDev(bModel ? &modelDev : NULL);
+    if((ret == LFS_ERR_OK) && (lfs_sd_mount() == NULL)) {
+        ret = LFS_ERR_IO;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tBlock device: %s, cmd %lu us, busy %lu us/block, trim %lu us, error %ld\r\n\r\n",
+            bModel ? "model" : "sd", model.cmdUs, model.busyUs, model.trimUs, ret);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_simlat = {
+    "lfs_simlat",
+    "lfs_simlat <cmd_us> <busy_us> [trim_us]:\r\n"
+    "\tRemounts on the SD card with added per-command latency and per-block\r\n"
+    "\tbusy time, all zero restores the plain SD card\r\n\r\n",
+    CmdLfsSimLat,
+    -1
+};
+
+
+/*
+ * Logging workload: <records> of <size> bytes appended round robin to
+ * <files> files at <KB/s> (0 unpaced), with the current sync policy.
+ */
+static BaseType_t CmdLfsReplay(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint8_t record[REPLAY_MAX_RECORD];
+    static int32_t fds[CONFIG_LFS_SD_MAX_OPEN_FILES];
+    const LFS_SD_IOSTAT_T * pIo;
+    BaseType_t strParamLen;
+    char path[16];
+    uint32_t nFiles;
+    uint32_t size;
+    uint32_t kbytes;
+    uint32_t rate = 0;
+    uint32_t total;
+    uint32_t written = 0;
+    uint32_t records = 0;
+    uint32_t credit = 0;
+    uint32_t cycles;
+    uint32_t us;
+    uint32_t maxUs = 0;
+    uint32_t ms;
+    uint32_t bucket;
+    uint32_t amp;
+    TickType_t xLastWakeTime;
+    TickType_t tickStart;
+    int32_t ret = LFS_ERR_OK;
+    int32_t retClose;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if((CLI_parseU32(pcCommandString, 1, &nFiles) != true) || (nFiles == 0) ||
+       (nFiles > CONFIG_LFS_SD_MAX_OPEN_FILES)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((CLI_parseU32(pcCommandString, 2, &size) != true) || (size == 0) ||
+       (size > REPLAY_MAX_RECORD)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((CLI_parseU32(pcCommandString, 3, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter3 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((FreeRTOS_CLIGetParameter(pcCommandString, 4, &strParamLen) != NULL) &&
+       (CLI_parseU32(pcCommandString, 4, &rate) != true)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter4 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < nFiles; i++) {
+        snprintf(path, sizeof(path), ".replay%lu", i);
+        fds[i] = lfs_sd_fopenFlags(path, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_TRUNC);
+        if(fds[i] < 0) {
+            ret = fds[i];
+            nFiles = i;
+            break;
+        }
+    }
+
+    memset(latHist, 0, sizeof(latHist));
+    lfs_sd_resetIoStats();
+    lfs_sd_resetSyncStats();
+    total = kbytes * 1024;
+    tickStart = xTaskGetTickCount();
+    xLastWakeTime = tickStart;
+    while((ret >= 0) && (written < total)) {
+        if(rate != 0) {
+            if(credit < size) {
+                /* rate KB/s is rate * 1024 / 1000 bytes per ms */
+                credit += (rate * 1024 * portTICK_PERIOD_MS) / 1000;
+                vTaskDelayUntil(&xLastWakeTime, 1);
+                continue;
+            }
+            credit -= size;
+        }
+        memset(record, (uint8_t)records, size);
+        cycles = BSP_CYCLE_get();
+        ret = lfs_sd_fwrite(fds[records % nFiles], record, size);
+        us = BSP_CYCLE_to_us(BSP_CYCLE_get() - cycles);
+        for(bucket = 0; (bucket < (REPLAY_HIST_BUCKETS - 1)) && ((1UL << bucket) < us); bucket++);
+        latHist[bucket]++;
+        if(us > maxUs) {
+            maxUs = us;
+        }
+        if(ret > 0) {
+            written += ret;
+        }
+        records++;
+    }
+    for(uint32_t i = 0; i < nFiles; i++) {
+        retClose = lfs_sd_fclose(fds[i]);
+        if((ret >= 0) && (retClose != LFS_ERR_OK)) {
+            ret = retClose;
+        }
+    }
+    ms = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+    if(ms == 0) {
+        ms = 1;
+    }
+    for(uint32_t i = 0; i < nFiles; i++) {
+        snprintf(path, sizeof(path), ".replay%lu", i);
+        lfs_sd_rm(path);
+    }
+
+    pIo = lfs_sd_getIoStats();
+    /* SD bytes programmed per byte written, in hundredths */
+    amp = (written != 0) ?
+          (uint32_t)(((uint64_t)pIo->progBlocks * 512 * 100) / written) : 0;
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\t%lu records, %lu bytes in %lu ms, error %ld\r\n"
+            "\t%lu ops/s, %lu KB/s\r\n"
+            "\tWrite amplification %lu.%02lu, %lu progs, %lu reads, %lu erases, %lu syncs\r\n"
+            "\tLatency p50 <%lu us, p90 <%lu us, p99 <%lu us, max %lu us\r\n\r\n",
+            records, written, ms, (ret < 0) ? ret : 0,
+            (records * 1000) / ms, (uint32_t)(((uint64_t)written * 1000) / ((uint64_t)ms * 1024)),
+            amp / 100, amp % 100, pIo->progs, pIo->reads, pIo->erases, pIo->syncs,
+            ReplayPercentile(records, 50), ReplayPercentile(records, 90),
+            ReplayPercentile(records, 99), maxUs);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_replay = {
+    "lfs_replay",
+    "lfs_replay <files> <record> <KB> [KB/s]:\r\n"
+    "\tAppends <KB> of <record>-byte records round robin to <files> files\r\n"
+    "\tand reports ops/s, write amplification and write latency\r\n\r\n",
+    CmdLfsReplay,
+    -1
+};
+
+
+void TEST_LFS_REPLAY_init(void)
+{
+    if(bInit) {
+        return;
+    }
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_simlat);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_replay);
+    bInit = true;
+}
+
+#endif /* CONFIG_TEST_LFS_REPLAY */
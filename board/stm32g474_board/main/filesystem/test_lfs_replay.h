@@ -0,0 +1,19 @@
+/*
+ * test_lfs_replay.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef FILESYSTEM_TEST_LFS_REPLAY_H_
+#define FILESYSTEM_TEST_LFS_REPLAY_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_LFS_REPLAY
+
+void TEST_LFS_REPLAY_init(void);
+
+#endif /* CONFIG_TEST_LFS_REPLAY */
+
+#endif /* FILESYSTEM_TEST_LFS_REPLAY_H_ */
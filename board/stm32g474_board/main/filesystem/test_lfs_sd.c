@@ -16,14 +16,35 @@
 #include "stdbool.h"
 #include "limits.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "cli.h"
 #include "lfs.h"
 #include "lfs_sd.h"
+#include "test_lfs_replay.h"
 
 #define LFS_SD_MAX_PATHNAME_LENGTH      (LFS_NAME_MAX)
 
 static bool bInit = false;
 
+/* Parses the file descriptor in parameter paramIdx */
+static bool ParseFd(const char *pcCommandString, UBaseType_t paramIdx, int32_t * pFd)
+{
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    char tmpStr[12];
+    char * ptrEnd;
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, paramIdx, &strParamLen);
+    if((ptrStrParam == NULL) || (strParamLen > (sizeof(tmpStr) - 1))) {
+        return false;
+    }
+    memcpy(tmpStr, ptrStrParam, strParamLen);
+    tmpStr[strParamLen] = '\0';
+    *pFd = strtol(tmpStr, &ptrEnd, 0);
+    return ((ptrEnd != tmpStr) && (*ptrEnd == '\0'));
+}
+
 static BaseType_t FuncLfsCmdFormat(
                 char *pcWriteBuffer,
                 size_t xWriteBufferLen,
@@ -262,12 +283,13 @@ static BaseType_t FuncLfsCmdFopen(
         return 0;
     }
 
-    if(NULL != lfs_sd_fopen(ptrStrParam)) {
+    const int32_t fd = lfs_sd_fopen(ptrStrParam);
+    if(fd >= 0) {
         snprintf(pcWriteBuffer, xWriteBufferLen,
-                "\tOK\r\n\r\n");
+                "\tOK, fd %ld\r\n\r\n", fd);
     } else {
         snprintf(pcWriteBuffer, xWriteBufferLen,
-                "\tError: open failed!\r\n\r\n");
+                "\tError: open failed %ld!\r\n\r\n", fd);
     }
     return 0;
 }
@@ -275,7 +297,7 @@ static BaseType_t FuncLfsCmdFopen(
 static const CLI_Command_Definition_t lfs_cmd_fopen = {
     "lfs_fopen",
     "lfs_fopen <filename>:\r\n"
-    "\tOpen file in RDWR mode\r\n\r\n",
+    "\tOpen file in RDWR mode, prints the file descriptor\r\n\r\n",
     FuncLfsCmdFopen,
     1
 };
@@ -286,9 +308,16 @@ static BaseType_t FuncLfsCmdFclose(
                 size_t xWriteBufferLen,
                 const char *pcCommandString )
 {
+    int32_t fd;
+
     memset(pcWriteBuffer, 0, xWriteBufferLen);
 
-    if(LFS_ERR_OK != lfs_sd_fclose()) {
+    if(ParseFd(pcCommandString, 1, &fd) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if(LFS_ERR_OK != lfs_sd_fclose(fd)) {
         snprintf(pcWriteBuffer, xWriteBufferLen, "\tError: fclose\r\n\r\n");
         return 0;
     }
@@ -298,10 +327,10 @@ static BaseType_t FuncLfsCmdFclose(
 
 static const CLI_Command_Definition_t lfs_cmd_fclose = {
     "lfs_fclose",
-    "lfs_fclose:\r\n"
+    "lfs_fclose <fd>:\r\n"
     "\tCloses already opened file\r\n\r\n",
     FuncLfsCmdFclose,
-    0
+    1
 };
 
 
@@ -312,17 +341,23 @@ static BaseType_t FuncLfsCmdFwrite(
 {
     char * ptrStrParam;
     BaseType_t strParamLen;
+    int32_t fd;
 
     memset(pcWriteBuffer, 0, xWriteBufferLen);
 
-    ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if(ParseFd(pcCommandString, 1, &fd) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    ptrStrParam = (char *) FreeRTOS_CLIGetParameter(pcCommandString, 2, &strParamLen);
     if(NULL == ptrStrParam) {
         snprintf(pcWriteBuffer, xWriteBufferLen,
                 "\tNothing to write!\r\n\r\n");
         return 0;
     }
     const size_t len = strlen(ptrStrParam);
-    if(len == lfs_sd_fwrite(ptrStrParam, len)) {
+    if(len == lfs_sd_fwrite(fd, ptrStrParam, len)) {
         snprintf(pcWriteBuffer, xWriteBufferLen, "\tOK\r\n\r\n");
     } else {
         snprintf(pcWriteBuffer, xWriteBufferLen, "\tFailed\r\n\r\n");
@@ -332,7 +367,7 @@ static BaseType_t FuncLfsCmdFwrite(
 
 static const CLI_Command_Definition_t lfs_cmd_fwrite = {
     "lfs_fwrite",
-    "lfs_fwrite <data>:\r\n"
+    "lfs_fwrite <fd> <data>:\r\n"
     "\tAppends <data> to already opened file\r\n\r\n",
     FuncLfsCmdFwrite,
     -1
@@ -344,9 +379,16 @@ static BaseType_t FuncLfsCmdFread(
                 size_t xWriteBufferLen,
                 const char *pcCommandString )
 {
+    int32_t fd;
+
     memset(pcWriteBuffer, 0, xWriteBufferLen);
 
-    int32_t ret = lfs_sd_fread(pcWriteBuffer, xWriteBufferLen - 4);
+    if(ParseFd(pcCommandString, 1, &fd) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    int32_t ret = lfs_sd_fread(fd, pcWriteBuffer, xWriteBufferLen - 4);
 
     if(ret == 0) {
         snprintf(pcWriteBuffer, xWriteBufferLen,
@@ -362,10 +404,10 @@ static BaseType_t FuncLfsCmdFread(
 
 static const CLI_Command_Definition_t lfs_cmd_fread = {
     "lfs_fread",
-    "lfs_fread:\r\n"
+    "lfs_fread <fd>:\r\n"
     "\tReads from already opened file\r\n\r\n",
     FuncLfsCmdFread,
-    0
+    1
 };
 
 static BaseType_t FuncLfsCmdMv(
@@ -475,12 +517,638 @@ static const CLI_Command_Definition_t lfs_cmd_rm = {
 };
 
 
+static const char * const eraseName[N_LFS_SD_ERASE] = {
+    "none",
+    "trim",
+    "fill"
+};
+
+static BaseType_t FuncLfsCmdErase(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    char * ptrStrParam;
+    BaseType_t strParamLen;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = (char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if(ptrStrParam != NULL) {
+        uint32_t i;
+        for(i = 0; i < N_LFS_SD_ERASE; i++) {
+            if((strParamLen == strlen(eraseName[i])) &&
+               (strncmp(ptrStrParam, eraseName[i], strParamLen) == 0)) {
+                lfs_sd_setEraseStrategy((LFS_SD_ERASE_T)i);
+                break;
+            }
+        }
+        if(i == N_LFS_SD_ERASE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tErase: %s\r\n\r\n",
+            eraseName[lfs_sd_getEraseStrategy()]);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_erase = {
+    "lfs_erase",
+    "lfs_erase [none|trim|fill]:\r\n"
+    "\tShows or sets what a littlefs block erase does\r\n\r\n",
+    FuncLfsCmdErase,
+    -1
+};
+
+
+static BaseType_t FuncLfsCmdAllocBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t strategy = 0;
+    static uint32_t blocks = 0;
+    LFS_SD_ALLOC_BENCH_T result;
+    char * ptrStrParam;
+    BaseType_t strParamLen;
+    char tmpStr[12];
+    char * ptrEnd;
+    int32_t i32Temp;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(strategy == 0) {
+        ptrStrParam = (char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam == NULL) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 not found!\r\n\r\n");
+            return 0;
+        }
+        if(strParamLen > (sizeof(tmpStr) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 len exceeded buffer!\r\n\r\n");
+            return 0;
+        }
+        memcpy(tmpStr, ptrStrParam, strParamLen);
+        tmpStr[strParamLen] = '\0';
+        errno = 0;
+        i32Temp = strtol(tmpStr, &ptrEnd, 0);
+        if((ptrEnd == tmpStr) || (*ptrEnd != '\0') || (i32Temp <= 0) ||
+           (((i32Temp == LONG_MIN) || (i32Temp == LONG_MAX)) && (errno == ERANGE))) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        blocks = (uint32_t)i32Temp;
+    }
+
+    ret = lfs_sd_allocBench((LFS_SD_ERASE_T)strategy, blocks, &result);
+    if(ret != LFS_ERR_OK) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\t%-5s error %ld\r\n\r\n", eraseName[strategy], ret);
+        strategy = 0;
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\t%-5s %lu ms, %lu erases in %lu ms, %lu ms/erase\r\n",
+            eraseName[strategy], result.totalMs, result.erases, result.eraseMs,
+            (result.erases != 0) ? (result.eraseMs / result.erases) : 0);
+    strategy++;
+    if(strategy < N_LFS_SD_ERASE) {
+        return 1;
+    }
+    strncat(pcWriteBuffer, "\r\n", xWriteBufferLen - strlen(pcWriteBuffer) - 1);
+    strategy = 0;
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_alloc_bench = {
+    "lfs_alloc_bench",
+    "lfs_alloc_bench <blocks>:\r\n"
+    "\tWrites <blocks> littlefs blocks to a scratch file with each erase\r\n"
+    "\tstrategy and reports the time spent allocating them\r\n\r\n",
+    FuncLfsCmdAllocBench,
+    1
+};
+
+
+/*
+ * Remounts with each cache size from 512 bytes up to the configured size,
+ * then restores the configured size.
+ */
+static BaseType_t FuncLfsCmdWriteBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t cacheSize = 0;
+    static uint32_t kbytes = 0;
+    char * ptrStrParam;
+    BaseType_t strParamLen;
+    char tmpStr[12];
+    char * ptrEnd;
+    int32_t i32Temp;
+    uint32_t ms = 0;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(cacheSize == 0) {
+        ptrStrParam = (char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+        if(ptrStrParam == NULL) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 not found!\r\n\r\n");
+            return 0;
+        }
+        if(strParamLen > (sizeof(tmpStr) - 1)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 len exceeded buffer!\r\n\r\n");
+            return 0;
+        }
+        memcpy(tmpStr, ptrStrParam, strParamLen);
+        tmpStr[strParamLen] = '\0';
+        errno = 0;
+        i32Temp = strtol(tmpStr, &ptrEnd, 0);
+        if((ptrEnd == tmpStr) || (*ptrEnd != '\0') || (i32Temp <= 0) ||
+           (((i32Temp == LONG_MIN) || (i32Temp == LONG_MAX)) && (errno == ERANGE))) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        kbytes = (uint32_t)i32Temp;
+        cacheSize = 512;
+    }
+
+    lfs_sd_umount();
+    ret = lfs_sd_setCacheSize(cacheSize);
+    if((ret == LFS_ERR_OK) && (lfs_sd_mount() == NULL)) {
+        ret = LFS_ERR_IO;
+    }
+    if(ret == LFS_ERR_OK) {
+        ret = lfs_sd_writeBench(kbytes, &ms);
+    }
+    if(ret != LFS_ERR_OK) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tcache %5lu: error %ld\r\n", cacheSize, ret);
+    } else {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tcache %5lu: %lu ms, %lu KB/s\r\n", cacheSize, ms,
+                (kbytes * 1000) / ((ms != 0) ? ms : 1));
+    }
+
+    cacheSize *= 2;
+    if((ret == LFS_ERR_OK) && (cacheSize <= CONFIG_LFS_SD_CACHE_SIZE)) {
+        return 1;
+    }
+    lfs_sd_umount();
+    lfs_sd_setCacheSize(CONFIG_LFS_SD_CACHE_SIZE);
+    lfs_sd_mount();
+    strncat(pcWriteBuffer, "\r\n", xWriteBufferLen - strlen(pcWriteBuffer) - 1);
+    cacheSize = 0;
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_write_bench = {
+    "lfs_write_bench",
+    "lfs_write_bench <KB>:\r\n"
+    "\tWrites <KB> to a scratch file in 512-byte writes with each cache\r\n"
+    "\tsize up to the configured one and reports the throughput\r\n\r\n",
+    FuncLfsCmdWriteBench,
+    1
+};
+
+
+static BaseType_t FuncLfsCmdIoStat(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    const LFS_SD_IOSTAT_T * pIo = lfs_sd_getIoStats();
+    char * ptrStrParam;
+    BaseType_t strParamLen;
+    uint32_t perAppend;
+    uint32_t amp;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = (char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if(ptrStrParam != NULL) {
+        if((strParamLen != 5) || (strncmp(ptrStrParam, "reset", 5) != 0)) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        lfs_sd_resetIoStats();
+        snprintf(pcWriteBuffer, xWriteBufferLen, "\tI/O counters reset\r\n\r\n");
+        return 0;
+    }
+
+    /* In hundredths: SD writes per append, SD bytes per appended byte */
+    perAppend = (pIo->appends != 0) ?
+                (uint32_t)(((uint64_t)pIo->progs * 100) / pIo->appends) : 0;
+    amp = (pIo->appendBytes != 0) ?
+          (uint32_t)(((uint64_t)pIo->progBlocks * 512 * 100) / pIo->appendBytes) : 0;
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tappend: %10lu ops %10lu KB\r\n"
+            "\tread  : %10lu ops %10lu blocks %10lu ms\r\n"
+            "\tprog  : %10lu ops %10lu blocks %10lu ms\r\n"
+            "\terase : %10lu ops %10lu blocks %10lu ms\r\n"
+            "\tsync  : %10lu ops %28lu ms\r\n"
+            "\tProgs per append %lu.%02lu, write amplification %lu.%02lu\r\n\r\n",
+            pIo->appends, (uint32_t)(pIo->appendBytes / 1024),
+            pIo->reads, pIo->readBlocks, (uint32_t)(pIo->readUs / 1000),
+            pIo->progs, pIo->progBlocks, (uint32_t)(pIo->progUs / 1000),
+            pIo->erases, pIo->eraseBlocks, (uint32_t)(pIo->eraseUs / 1000),
+            pIo->syncs, (uint32_t)(pIo->syncUs / 1000),
+            perAppend / 100, perAppend % 100, amp / 100, amp % 100);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_iostat = {
+    "lfs_iostat",
+    "lfs_iostat [reset]:\r\n"
+    "\tShows or resets the littlefs block device I/O counters\r\n\r\n",
+    FuncLfsCmdIoStat,
+    -1
+};
+
+
+static void PrintRingInfo(int32_t ring, char *pcWriteBuffer, size_t xWriteBufferLen)
+{
+    LFS_SD_RING_INFO_T info;
+    const int32_t ret = lfs_sd_ringInfo(ring, &info);
+    const size_t len = strlen(pcWriteBuffer);
+
+    if(ret != LFS_ERR_OK) {
+        snprintf(&pcWriteBuffer[len], xWriteBufferLen - len,
+                "\tlfs_sd_ringInfo error %ld\r\n\r\n", ret);
+        return;
+    }
+    snprintf(&pcWriteBuffer[len], xWriteBufferLen - len,
+            "\tRing %ld: capacity %lu, head %lu, tail %lu, used %lu\r\n\r\n",
+            ring, info.capacity, info.head, info.tail, info.used);
+}
+
+
+static BaseType_t FuncLfsCmdRingOpen(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    char path[32];
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    uint32_t kbytes;
+    int32_t ring;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if((ptrStrParam == NULL) || (strParamLen > (sizeof(path) - 1))) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    memcpy(path, ptrStrParam, strParamLen);
+    path[strParamLen] = '\0';
+    if((CLI_parseU32(pcCommandString, 2, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    ring = lfs_sd_ringOpen(path, kbytes * 1024);
+    if(ring < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tlfs_sd_ringOpen error %ld\r\n\r\n", ring);
+        return 0;
+    }
+    PrintRingInfo(ring, pcWriteBuffer, xWriteBufferLen);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_ringopen = {
+    "lfs_ringopen",
+    "lfs_ringopen <path> <KB>:\r\n"
+    "\tOpens the ring log <path>, preallocating <KB> if it is new\r\n\r\n",
+    FuncLfsCmdRingOpen,
+    2
+};
+
+
+static BaseType_t FuncLfsCmdRingWrite(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t record[512 / sizeof(uint32_t)];
+    static uint32_t seq = 0;
+    uint32_t kbytes;
+    int32_t ring;
+    int32_t ret = 0;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(ParseFd(pcCommandString, 1, &ring) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((CLI_parseU32(pcCommandString, 2, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    for(uint32_t i = 0; (i < (kbytes * 2)) && (ret >= 0); i++) {
+        /* Every record starts with a running sequence number */
+        record[0] = seq++;
+        ret = lfs_sd_ringWrite(ring, record, sizeof(record));
+    }
+    if(ret >= 0) {
+        ret = lfs_sd_ringSync(ring);
+    }
+    if(ret < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tlfs_sd_ringWrite error %ld\r\n", ret);
+    }
+    PrintRingInfo(ring, pcWriteBuffer, xWriteBufferLen);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_ringwrite = {
+    "lfs_ringwrite",
+    "lfs_ringwrite <ring> <KB>:\r\n"
+    "\tAppends <KB> of 512-byte records to a ring log\r\n\r\n",
+    FuncLfsCmdRingWrite,
+    2
+};
+
+
+static BaseType_t FuncLfsCmdRingRead(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    uint8_t data[16];
+    uint32_t pos;
+    int32_t ring;
+    int32_t ret;
+    size_t len;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(ParseFd(pcCommandString, 1, &ring) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if(CLI_parseU32(pcCommandString, 2, &pos) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    ret = lfs_sd_ringRead(ring, pos, data, sizeof(data));
+    if(ret < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tlfs_sd_ringRead error %ld\r\n\r\n", ret);
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\t%08lx:", pos);
+    for(int32_t i = 0; i < ret; i++) {
+        len = strlen(pcWriteBuffer);
+        snprintf(&pcWriteBuffer[len], xWriteBufferLen - len, " %02x", data[i]);
+    }
+    strncat(pcWriteBuffer, "\r\n\r\n", xWriteBufferLen - strlen(pcWriteBuffer) - 1);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_ringread = {
+    "lfs_ringread",
+    "lfs_ringread <ring> <pos>:\r\n"
+    "\tDumps 16 bytes at <pos> from the oldest byte of a ring log\r\n\r\n",
+    FuncLfsCmdRingRead,
+    2
+};
+
+
+static BaseType_t FuncLfsCmdRingClose(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    int32_t ring;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(ParseFd(pcCommandString, 1, &ring) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tlfs_sd_ringClose returns %ld\r\n\r\n",
+            lfs_sd_ringClose(ring));
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_ringclose = {
+    "lfs_ringclose",
+    "lfs_ringclose <ring>:\r\n"
+    "\tCloses a ring log\r\n\r\n",
+    FuncLfsCmdRingClose,
+    1
+};
+
+
+static const char * const syncName[N_LFS_SD_SYNC] = {
+    "close",
+    "bytes",
+    "period",
+    "idle"
+};
+
+static BaseType_t FuncLfsCmdSync(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    LFS_SD_SYNC_POLICY_T policy = *lfs_sd_getSyncPolicy();
+    const LFS_SD_SYNC_STATS_T * pStats;
+    char * ptrStrParam;
+    BaseType_t strParamLen;
+    uint32_t value;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = (char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if(ptrStrParam != NULL) {
+        uint32_t i;
+        for(i = 0; i < N_LFS_SD_SYNC; i++) {
+            if((strParamLen == strlen(syncName[i])) &&
+               (strncmp(ptrStrParam, syncName[i], strParamLen) == 0)) {
+                policy.mode = (LFS_SD_SYNC_T)i;
+                break;
+            }
+        }
+        if(i == N_LFS_SD_SYNC) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                    "\tError: Parameter1 value is invalid!\r\n\r\n");
+            return 0;
+        }
+        if(FreeRTOS_CLIGetParameter(pcCommandString, 2, &strParamLen) != NULL) {
+            if((CLI_parseU32(pcCommandString, 2, &value) != true) || (value == 0)) {
+                snprintf(pcWriteBuffer, xWriteBufferLen,
+                        "\tError: Parameter2 value is invalid!\r\n\r\n");
+                return 0;
+            }
+            if(policy.mode == LFS_SD_SYNC_BYTES) {
+                policy.bytes = value;
+            } else {
+                policy.ms = value;
+            }
+        }
+        lfs_sd_setSyncPolicy(&policy);
+    }
+
+    pStats = lfs_sd_getSyncStats();
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tSync: %s, %lu bytes, %lu ms\r\n"
+            "\tAt risk %lu bytes (max %lu)\r\n"
+            "\t%lu syncs in %lu ms, longest %lu ms\r\n\r\n",
+            syncName[policy.mode], policy.bytes, policy.ms,
+            pStats->atRisk, pStats->maxAtRisk,
+            pStats->syncs, pStats->syncMs, pStats->maxSyncMs);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_sync = {
+    "lfs_sync",
+    "lfs_sync [close|bytes|period|idle] [N]:\r\n"
+    "\tShows or sets the file sync policy, N is bytes or ms\r\n\r\n",
+    FuncLfsCmdSync,
+    -1
+};
+
+
+/*
+ * Appends <KB> in 512-byte writes at <KB/s> (0 is unpaced), then drops
+ * power without closing the file: the handles are discarded, the volume is
+ * remounted and the surviving file size compared with the at-risk count.
+ */
+static BaseType_t FuncLfsCmdPowerCut(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static const char path[] = ".pwrcut";
+    static uint8_t chunk[512];
+    const LFS_SD_SYNC_STATS_T * pStats;
+    struct lfs_info info;
+    lfs_t * pLfs;
+    uint32_t kbytes;
+    uint32_t rate;
+    uint32_t total;
+    uint32_t written = 0;
+    uint32_t atRisk;
+    uint32_t syncs;
+    uint32_t syncMs;
+    uint32_t ms;
+    TickType_t tickStart;
+    int32_t fd;
+    int32_t ret = LFS_ERR_OK;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if((CLI_parseU32(pcCommandString, 1, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if(CLI_parseU32(pcCommandString, 2, &rate) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    fd = lfs_sd_fopenFlags(path, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_TRUNC);
+    if(fd < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tlfs_sd_fopenFlags error %ld\r\n\r\n", fd);
+        return 0;
+    }
+    lfs_sd_resetSyncStats();
+
+    total = kbytes * 1024;
+    tickStart = xTaskGetTickCount();
+    while((written < total) && (ret >= 0)) {
+        if(rate != 0) {
+            /* rate KB/s allows rate * 1024 bytes per 1000 ms since the start */
+            ms = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+            if((((uint64_t)written + sizeof(chunk)) * 1000) > ((uint64_t)ms * rate * 1024)) {
+                vTaskDelay(1);
+                continue;
+            }
+        }
+        memset(chunk, (uint8_t)(written / sizeof(chunk)), sizeof(chunk));
+        ret = lfs_sd_fwrite(fd, chunk, sizeof(chunk));
+        if(ret > 0) {
+            written += ret;
+        }
+    }
+    ms = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+
+    pStats = lfs_sd_getSyncStats();
+    atRisk = pStats->atRisk;
+    syncs = pStats->syncs;
+    syncMs = pStats->syncMs;
+    lfs_sd_simPowerCut();
+
+    pLfs = lfs_sd_mount();
+    if(pLfs == NULL) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tRemount failed\r\n\r\n");
+        return 0;
+    }
+    if(lfs_stat(pLfs, path, &info) != LFS_ERR_OK) {
+        info.size = 0;
+    }
+    lfs_sd_rm(path);
+
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tWrote %lu bytes in %lu ms, %lu KB/s, error %ld\r\n"
+            "\t%lu syncs in %lu ms\r\n"
+            "\tSurvived %lu, lost %lu, bound %lu: %s\r\n\r\n",
+            written, ms, (uint32_t)(((uint64_t)written * 1000) / ((uint64_t)((ms != 0) ? ms : 1) * 1024)),
+            (ret < 0) ? ret : 0, syncs, syncMs,
+            (uint32_t)info.size, written - (uint32_t)info.size, atRisk,
+            ((written - (uint32_t)info.size) <= atRisk) ? "PASS" : "FAIL");
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_cmd_pwrcut = {
+    "lfs_pwrcut",
+    "lfs_pwrcut <KB> <KB/s>:\r\n"
+    "\tWrites <KB> at <KB/s> (0 unpaced) with the sync policy, then\r\n"
+    "\tsimulates a power cut and reports the data lost\r\n\r\n",
+    FuncLfsCmdPowerCut,
+    2
+};
+
+
 void TEST_LFS_Init(void)
 {
     if(bInit) {
         return;
     }
 
+#if CONFIG_TEST_LFS_REPLAY
+    TEST_LFS_REPLAY_init();
+#endif /* CONFIG_TEST_LFS_REPLAY */
+
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_format);
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_stat);
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_mount);
@@ -494,6 +1162,16 @@ void TEST_LFS_Init(void)
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_fread);
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_mv);
     FreeRTOS_CLIRegisterCommand(&lfs_cmd_rm);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_erase);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_alloc_bench);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_write_bench);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_sync);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_pwrcut);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_iostat);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_ringopen);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_ringwrite);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_ringread);
+    FreeRTOS_CLIRegisterCommand(&lfs_cmd_ringclose);
 
     bInit = true;
 }
@@ -0,0 +1,134 @@
+/*
+ * test_lfs_writer.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_LFS_WRITER
+
+#include "string.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "cli.h"
+#include "lfs.h"
+#include "lfs_writer.h"
+#include "test_lfs_writer.h"
+#include "bsp/bsp_cycle.h"
+
+#define TEST_LFS_WRITER_RECORD_SIZE     (64)    // one CAN FD frame record
+
+static bool bInit = false;
+
+/*
+ * Produces <KB> of 64-byte records at <KB/s> from the CLI task and reports
+ * how long the producer spent in LFS_WRITER_write().
+ */
+static BaseType_t CmdLfsWriterBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint8_t record[TEST_LFS_WRITER_RECORD_SIZE];
+    char path[32];
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    uint32_t kbytes;
+    uint32_t rate;
+    uint32_t total;
+    uint32_t produced = 0;
+    uint32_t credit = 0;
+    uint32_t cycles;
+    uint32_t maxCycles = 0;
+    TickType_t xLastWakeTime;
+    TickType_t tickStart;
+    int32_t stream;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, 1, &strParamLen);
+    if((ptrStrParam == NULL) || (strParamLen > (sizeof(path) - 1))) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    memcpy(path, ptrStrParam, strParamLen);
+    path[strParamLen] = '\0';
+    if((CLI_parseU32(pcCommandString, 2, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter2 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    if((CLI_parseU32(pcCommandString, 3, &rate) != true) || (rate == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter3 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    stream = LFS_WRITER_open(path);
+    if(stream < 0) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tLFS_WRITER_open error %ld\r\n\r\n", stream);
+        return 0;
+    }
+
+    total = kbytes * 1024;
+    tickStart = xTaskGetTickCount();
+    xLastWakeTime = tickStart;
+    while(produced < total) {
+        /* rate KB/s is rate * 1024 / 1000 bytes per ms */
+        credit += (rate * 1024 * portTICK_PERIOD_MS) / 1000;
+        while((credit >= sizeof(record)) && (produced < total)) {
+            memset(record, (uint8_t)(produced / sizeof(record)), sizeof(record));
+            cycles = BSP_CYCLE_get();
+            LFS_WRITER_write(stream, record, sizeof(record));
+            cycles = BSP_CYCLE_get() - cycles;
+            if(cycles > maxCycles) {
+                maxCycles = cycles;
+            }
+            produced += sizeof(record);
+            credit -= sizeof(record);
+        }
+        vTaskDelayUntil(&xLastWakeTime, 1);
+    }
+    ret = LFS_WRITER_close(stream);
+
+    const LFS_WRITER_STATS_T * pStats = LFS_WRITER_getStats(stream);
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\t%lu bytes in %lu ms, close %ld\r\n"
+            "\tProducer max %lu us per record\r\n"
+            "\tWritten %lu, overflow %lu bytes (%lu writes)\r\n"
+            "\tDropped %lu bytes after errors, %lu retries\r\n"
+            "\tRing max %lu buffers, longest write %lu ms\r\n\r\n",
+            produced, (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS, ret,
+            BSP_CYCLE_to_us(maxCycles),
+            pStats->bytesWritten, pStats->overflowBytes, pStats->overflows,
+            pStats->droppedBytes, pStats->retries,
+            pStats->maxBuffers, pStats->maxWriteMs);
+    return 0;
+}
+
+static const CLI_Command_Definition_t lfs_writer_bench = {
+    "lfsw_bench",
+    "lfsw_bench <path> <KB> <KB/s>:\r\n"
+    "\tAppends <KB> of 64-byte records to <path> through the writer task\r\n\r\n",
+    CmdLfsWriterBench,
+    3
+};
+
+void TEST_LFS_WRITER_init(void)
+{
+    if(bInit) {
+        return;
+    }
+    FreeRTOS_CLIRegisterCommand(&lfs_writer_bench);
+    bInit = true;
+}
+
+#endif /* CONFIG_TEST_LFS_WRITER */
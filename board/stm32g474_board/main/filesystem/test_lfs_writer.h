@@ -0,0 +1,19 @@
+/*
+ * test_lfs_writer.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef FILESYSTEM_TEST_LFS_WRITER_H_
+#define FILESYSTEM_TEST_LFS_WRITER_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_LFS_WRITER
+
+void TEST_LFS_WRITER_init(void);
+
+#endif /* CONFIG_TEST_LFS_WRITER */
+
+#endif /* FILESYSTEM_TEST_LFS_WRITER_H_ */
@@ -0,0 +1,236 @@
+/*
+ * test_rawlog.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_RAWLOG
+
+#include "string.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS-Plus-CLI/FreeRTOS_CLI.h"
+#include "cli.h"
+#include "rawlog.h"
+#include "test_rawlog.h"
+#include "bsp/bsp_cycle.h"
+
+#define TEST_RAWLOG_RECORD_SIZE     (64)    // one CAN FD frame record
+
+static bool bInit = false;
+
+static BaseType_t CmdRawInfo(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    const RAWLOG_INFO_T * pInfo = RAWLOG_getInfo();
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tRegion: LBA %lu, %lu chunks of %lu bytes\r\n"
+            "\tHead %lu, seq %lu, used %lu chunks\r\n"
+            "\tScan: %lu header reads in %lu ms\r\n"
+            "\tWritten %lu chunks, %lu bytes in, longest write %lu ms, error %ld\r\n\r\n",
+            pInfo->firstLba, pInfo->chunks, RAWLOG_CHUNK_SIZE,
+            pInfo->head, pInfo->seq, pInfo->used,
+            pInfo->scanReads, pInfo->scanMs,
+            pInfo->chunksWritten, pInfo->bytesIn, pInfo->maxWriteMs, pInfo->error);
+    return 0;
+}
+
+static const CLI_Command_Definition_t raw_info = {
+    "raw_info",
+    "raw_info:\r\n"
+    "\tShows the raw log region, head and write statistics\r\n\r\n",
+    CmdRawInfo,
+    0
+};
+
+
+static BaseType_t CmdRawFormat(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+    snprintf(pcWriteBuffer, xWriteBufferLen, "\tRAWLOG_format returns %ld\r\n\r\n",
+            RAWLOG_format());
+    return 0;
+}
+
+static const CLI_Command_Definition_t raw_format = {
+    "raw_format",
+    "raw_format:\r\n"
+    "\tTrims the raw log region and starts over\r\n\r\n",
+    CmdRawFormat,
+    0
+};
+
+
+/* Appends <KB> of 64-byte records as fast as possible, then flushes */
+static BaseType_t CmdRawBench(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    static uint32_t record[TEST_RAWLOG_RECORD_SIZE / sizeof(uint32_t)];
+    uint32_t kbytes;
+    uint32_t total;
+    uint32_t produced = 0;
+    uint32_t cycles;
+    uint32_t maxCycles = 0;
+    uint32_t ms;
+    TickType_t tickStart;
+    int32_t ret = RAWLOG_ERR_NONE;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if((CLI_parseU32(pcCommandString, 1, &kbytes) != true) || (kbytes == 0)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+
+    total = kbytes * 1024;
+    tickStart = xTaskGetTickCount();
+    while((produced < total) && (ret == RAWLOG_ERR_NONE)) {
+        record[0] = produced / sizeof(record);
+        cycles = BSP_CYCLE_get();
+        ret = RAWLOG_append(record, sizeof(record));
+        cycles = BSP_CYCLE_get() - cycles;
+        if(cycles > maxCycles) {
+            maxCycles = cycles;
+        }
+        produced += sizeof(record);
+    }
+    if(ret == RAWLOG_ERR_NONE) {
+        ret = RAWLOG_flush();
+    }
+    ms = (xTaskGetTickCount() - tickStart) * portTICK_PERIOD_MS;
+    if(ms == 0) {
+        ms = 1;
+    }
+
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\t%lu bytes in %lu ms, %lu KB/s, error %ld\r\n"
+            "\tProducer max %lu us per record\r\n\r\n",
+            produced, ms, (uint32_t)(((uint64_t)produced * 1000) / ((uint64_t)ms * 1024)),
+            ret, BSP_CYCLE_to_us(maxCycles));
+    return 0;
+}
+
+static const CLI_Command_Definition_t raw_bench = {
+    "raw_bench",
+    "raw_bench <KB>:\r\n"
+    "\tAppends <KB> of 64-byte records to the raw log\r\n\r\n",
+    CmdRawBench,
+    1
+};
+
+
+static BaseType_t CmdRawVerify(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    RAWLOG_HDR_T hdr;
+    uint32_t n;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    if(CLI_parseU32(pcCommandString, 1, &n) != true) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: Parameter1 value is invalid!\r\n\r\n");
+        return 0;
+    }
+    ret = RAWLOG_verify(n, &hdr);
+    if((ret != RAWLOG_ERR_NONE) && (ret != RAWLOG_ERR_CRC)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tRAWLOG_verify error %ld\r\n\r\n", ret);
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tChunk %lu: seq %lu, tick %lu ms, %lu bytes, crc %08lx %s\r\n\r\n",
+            n, hdr.seq, hdr.tick, hdr.len, hdr.crc,
+            (ret == RAWLOG_ERR_NONE) ? "OK" : "BAD");
+    return 0;
+}
+
+static const CLI_Command_Definition_t raw_verify = {
+    "raw_verify",
+    "raw_verify <n>:\r\n"
+    "\tChecks the CRC of chunk <n>, counted from the oldest\r\n\r\n",
+    CmdRawVerify,
+    1
+};
+
+
+/*
+ * Tears the head chunk like a reset during its write. The scan has to
+ * find the same head and seq again, and keep the rest of the region.
+ */
+static BaseType_t CmdRawTear(
+                char *pcWriteBuffer,
+                size_t xWriteBufferLen,
+                const char *pcCommandString )
+{
+    const RAWLOG_INFO_T * pInfo = RAWLOG_getInfo();
+    uint32_t head;
+    uint32_t seq;
+    uint32_t used;
+    int32_t ret;
+
+    memset(pcWriteBuffer, 0, xWriteBufferLen);
+
+    ret = RAWLOG_flush();
+    if(ret == RAWLOG_ERR_NONE) {
+        head = pInfo->head;
+        seq = pInfo->seq;
+        /* The torn chunk held the oldest one once the region is full */
+        used = (pInfo->used == pInfo->chunks) ? (pInfo->chunks - 1) : pInfo->used;
+        ret = RAWLOG_simTear();
+    }
+    if(ret != RAWLOG_ERR_NONE) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                "\tError: %ld\r\n\r\n", ret);
+        return 0;
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen,
+            "\tHead %lu/%lu, seq %lu/%lu, used %lu/%lu (expected/scanned), %lu reads\r\n"
+            "\t%s\r\n\r\n",
+            head, pInfo->head, seq, pInfo->seq, used, pInfo->used, pInfo->scanReads,
+            ((pInfo->head == head) && (pInfo->seq == seq) && (pInfo->used == used)) ?
+            "PASS" : "FAIL");
+    return 0;
+}
+
+static const CLI_Command_Definition_t raw_tear = {
+    "raw_tear",
+    "raw_tear:\r\n"
+    "\tTears the head chunk and checks the recovery scan\r\n\r\n",
+    CmdRawTear,
+    0
+};
+
+
+void TEST_RAWLOG_init(void)
+{
+    if(bInit) {
+        return;
+    }
+    FreeRTOS_CLIRegisterCommand(&raw_info);
+    FreeRTOS_CLIRegisterCommand(&raw_format);
+    FreeRTOS_CLIRegisterCommand(&raw_bench);
+    FreeRTOS_CLIRegisterCommand(&raw_verify);
+    FreeRTOS_CLIRegisterCommand(&raw_tear);
+    bInit = true;
+}
+
+#endif /* CONFIG_TEST_RAWLOG */
@@ -0,0 +1,19 @@
+/*
+ * test_rawlog.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef FILESYSTEM_TEST_RAWLOG_H_
+#define FILESYSTEM_TEST_RAWLOG_H_
+
+#include "logger_conf.h"
+
+#if CONFIG_TEST_RAWLOG
+
+void TEST_RAWLOG_init(void);
+
+#endif /* CONFIG_TEST_RAWLOG */
+
+#endif /* FILESYSTEM_TEST_RAWLOG_H_ */
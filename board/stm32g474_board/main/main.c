@@ -5,9 +5,15 @@
  * @brief          : Main program body
  ******************************************************************************
  */
+#include "stdio.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "bsp/sdcard/sdcard.h"
+#include "blockdev/blockdev.h"
+#include "filesystem/lfs_sd.h"
+#include "filesystem/lfs_writer.h"
+#include "filesystem/rawlog.h"
+#include "capture/capture.h"
 #include "bsp/board_api.h"
 #include "bsp/lpuart.h"
 #include "cli.h"
@@ -18,6 +24,42 @@ static TaskHandle_t taskHandle_main = NULL;
 static StaticTask_t taskStruct_main;
 static StackType_t taskStackStorage[MAIN_TASK_STACK_SIZE];
 
+#if CONFIG_LFS_SD_BOOT_LOG
+/*
+ * Mounts the filesystem and appends the boot time to boot.log. The time
+ * until that record is synced is the boot-to-first-write latency.
+ */
+static void mainBootLog(void)
+{
+    const LFS_SD_MOUNT_STATS_T * pMount;
+    char record[16];
+    int32_t len;
+    int32_t fd;
+    int32_t ret;
+
+    if(lfs_sd_mount() == NULL) {
+        CLI_printf("lfs_sd_mount failed\r\n");
+        return;
+    }
+    fd = lfs_sd_fopenFlags("boot.log", LFS_O_CREAT | LFS_O_WRONLY | LFS_O_APPEND);
+    if(fd < 0) {
+        CLI_printf("boot.log open error %ld\r\n", fd);
+        return;
+    }
+    len = snprintf(record, sizeof(record), "%lu\n", xTaskGetTickCount() * portTICK_PERIOD_MS);
+    ret = lfs_sd_fwrite(fd, record, len);
+    if(ret >= 0) {
+        ret = lfs_sd_fsync(fd);
+    }
+    lfs_sd_fclose(fd);
+
+    pMount = lfs_sd_getMountStats();
+    CLI_printf("Boot to first write %lu ms, mount %lu ms, alloc hint %s, error %ld\r\n",
+            xTaskGetTickCount() * portTICK_PERIOD_MS, pMount->mountMs,
+            pMount->bHint ? "used" : "none", (ret < 0) ? ret : 0);
+}
+#endif /* CONFIG_LFS_SD_BOOT_LOG */
+
 static void mainTask(void * pvParam)
 {
     TickType_t xLastWakeTime;
@@ -31,6 +73,18 @@ static void mainTask(void * pvParam)
         ret = SDCARD_Init();
         if(SDCARD_ERR_NONE == ret) {
             CLI_printf("SDCARD_Init OK\r\n");
+#if CONFIG_USE_BLOCKDEV
+            BLOCKDEV_init();
+#endif /* CONFIG_USE_BLOCKDEV */
+#if CONFIG_USE_RAWLOG
+            ret = RAWLOG_init();
+            if(RAWLOG_ERR_NONE != ret) {
+                CLI_printf("RAWLOG_init return %d\r\n", ret);
+            }
+#endif /* CONFIG_USE_RAWLOG */
+#if CONFIG_LFS_SD_BOOT_LOG
+            mainBootLog();
+#endif /* CONFIG_LFS_SD_BOOT_LOG */
             break;
         } else {
             retry++;
@@ -49,6 +103,12 @@ static void mainTask(void * pvParam)
 #if CONFIG_TEST_LFS_SD
     TEST_LFS_Init();
 #endif /* CONFIG_TEST_LFS_SD */
+#if CONFIG_USE_LFS_WRITER
+    LFS_WRITER_init();
+#endif /* CONFIG_USE_LFS_WRITER */
+#if CONFIG_USE_CAPTURE
+    CAPTURE_init();
+#endif /* CONFIG_USE_CAPTURE */
 
     xLastWakeTime = xTaskGetTickCount();
     while(1) {
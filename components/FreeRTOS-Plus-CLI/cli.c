@@ -7,6 +7,8 @@
 
 #include "stdbool.h"
 #include "stdio.h"
+#include "stdlib.h"
+#include "errno.h"
 #include "stdarg.h"
 #include "string.h"
 #include "FreeRTOS.h"
@@ -294,3 +296,35 @@ int32_t CLI_printf(const char * format, ...)
 #endif
     return retval;
 }
+
+
+bool CLI_parseU32(const char * pcCommandString, uint32_t paramIdx, uint32_t * pValue)
+{
+    const char * ptrStrParam;
+    BaseType_t strParamLen;
+    char tmpStr[12];
+    char * ptrEnd;
+    unsigned long u32Temp;
+
+    if((pcCommandString == NULL) || (pValue == NULL)) {
+        return false;
+    }
+    ptrStrParam = FreeRTOS_CLIGetParameter(pcCommandString, paramIdx, &strParamLen);
+    if((ptrStrParam == NULL) || (strParamLen > (sizeof(tmpStr) - 1))) {
+        return false;
+    }
+    memcpy(tmpStr, ptrStrParam, strParamLen);
+    tmpStr[strParamLen] = '\0';
+    if(tmpStr[0] == '-') {
+        /* strtoul() would wrap it */
+        return false;
+    }
+    errno = 0;
+    u32Temp = strtoul(tmpStr, &ptrEnd, 0);
+    if((ptrEnd == tmpStr) || (*ptrEnd != '\0') || (errno == ERANGE) ||
+       (u32Temp > UINT32_MAX)) {
+        return false;
+    }
+    *pValue = (uint32_t)u32Temp;
+    return true;
+}
@@ -8,6 +8,9 @@
 #ifndef FREERTOS_PLUS_CLI_CLI_H_
 #define FREERTOS_PLUS_CLI_CLI_H_
 
+#include "stdint.h"
+#include "stdbool.h"
+
 #define CLI_ERR_INVALID_ARG          (-1)
 #define CLI_ERR_INVALID_STATE        (-2)
 #define CLI_ERR_MUTEX                (-3)
@@ -16,5 +19,10 @@
 void CLI_init(void);
 void CLI_Receive(uint8_t* pBuf, uint32_t len);
 int32_t CLI_printf(const char * format, ...);
+/*
+ * Parameter paramIdx of a command line as an unsigned 32-bit value,
+ * decimal, hex (0x) or octal (0). False if missing or not a number.
+ */
+bool CLI_parseU32(const char * pcCommandString, uint32_t paramIdx, uint32_t * pValue);
 
 #endif /* FREERTOS_PLUS_CLI_CLI_H_ */